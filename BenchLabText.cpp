@@ -0,0 +1,1145 @@
+#define LABTEXT_ODR
+#include "include/LabText/LabText.h"
+#include "include/LabText/LabTextBind.h"
+#include "include/LabText/LabTextGrammar.h"
+#include <chrono>
+#include <ctype.h>
+#include <filesystem>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+using lab::Text::StrView;
+
+// every heap allocation made by the benchmarks is counted
+static size_t allocations = 0;
+
+void* operator new(size_t sz)
+{
+    ++allocations;
+    if (void* p = malloc(sz ? sz : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+// Best of several runs, in milliseconds.
+template <class F>
+static double Time(F&& fn, int runs = 15)
+{
+    double best = 1e30;
+    for (int i = 0; i < runs; ++i) {
+        auto start = std::chrono::high_resolution_clock::now();
+        fn();
+        auto end = std::chrono::high_resolution_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        if (ms < best)
+            best = ms;
+    }
+    return best;
+}
+
+static void Report(char const* name, double ms, size_t bytes)
+{
+    printf("%-40s %9.3f ms %9.1f MB/s\n", name, ms, (double) bytes / (ms * 1e3));
+}
+
+//-----------------------------------------------------------------------------
+// key = value lines, parsed by hand chained StrView calls and by a grammar
+//-----------------------------------------------------------------------------
+
+static void BenchGrammar()
+{
+    std::string doc;
+    for (int i = 0; i < 200000; ++i) {
+        doc += "  key_";
+        doc += std::to_string(i);
+        doc += " = ";
+        doc += std::to_string(i % 977);
+        doc += ".25\n";
+    }
+    StrView input(doc);
+
+    double handSum = 0;
+    size_t handCount = 0;
+    double hand = Time([&]() {
+        handSum = 0;
+        handCount = 0;
+        StrView curr = input;
+        StrView key;
+        float value;
+        while (curr.sz > 0) {
+            curr = curr.GetTokenAlphaNumericExt("_", key);
+            if (!key.sz)
+                break;
+            curr = curr.ScanForNonWhiteSpace();
+            StrView next = curr.Expect("=");
+            if (next.curr == curr.curr)
+                break;
+            curr = next.GetFloat(value);
+            handSum += value;
+            ++handCount;
+            curr = curr.ScanForBeginningOfNextLine();
+        }
+    });
+
+    double gramSum = 0;
+    size_t gramCount = 0;
+    double gram = Time([&]() {
+        using namespace lab::Text::Grammar;
+        gramSum = 0;
+        gramCount = 0;
+        StrView key;
+        float value;
+        auto line = tok(token(identifier, key)) >> tok('=') >> tok(number(value)) >> ws;
+        StrView curr = input;
+        while (Parse(line, curr)) {
+            gramSum += value;
+            ++gramCount;
+        }
+    });
+
+    if (handCount != gramCount || handSum != gramSum)
+        printf("grammar mismatch: %zu %zu %f %f\n", handCount, gramCount, handSum, gramSum);
+    Report("key = value, hand chained", hand, doc.size());
+    Report("key = value, grammar", gram, doc.size());
+}
+
+//-----------------------------------------------------------------------------
+// long numeric lists, token by token versus in bulk
+//-----------------------------------------------------------------------------
+
+static void BenchNumberArrays()
+{
+    std::string ints;
+    std::string floats;
+    for (int i = 0; i < 500000; ++i) {
+        ints += std::to_string((i * 7919u) % 100000);
+        ints += ' ';
+        floats += std::to_string((i * 7919u) % 1000);
+        floats += ".125 ";
+    }
+
+    size_t count = 0;
+    double handInts = Time([&]() {
+        count = 0;
+        StrView curr(ints);
+        int32_t v;
+        while (true) {
+            StrView next = curr.GetInt32(v);
+            if (next.curr == curr.curr)
+                break;
+            ++count;
+            curr = next;
+        }
+    });
+    std::vector<int64_t> intOut;
+    double bulkInts = Time([&]() {
+        intOut.clear();
+        lab::Text::ParseNumberArray(StrView(ints), tsNumberSeparatorWhiteSpace, intOut);
+    });
+    if (count != intOut.size())
+        printf("integer count mismatch %zu %zu\n", count, intOut.size());
+
+    double handFloats = Time([&]() {
+        count = 0;
+        StrView curr(floats);
+        float v;
+        while (true) {
+            StrView next = curr.GetFloat(v);
+            if (next.curr == curr.curr)
+                break;
+            ++count;
+            curr = next;
+        }
+    });
+    std::vector<double> floatOut;
+    double bulkFloats = Time([&]() {
+        floatOut.clear();
+        lab::Text::ParseNumberArray(StrView(floats), tsNumberSeparatorWhiteSpace, floatOut);
+    });
+    if (count != floatOut.size())
+        printf("float count mismatch %zu %zu\n", count, floatOut.size());
+
+    Report("integers, GetInt32 loop", handInts, ints.size());
+    Report("integers, ParseNumberArray", bulkInts, ints.size());
+    Report("floats, GetFloat loop", handFloats, floats.size());
+    Report("floats, ParseNumberArray", bulkFloats, floats.size());
+
+    std::string doc = "(samples " + ints + ")\n(curve " + floats + ")\n";
+    double sexpr = Time([&]() {
+        lab::Text::Sexpr s(StrView{ doc });
+    });
+    Report("numeric lists, Sexpr", sexpr, doc.size());
+    lab::Text::SexprOptions options;
+    options.trackOffsets = true;
+    double tracked = Time([&]() {
+        lab::Text::Sexpr s(StrView{ doc }, options);
+    });
+    Report("numeric lists, Sexpr with offsets", tracked, doc.size());
+
+    // the C parser converts numbers one token at a time; the bulk path must
+    // agree with it on values and offsets, including on digit runs longer
+    // than a SIMD window
+    std::string runs = doc + "(runs 1234567890123456789012345678901234567890 "
+                             "-98765432109876543210987654321098765 "
+                             "3.14159265358979323846264338327950288419 "
+                             "12345678901234567890123456789012345678.5 7 8)\n";
+    lab::Text::Sexpr fast{ StrView{ runs }, options };
+    tsParsedSexpr_t* head = tsParsedSexpr_New();
+    tsSexprOffsets_t offsets = {};
+    tsStrView_t str = { runs.data(), runs.size() };
+    tsStrViewParseSexprWithOffsets(&str, head, 0, &offsets);
+    bool same = offsets.count == fast.expr.size();
+    size_t n = 0;
+    for (tsParsedSexpr_t* c = head->next; same && c; c = c->next, ++n) {
+        auto const& e = fast.expr[n];
+        same = e.token == c->token && fast.offsets[n] == offsets.offsets[n] &&
+               (e.token != tsSexprInteger || fast.ints[e.ref] == (int) c->i) &&
+               (e.token != tsSexprFloat || fast.floats[e.ref] == (float) c->f);
+    }
+    if (!same || n != fast.expr.size())
+        printf("numeric fast path mismatch\n");
+    tsSexprOffsets_Free(&offsets);
+    tsParsedSexpr_Free(head);
+}
+
+//-----------------------------------------------------------------------------
+// mixed keyword, integer, float and hex atoms, as found in node graphs
+//-----------------------------------------------------------------------------
+
+// counts the elements of a document, storing nothing
+struct CountingVisitor {
+    size_t count = 0;
+    void OnPush() { ++count; }
+    void OnPop() { ++count; }
+    void OnAtom(StrView) { ++count; }
+    void OnInt(int64_t) { ++count; }
+    void OnFloat(double) { ++count; }
+    void OnString(StrView) { ++count; }
+};
+
+static void CountElement(void* user) { ++*(size_t*) user; }
+static void CountView(void* user, tsStrView_t) { ++*(size_t*) user; }
+static void CountInt(void* user, int64_t) { ++*(size_t*) user; }
+static void CountFloat(void* user, double) { ++*(size_t*) user; }
+
+static std::string AtomsDocument()
+{
+    std::string doc;
+    for (int i = 0; i < 100000; ++i) {
+        doc += "(ls-node :name \"Gain-";
+        doc += std::to_string(i);
+        doc += "\" :pos ";
+        doc += std::to_string(i % 1500);
+        doc += " ";
+        doc += std::to_string((i * 7u) % 900);
+        doc += " :value 0.125 :scale 1e-3 :color 0x7f7f7fff :id -";
+        doc += std::to_string(i);
+        doc += ")\n";
+    }
+    return doc;
+}
+
+static void BenchAtoms()
+{
+    std::string doc = AtomsDocument();
+
+    double cpp = Time([&]() {
+        lab::Text::Sexpr s(StrView{ doc });
+    });
+    lab::Text::SexprOptions options;
+    options.trackOffsets = true;
+    double cppOffsets = Time([&]() {
+        lab::Text::Sexpr s(StrView{ doc }, options);
+    });
+    double c = Time([&]() {
+        tsStrView_t s = { doc.data(), doc.size() };
+        tsParsedSexpr_t* root = tsParsedSexpr_New();
+        tsStrViewParseSexpr(&s, root, 0);
+        tsParsedSexpr_Free(root);
+    });
+
+    size_t visited = 0;
+    double visit = Time([&]() {
+        CountingVisitor v;
+        lab::Text::VisitSexpr(StrView{ doc }, v);
+        visited = v.count;
+    });
+    size_t cVisited = 0;
+    double cVisit = Time([&]() {
+        tsSexprVisitor_t v = { CountElement, CountElement, CountView, CountInt, CountFloat, CountView };
+        tsStrView_t s = { doc.data(), doc.size() };
+        cVisited = 0;
+        tsStrViewVisitSexpr(&s, &v, &cVisited, nullptr, 0);
+    });
+    if (visited != cVisited || visited != lab::Text::Sexpr(StrView{ doc }).expr.size())
+        printf("visited element count mismatch\n");
+
+    size_t pulled = 0;
+    double pull = Time([&]() {
+        lab::Text::SexprTokenizer t(StrView{ doc });
+        lab::Text::SexprToken tok;
+        pulled = 0;
+        while (t.Next(tok) == lab::Text::SexprTokenizer::Token)
+            ++pulled;
+    });
+    size_t chunked = 0;
+    size_t before = 0;
+    double pullChunked = Time([&]() {
+        lab::Text::SexprTokenizer t;
+        lab::Text::SexprToken tok;
+        size_t at = 0;
+        chunked = 0;
+        before = allocations;
+        while (true) {
+            lab::Text::SexprTokenizer::Status st = t.Next(tok);
+            if (st == lab::Text::SexprTokenizer::Token)
+                ++chunked;
+            else if (st != lab::Text::SexprTokenizer::NeedInput)
+                break;
+            else if (at == doc.size())
+                t.Finish();
+            else {
+                size_t n = doc.size() - at < 4096 ? doc.size() - at : 4096;
+                t.Feed(StrView{ doc.data() + at, n });
+                at += n;
+            }
+        }
+    });
+    size_t chunkedAllocations = allocations - before;
+    if (pulled != visited || chunked != visited)
+        printf("tokenized element count mismatch\n");
+
+    Report("atoms, Sexpr", cpp, doc.size());
+    Report("atoms, Sexpr with offsets", cppOffsets, doc.size());
+    Report("atoms, tsStrViewParseSexpr", c, doc.size());
+    Report("atoms, VisitSexpr", visit, doc.size());
+    Report("atoms, tsStrViewVisitSexpr", cVisit, doc.size());
+    Report("atoms, SexprTokenizer", pull, doc.size());
+    Report("atoms, SexprTokenizer in 4k chunks", pullChunked, doc.size());
+    printf("chunked tokenizer allocations: %d for %d tokens\n", (int) chunkedAllocations, (int) chunked);
+}
+
+//-----------------------------------------------------------------------------
+// a stream of small messages, each parsed into a new Sexpr or by a SexprParser
+//-----------------------------------------------------------------------------
+
+static void BenchMessages()
+{
+    std::vector<std::string> messages;
+    size_t bytes = 0;
+    for (int i = 0; i < 20000; ++i) {
+        std::string m = "(set :node \"Oscillator-" + std::to_string(i % 97) + "\" :param frequency :value ";
+        m += std::to_string(i % 1000) + ".5 :ramp 0.125 :tag a-rather-long-message-identifier-" + std::to_string(i % 13) + ")";
+        bytes += m.size();
+        messages.push_back(std::move(m));
+    }
+
+    double fresh = Time([&]() {
+        for (auto& m : messages)
+            lab::Text::Sexpr s(StrView{ m });
+    });
+    size_t before = allocations;
+    for (auto& m : messages)
+        lab::Text::Sexpr s(StrView{ m });
+    size_t freshAllocations = allocations - before;
+
+    lab::Text::SexprParser parser;
+    double reused = Time([&]() {
+        for (auto& m : messages)
+            parser.Parse(StrView{ m });
+    });
+    before = allocations;
+    for (auto& m : messages)
+        parser.Parse(StrView{ m });
+    size_t reusedAllocations = allocations - before;
+
+    Report("messages, Sexpr", fresh, bytes);
+    Report("messages, SexprParser", reused, bytes);
+    printf("allocations per message: Sexpr %.2f, SexprParser %.2f\n",
+           (double) freshAllocations / messages.size(), (double) reusedAllocations / messages.size());
+}
+
+//-----------------------------------------------------------------------------
+// keystrokes in a large document, each followed by Sexpr::Reparse
+//-----------------------------------------------------------------------------
+
+static void BenchEdits()
+{
+    // about 10MB, in whole forms
+    std::string doc = AtomsDocument();
+    std::string more = AtomsDocument();
+    doc += more.substr(0, more.find('\n', 10 * 1024 * 1024 - doc.size()) + 1);
+    lab::Text::SexprOptions options;
+    options.trackOffsets = true;
+    double full = Time([&]() {
+        lab::Text::Sexpr s(StrView{ doc }, options);
+    }, 3);
+    lab::Text::Sexpr tree(StrView{ doc }, options);
+
+    // alternately type a digit into a value, which moves everything after
+    // it, and add an element, which also moves the elements after it
+    using clock = std::chrono::steady_clock;
+    double total = 0, worst = 0;
+    int edits = 200, incremental = 0;
+    for (int i = 0; i < edits; ++i) {
+        size_t at = doc.find(":value 0.125", (doc.size() / edits) * i);
+        lab::Text::SexprEdit edit;
+        if (i & 1) {
+            edit.offset = at + 11;
+            edit.inserted = 1;
+            doc.insert(edit.offset, "7");
+        }
+        else {
+            edit.offset = at;
+            edit.inserted = 8;
+            doc.insert(edit.offset, ":tag 42 ");
+        }
+        auto t0 = clock::now();
+        incremental += tree.Reparse(StrView{ doc }, edit, options);
+        double ms = std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+        total += ms;
+        worst = ms > worst ? ms : worst;
+    }
+    if (tree.expr.size() != lab::Text::Sexpr(StrView{ doc }, options).expr.size())
+        printf("reparsed element count mismatch\n");
+
+    Report("edits, full parse of document", full, doc.size());
+    printf("edits, Reparse of %.1f MB: mean %.3f ms, worst %.3f ms, %d of %d incremental\n",
+           doc.size() / (1024.0 * 1024.0), total / edits, worst, incremental, edits);
+}
+
+//-----------------------------------------------------------------------------
+// indented source with long comments, and a commented s-expression file
+//-----------------------------------------------------------------------------
+
+static void BenchComments()
+{
+    std::string src;
+    std::string lisp;
+    for (int i = 0; src.size() < 8 * 1024 * 1024; ++i) {
+        src += "/* ";
+        for (int j = 0; j < 6; ++j)
+            src += "a block comment that runs across several lines of prose\n   ";
+        src += "*/\n";
+        src += "                // a line comment, indented as it would be in a nested scope\n";
+        src += "                x" + std::to_string(i) + " = 1;\n";
+        lisp += "    ; a comment describing the node that follows, as a tool might write it\n";
+        lisp += "    (node :name n" + std::to_string(i) + " :value 0.125)\n";
+    }
+    lisp = "(graph\n" + lisp + ")\n";
+
+    size_t statements = 0;
+    double ms = Time([&]() {
+        statements = 0;
+        char const* p = src.data();
+        char const* end = p + src.size();
+        while (true) {
+            p = tsSkipCommentsAndWhitespace(p, end);
+            if (p == end)
+                break;
+            p = tsScanForEndOfLine(p, end);
+            ++statements;
+        }
+    });
+    Report("comments, skip C++ comments and indentation", ms, src.size());
+
+    ms = Time([&]() {
+        lab::Text::Sexpr s(StrView{ lisp });
+    }, 5);
+    Report("comments, commented Sexpr", ms, lisp.size());
+    if (!statements)
+        printf("no statements found\n");
+}
+
+//-----------------------------------------------------------------------------
+// parsing a document again, through a SexprCache
+//-----------------------------------------------------------------------------
+
+static void BenchCache()
+{
+#ifdef LABTEXT_SEXPR_CACHE
+    std::string doc = AtomsDocument();
+    std::string dir = (std::filesystem::temp_directory_path() / "LabTextBenchCache").string();
+    lab::Text::SexprCache cache(dir);
+    cache.Clear();
+
+    double parse = Time([&]() {
+        lab::Text::Sexpr s(StrView{ doc });
+    });
+    auto t0 = std::chrono::steady_clock::now();
+    size_t elements = cache.Parse(StrView{ doc }).expr.size();
+    double store = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    double load = Time([&]() {
+        if (cache.Parse(StrView{ doc }).expr.size() != elements)
+            printf("cached element count mismatch\n");
+    });
+    double hash = Time([&]() {
+        volatile uint64_t h = tsHashBytes(doc.data(), doc.size(), 0);
+        (void) h;
+    });
+
+    Report("cache, parse", parse, doc.size());
+    Report("cache, miss: parse and store", store, doc.size());
+    Report("cache, hit: load image", load, doc.size());
+    Report("cache, tsHashBytes", hash, doc.size());
+    cache.Clear();
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// one FrozenSexpr queried from several threads at once
+//-----------------------------------------------------------------------------
+
+static void BenchShared()
+{
+    std::string doc = AtomsDocument();
+    lab::Text::FrozenSexpr graph{ StrView{ doc } };
+    lab::Text::Sexpr const& tree = graph.Tree();
+
+    // look up two keywords in every node, and walk every :name
+    auto query = [&]() {
+        int64_t sum = 0;
+        int nodes = (int) tree.expr.size();
+        for (int node = 0; node < nodes; node = graph.End(node)) {
+            int id = graph.Find(node, StrView{ ":id" });
+            int name = graph.Find(node, StrView{ ":name" });
+            sum += tree.ints[tree.expr[id].ref] + graph.SymbolOf(name);
+        }
+        for (int e : graph.Keyword(StrView{ ":name" }))
+            sum += graph.Parent(e);
+        return sum;
+    };
+
+    unsigned maxThreads = std::thread::hardware_concurrency();
+    if (maxThreads < 4)
+        maxThreads = 4;
+    double single = 0;
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        std::vector<int64_t> sums(threads);
+        auto run = [&]() {
+            std::vector<std::thread> pool;
+            for (unsigned t = 0; t < threads; ++t)
+                pool.emplace_back([&, t]() { sums[t] = query(); });
+            for (auto& t : pool)
+                t.join();
+        };
+        run();  // the first run races to build the indexes
+        double ms = Time(run, 5);
+        for (int64_t sum : sums)
+            if (sum != sums[0])
+                printf("shared query results differ\n");
+        if (threads == 1)
+            single = ms;
+        // every thread does the whole workload, so perfect scaling holds the time constant
+        printf("shared queries, %2u threads %14.3f ms     speedup %.2fx\n", threads, ms, single * threads / ms);
+    }
+    printf("(%u hardware threads)\n", std::thread::hardware_concurrency());
+}
+
+//-----------------------------------------------------------------------------
+// the atoms document as JSON, against the same document as s-expressions
+//-----------------------------------------------------------------------------
+
+static void BenchJson()
+{
+    std::string sexpr = AtomsDocument();
+    std::string json = "[\n";
+    for (int i = 0; i < 100000; ++i) {
+        json += i ? ",\n" : "";
+        json += "{\"type\": \"ls-node\", \"name\": \"Gain-";
+        json += std::to_string(i);
+        json += "\", \"pos\": [";
+        json += std::to_string(i % 1500);
+        json += ", ";
+        json += std::to_string((i * 7u) % 900);
+        json += "], \"value\": 0.125, \"scale\": 1e-3, \"color\": 2139062271, \"id\": -";
+        json += std::to_string(i);
+        json += "}";
+    }
+    json += "\n]\n";
+
+    lab::Text::SexprOptions options;
+    options.json = true;
+    size_t elements[2] = {};
+    double sexprMs = Time([&]() {
+        lab::Text::Sexpr s{ StrView{ sexpr } };
+        elements[0] = s.expr.size();
+    }, 5);
+    double jsonMs = Time([&]() {
+        lab::Text::Sexpr s(StrView{ json }, options);
+        elements[1] = s.expr.size();
+    }, 5);
+    lab::Text::SexprParser parser;
+    parser.Parse(StrView{ json }, options);
+    double reusedMs = Time([&]() {
+        parser.Parse(StrView{ json }, options);
+    }, 5);
+    Report("json, Sexpr of the s-expressions", sexprMs, sexpr.size());
+    Report("json, Sexpr of the JSON", jsonMs, json.size());
+    Report("json, SexprParser of the JSON", reusedMs, json.size());
+    printf("json, %.1f M elements per second from s-expressions, %.1f M from JSON\n",
+           elements[0] / (sexprMs * 1e3), elements[1] / (jsonMs * 1e3));
+}
+
+//-----------------------------------------------------------------------------
+// a large CSV file, by Split per line, by DelimitedReader, and in chunks
+//-----------------------------------------------------------------------------
+
+static void BenchDelimited()
+{
+    std::string csv;
+    for (int i = 0; csv.size() < 64 * 1024 * 1024; ++i) {
+        csv += std::to_string(i);
+        csv += ",sensor-";
+        csv += std::to_string(i % 977);
+        csv += ",\"Room ";
+        csv += std::to_string(i % 31);
+        csv += ", north wall\",";
+        csv += std::to_string((i % 1000) * 0.25);
+        csv += ",";
+        csv += std::to_string(i % 4096);
+        csv += "\n";
+    }
+    StrView all{ csv };
+
+    double sums[3] = {};
+    double ms = Time([&]() {
+        double sum = 0;
+        StrView curr = all;
+        while (curr.sz) {
+            StrView line;
+            curr = curr.ScanForEndofLine(line);
+            std::vector<StrView> fields = lab::Text::Split(line, ',');
+            float value;
+            if (fields.size() > 4 && fields[4].sz) {
+                fields[4].GetFloat(value);
+                sum += value;
+            }
+        }
+        sums[0] = sum;
+    }, 3);
+    Report("delimited, Split per line", ms, csv.size());
+
+    auto read = [](StrView s) {
+        double sum = 0;
+        lab::Text::DelimitedReader reader(s);
+        std::vector<StrView> fields;
+        while (reader.Next(fields)) {
+            double value;
+            if (fields.size() > 4 && lab::Text::DelimitedReader::GetDouble(fields[4], value))
+                sum += value;
+        }
+        return sum;
+    };
+    ms = Time([&]() { sums[1] = read(all); }, 3);
+    Report("delimited, DelimitedReader", ms, csv.size());
+
+    unsigned threads = std::thread::hardware_concurrency();
+    if (threads < 2)
+        threads = 2;
+    ms = Time([&]() {
+        std::vector<StrView> chunks = lab::Text::DelimitedReader::Chunks(all, threads);
+        std::vector<double> partial(chunks.size());
+        std::vector<std::thread> pool;
+        for (size_t c = 0; c < chunks.size(); ++c)
+            pool.emplace_back([&, c]() { partial[c] = read(chunks[c]); });
+        for (auto& t : pool)
+            t.join();
+        sums[2] = 0;
+        for (double p : partial)
+            sums[2] += p;
+    }, 3);
+    char name[64];
+    snprintf(name, sizeof(name), "delimited, %u chunks on threads", threads);
+    Report(name, ms, csv.size());
+    if (sums[1] != sums[2] || (float) sums[0] == 0)
+        printf("delimited sums differ\n");
+}
+
+//-----------------------------------------------------------------------------
+// a large INI file, loaded and queried by hand chained StrView calls into a
+// map, and by Config
+//-----------------------------------------------------------------------------
+
+static void BenchConfig()
+{
+    std::string ini;
+    for (int s = 0; s < 2000; ++s) {
+        ini += "# settings for unit " + std::to_string(s) + "\n[unit_" + std::to_string(s) + "]\n";
+        for (int k = 0; k < 40; ++k)
+            ini += "param_" + std::to_string(k) + " = " + std::to_string((s * 40 + k) % 1000) + ".5\n";
+    }
+    StrView input{ ini };
+
+    std::unordered_map<std::string, StrView> map;
+    double hand = Time([&]() {
+        map.clear();
+        StrView curr = input;
+        StrView section;
+        while (curr.sz) {
+            curr = curr.ScanForNonWhiteSpace();
+            if (!curr.sz)
+                break;
+            if (*curr.curr == '#' || *curr.curr == ';') {
+                curr = curr.ScanForBeginningOfNextLine();
+                continue;
+            }
+            if (*curr.curr == '[') {
+                curr = StrView(curr.curr + 1, curr.sz - 1).GetTokenAlphaNumericExt("_", section);
+                curr = curr.ScanForBeginningOfNextLine();
+                continue;
+            }
+            StrView key, line;
+            curr = curr.GetTokenAlphaNumericExt("_", key);
+            curr = curr.ScanForNonWhiteSpace().Expect("=");
+            curr = curr.ScanForEndofLine(line);
+            map[std::string(section.curr, section.sz) + "." + std::string(key.curr, key.sz)] = line.Strip();
+        }
+    }, 5);
+    double load = Time([&]() {
+        lab::Text::Config config(input);
+    }, 5);
+    lab::Text::Config config(input);
+    Report("config, load by hand into a map", hand, ini.size());
+    Report("config, load Config", load, ini.size());
+
+    // the same pseudo random lookups of both
+    std::vector<std::string> sections, keys;
+    for (int i = 0; i < 100000; ++i) {
+        sections.push_back("unit_" + std::to_string((i * 7919) % 2000));
+        keys.push_back("param_" + std::to_string((i * 31) % 40));
+    }
+    double sums[2] = {};
+    double mapMs = Time([&]() {
+        sums[0] = 0;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto it = map.find(sections[i] + "." + keys[i]);
+            float value;
+            if (it != map.end()) {
+                it->second.GetFloat(value);
+                sums[0] += value;
+            }
+        }
+    });
+    double configMs = Time([&]() {
+        sums[1] = 0;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            float value;
+            if (config.GetFloat(StrView{ sections[i] }, StrView{ keys[i] }, value))
+                sums[1] += value;
+        }
+    });
+    if (sums[0] != sums[1])
+        printf("config lookups differ: %f %f\n", sums[0], sums[1]);
+    printf("config, %zu lookups: map %.3f ms, Config %.3f ms\n", keys.size(), mapMs, configMs);
+}
+
+//-----------------------------------------------------------------------------
+// comparing, hashing and searching without regard to case, against lower
+// case copies
+//-----------------------------------------------------------------------------
+
+static std::string Lower(StrView s)
+{
+    std::string result(s.curr, s.sz);
+    for (char& c : result)
+        c = (char) tolower((unsigned char) c);
+    return result;
+}
+
+static void BenchNoCase()
+{
+    std::vector<std::string> words;
+    for (int i = 0; i < 100000; ++i)
+        words.push_back((i % 2 ? "Content-Type-" : "CONTENT-type-") + std::to_string(i % 5000) + "-Header-Value");
+    std::string text;
+    for (int i = 0; i < 20000; ++i)
+        text += "Lorem Ipsum Dolor Sit Amet " + std::to_string(i) + " ";
+    text += "The Needle In The Haystack";
+
+    size_t counts[2] = {};
+    double copyEq = Time([&]() {
+        counts[0] = 0;
+        for (size_t i = 1; i < words.size(); ++i)
+            counts[0] += Lower(StrView{ words[i - 1] }) == Lower(StrView{ words[i] });
+    });
+    double noCaseEq = Time([&]() {
+        counts[1] = 0;
+        for (size_t i = 1; i < words.size(); ++i)
+            counts[1] += StrView{ words[i - 1] }.EqualNoCase(StrView{ words[i] });
+    });
+    if (counts[0] != counts[1])
+        printf("no case equal differs: %zu %zu\n", counts[0], counts[1]);
+    printf("no case, %zu equals: lower copies %.3f ms, EqualNoCase %.3f ms\n", words.size(), copyEq, noCaseEq);
+
+    uint64_t hashes[2] = {};
+    double copyHash = Time([&]() {
+        hashes[0] = 0;
+        for (auto& w : words) {
+            std::string l = Lower(StrView{ w });
+            hashes[0] += tsHashBytes(l.data(), l.size(), 0);
+        }
+    });
+    double noCaseHash = Time([&]() {
+        hashes[1] = 0;
+        for (auto& w : words)
+            hashes[1] += StrView{ w }.HashNoCase();
+    });
+    if (hashes[0] != hashes[1])
+        printf("no case hash differs\n");
+    printf("no case, %zu hashes: lower copies %.3f ms, HashNoCase %.3f ms\n", words.size(), copyHash, noCaseHash);
+
+    StrView haystack{ text };
+    StrView needle{ "the needle" };
+    size_t found[2] = {};
+    double copyFind = Time([&]() {
+        found[0] = Lower(haystack).find(Lower(needle));
+    }, 20);
+    double noCaseFind = Time([&]() {
+        found[1] = (size_t)(haystack.FindNoCase(needle).curr - haystack.curr);
+    }, 20);
+    if (found[0] != found[1])
+        printf("no case find differs: %zu %zu\n", found[0], found[1]);
+    Report("no case, find in lower copies", copyFind, text.size());
+    Report("no case, FindNoCase", noCaseFind, text.size());
+}
+
+//-----------------------------------------------------------------------------
+// tokenizing identifiers, ASCII and UTF-8
+//-----------------------------------------------------------------------------
+
+static void BenchUtf8Tokens()
+{
+    std::string english, localized;
+    for (int i = 0; i < 100000; ++i) {
+        english += "oscillator_frequency_" + std::to_string(i % 1000) + " ";
+        localized += "Oszillator_Größe_" + std::to_string(i % 1000) + " 音量_" + std::to_string(i % 7) + " ";
+    }
+    auto tokenize = [](std::string const& text, bool utf8, size_t& count) {
+        count = 0;
+        StrView curr{ text };
+        StrView token;
+        while (curr.sz) {
+            curr = utf8 ? curr.GetTokenUtf8(nullptr, token) : curr.GetTokenAlphaNumeric(token);
+            if (!token.sz && curr.sz)
+                curr = StrView(curr.curr + 1, curr.sz - 1);
+            count += token.sz != 0;
+        }
+    };
+    size_t counts[3] = {};
+    double ascii = Time([&]() { tokenize(english, false, counts[0]); });
+    double utf8 = Time([&]() { tokenize(english, true, counts[1]); });
+    double local = Time([&]() { tokenize(localized, true, counts[2]); });
+    if (counts[0] != counts[1])
+        printf("utf8 tokens differ: %zu %zu\n", counts[0], counts[1]);
+    Report("tokens, English, AlphaNumeric", ascii, english.size());
+    Report("tokens, English, Utf8", utf8, english.size());
+    Report("tokens, localized, Utf8", local, localized.size());
+}
+
+//-----------------------------------------------------------------------------
+// splitting and counting the lines of a large log
+//-----------------------------------------------------------------------------
+
+static void BenchLines()
+{
+    std::string log;
+    for (int i = 0; log.size() < (256u << 20); ++i)
+        log += "2024-03-01T12:00:00.000Z INFO worker " + std::to_string(i % 64) +
+               " processed request " + std::to_string(i) + " in " + std::to_string(i % 997) + " us\n";
+    StrView input{ log };
+
+    size_t counts[5] = {};
+    double scan = Time([&]() {
+        counts[0] = 0;
+        for (StrView curr = input; curr.sz; curr = curr.ScanForBeginningOfNextLine())
+            ++counts[0];
+    }, 3);
+    double split = Time([&]() { counts[1] = lab::Text::Split(input, '\n').size(); }, 3);
+    double count = Time([&]() { counts[2] = lab::Text::CountLines(input, 1); }, 3);
+    double offsets = Time([&]() { counts[3] = lab::Text::LineOffsets(input, 1).size(); }, 3);
+    unsigned threads = std::thread::hardware_concurrency();
+    double parallel = Time([&]() { counts[4] = lab::Text::LineOffsets(input, threads).size(); }, 3);
+    for (size_t c : counts)
+        if (c != counts[0])
+            printf("line counts differ: %zu %zu\n", counts[0], c);
+    Report("lines, ScanForBeginningOfNextLine", scan, log.size());
+    Report("lines, Split", split, log.size());
+    Report("lines, CountLines", count, log.size());
+    Report("lines, LineOffsets", offsets, log.size());
+    char name[64];
+    snprintf(name, sizeof(name), "lines, LineOffsets on %u threads", threads);
+    Report(name, parallel, log.size());
+}
+
+//-----------------------------------------------------------------------------
+// binary blobs as hex and base64
+//-----------------------------------------------------------------------------
+
+static void BenchBlobs()
+{
+    std::vector<uint8_t> blob(8u << 20);
+    uint32_t state = 1;
+    for (uint8_t& b : blob) {
+        state = state * 1664525u + 1013904223u;
+        b = (uint8_t)(state >> 24);
+    }
+    std::string hex = lab::Text::EncodeHex(blob.data(), blob.size());
+    std::string base64 = lab::Text::EncodeBase64(blob.data(), blob.size());
+
+    // by hand, as with tsGetHex, a byte at a time
+    std::vector<uint8_t> decoded(blob.size());
+    double hand = Time([&]() {
+        char const* p = hex.data();
+        for (size_t i = 0; i < decoded.size(); ++i, p += 2) {
+            uint32_t value;
+            char pair[2] = { p[0], p[1] };
+            tsGetHex(pair, pair + 2, &value);
+            decoded[i] = (uint8_t) value;
+        }
+    }, 5);
+    std::vector<uint8_t> result;
+    double hexMs = Time([&]() {
+        result.clear();
+        lab::Text::DecodeHex(StrView{ hex }, result);
+    }, 5);
+    if (result != blob || decoded != blob)
+        printf("hex blob differs\n");
+    double base64Ms = Time([&]() {
+        result.clear();
+        lab::Text::DecodeBase64(StrView{ base64 }, result);
+    }, 5);
+    if (result != blob)
+        printf("base64 blob differs\n");
+    std::string text;
+    double hexOut = Time([&]() { text = lab::Text::EncodeHex(blob.data(), blob.size()); }, 5);
+    double base64Out = Time([&]() { text = lab::Text::EncodeBase64(blob.data(), blob.size()); }, 5);
+    Report("blobs, hex by tsGetHex", hand, hex.size());
+    Report("blobs, DecodeHex", hexMs, hex.size());
+    Report("blobs, DecodeBase64", base64Ms, base64.size());
+    Report("blobs, EncodeHex", hexOut, hex.size());
+    Report("blobs, EncodeBase64", base64Out, base64.size());
+}
+
+//-----------------------------------------------------------------------------
+// walking a large graph, in the Sexpr layout and packed into 32 bit words
+//-----------------------------------------------------------------------------
+
+// the same walk over either layout, through the shared accessors
+template <class Tree>
+static double WalkGraph(Tree const& tree)
+{
+    double sum = 0;
+    int count = tree.Count();
+    for (int node = 0; node < count; ) {
+        int end = tree.End(node);
+        for (int e = node + 1; e < end - 1; e = tree.End(e)) {
+            switch (tree.Token(e)) {
+            case tsSexprInteger: sum += tree.Int(e); break;
+            case tsSexprFloat: sum += tree.Float(e); break;
+            case tsSexprAtom:
+            case tsSexprString: sum += tree.Text(e).sz; break;
+            default: break;
+            }
+        }
+        node = end;
+    }
+    return sum;
+}
+
+static void BenchPacked()
+{
+    std::string doc;
+    for (int i = 0; i < 4; ++i)
+        doc += AtomsDocument();
+    lab::Text::Sexpr tree{ StrView{ doc } };
+    double ms = Time([&]() {
+        lab::Text::PackedSexpr packed{ tree };
+    }, 5);
+    lab::Text::PackedSexpr packed{ tree };
+    Report("packed, pack a parsed graph", ms, doc.size());
+
+    size_t sexprBytes = tree.expr.size() * sizeof(tree.expr[0]) + tree.ints.size() * sizeof(int) +
+                        tree.floats.size() * sizeof(float) + tree.strings.size() * sizeof(std::string);
+    for (auto const& str : tree.strings)
+        if (str.capacity() > std::string().capacity())
+            sexprBytes += str.capacity() + 1;
+    double sums[2] = {};
+    double walk = Time([&]() { sums[0] = WalkGraph(tree); });
+    double walkPacked = Time([&]() { sums[1] = WalkGraph(packed); });
+    if (sums[0] != sums[1])
+        printf("packed walk differs\n");
+    printf("packed, walk %d elements: Sexpr %.3f ms, %.1f MB; packed %.3f ms, %.1f MB; %.2fx\n",
+           tree.Count(), walk, sexprBytes / (1024.0 * 1024.0),
+           walkPacked, packed.Bytes() / (1024.0 * 1024.0), walk / walkPacked);
+}
+
+//-----------------------------------------------------------------------------
+// structural hashes and diff between versions of a graph
+//-----------------------------------------------------------------------------
+
+static void BenchDiff()
+{
+    std::string doc = AtomsDocument();
+    // a changed value, a removed node and an added one
+    std::string edited = doc;
+    size_t at = edited.find(":value 0.125", edited.find("\"Gain-500\""));
+    edited.replace(at, 12, ":value 0.250");
+    size_t node = edited.find("(ls-node :name \"Gain-50000\"");
+    edited.erase(node, edited.find('\n', node) + 1 - node);
+    edited += "(ls-node :name \"Reverb\" :pos 1 2 :value 0.5)\n";
+
+    lab::Text::Sexpr from{ StrView{ doc } };
+    lab::Text::Sexpr to{ StrView{ edited } };
+    double hash = Time([&]() { lab::Text::SexprHashes hashes(from); }, 5);
+    lab::Text::SexprHashes fromHashes(from);
+    lab::Text::SexprHashes toHashes(to);
+    std::vector<lab::Text::SexprChange> changes;
+    double diff = Time([&]() { changes = lab::Text::DiffSexpr(fromHashes, toHashes); });
+    // the text compare only says whether anything changed; it is made
+    // against a copy of equal length changed in its last node, so that it
+    // reads the whole document rather than stopping at the sizes
+    std::string retyped = doc;
+    retyped.replace(retyped.rfind(":value 0.125"), 12, ":value 0.250");
+    bool same = false;
+    double text = Time([&]() { same = doc == retyped; });
+    Report("diff, hash a parse", hash, doc.size());
+    printf("diff, %zu changes in %.3f ms; text compare of equal sizes %.3f ms (%s)\n",
+           changes.size(), diff, text, same ? "same" : "differs");
+}
+
+struct BenchNode {
+    StrView  name;
+    float    pos[2] = {};
+    float    value = 0;
+    float    scale = 1;
+    uint32_t color = 0;
+    int      id = 0;
+};
+
+static void BenchBind()
+{
+    using namespace lab::Text::Bind;
+    static constexpr auto nodeBinding = binding<BenchNode>("ls-node",
+        field(":name", &BenchNode::name), field(":pos", &BenchNode::pos),
+        field(":value", &BenchNode::value), field(":scale", &BenchNode::scale),
+        field(":color", &BenchNode::color), field(":id", &BenchNode::id));
+
+    std::string doc = AtomsDocument();
+    double parse = Time([&]() { lab::Text::Sexpr s(StrView{ doc }); }, 5);
+    lab::Text::Sexpr tree{ StrView{ doc } };
+    lab::Text::PackedSexpr packed{ tree };
+
+    std::vector<BenchNode> nodes;
+    double bound = Time([&]() {
+        nodes.clear();
+        DecodeAll(nodeBinding, tree, nodes);
+    });
+    double boundPacked = Time([&]() {
+        nodes.clear();
+        DecodeAll(nodeBinding, packed, nodes);
+    });
+
+    // the decode loop written out by hand, comparing keywords in turn
+    double hand = Time([&]() {
+        nodes.clear();
+        for (int e = 0; e < tree.Count(); e = tree.End(e)) {
+            if (tree.Token(e) != tsSexprPushList || tree.Text(e + 1) != StrView("ls-node"))
+                continue;
+            BenchNode& node = nodes.emplace_back();
+            int end = tree.End(e) - 1;
+            for (int i = e + 2; i < end; ++i) {
+                if (tree.Token(i) != tsSexprAtom)
+                    continue;
+                std::string key(tree.Text(i).curr, tree.Text(i).sz);
+                if (key == ":name")
+                    node.name = tree.Text(++i);
+                else if (key == ":pos") {
+                    node.pos[0] = tree.Token(i + 1) == tsSexprFloat ? tree.Float(i + 1) : (float) tree.Int(i + 1);
+                    node.pos[1] = tree.Token(i + 2) == tsSexprFloat ? tree.Float(i + 2) : (float) tree.Int(i + 2);
+                    i += 2;
+                }
+                else if (key == ":value")
+                    node.value = tree.Float(++i);
+                else if (key == ":scale")
+                    node.scale = tree.Float(++i);
+                else if (key == ":color")
+                    node.color = (uint32_t) tree.Int(++i);
+                else if (key == ":id")
+                    node.id = tree.Int(++i);
+            }
+        }
+    });
+
+    Report("bind, parse", parse, doc.size());
+    Report("bind, decode a Sexpr", bound, doc.size());
+    Report("bind, decode a PackedSexpr", boundPacked, doc.size());
+    Report("bind, decode by hand", hand, doc.size());
+    printf("bind, %zu nodes, last %.*s id %d color %08x\n", nodes.size(), (int) nodes.back().name.sz,
+           nodes.back().name.curr, nodes.back().id, nodes.back().color);
+}
+
+static void BenchSchema()
+{
+    char const* schemaText =
+        "(form ls-node (:name string) (:pos number number) (:value? number)\n"
+        "    (:scale? number) (:color? int) (:id int))\n";
+    lab::Text::SexprSchema schema{ StrView{ schemaText, strlen(schemaText) } };
+    std::string doc = AtomsDocument();
+    lab::Text::SexprOptions options;
+    options.trackOffsets = true;
+    double parse = Time([&]() { lab::Text::Sexpr s(StrView{ doc }, options); }, 5);
+    lab::Text::Sexpr tree{ StrView{ doc }, options };
+
+    std::vector<lab::Text::SchemaError> errors;
+    double checked = Time([&]() {
+        errors.clear();
+        schema.Validate(tree, errors);
+    });
+    double fused = Time([&]() {
+        errors.clear();
+        schema.Validate(StrView{ doc }, errors);
+    }, 5);
+    Report("schema, parse with offsets", parse, doc.size());
+    Report("schema, validate a Sexpr", checked, doc.size());
+    Report("schema, validate source", fused, doc.size());
+    printf("schema, %zu errors\n", errors.size());
+}
+
+int main()
+{
+    BenchGrammar();
+    BenchNumberArrays();
+    BenchAtoms();
+    BenchMessages();
+    BenchEdits();
+    BenchComments();
+    BenchCache();
+    BenchShared();
+    BenchPacked();
+    BenchJson();
+    BenchDelimited();
+    BenchConfig();
+    BenchNoCase();
+    BenchUtf8Tokens();
+    BenchLines();
+    BenchBlobs();
+    BenchDiff();
+    BenchBind();
+    BenchSchema();
+    return 0;
+}
@@ -1,7 +1,24 @@
 
 #define LABTEXT_ODR
 #include "include/LabText/LabText.h"
+#include "include/LabText/LabTextBind.h"
 #include <stdio.h>
+#include <stdlib.h>
+
+// counts lists and sums the integers of a document without storing it
+struct Tally {
+    int lists = 0;
+    int64_t sum = 0;
+    void OnPush() { ++lists; }
+    void OnPop() {}
+    void OnAtom(lab::Text::StrView) {}
+    void OnInt(int64_t value) { sum += value; }
+    void OnFloat(double) {}
+    void OnString(lab::Text::StrView) {}
+};
+
+static void TallyPush(void* user) { ++((Tally*) user)->lists; }
+static void TallyInt(void* user, int64_t value) { ((Tally*) user)->sum += value; }
 
 char const* test = R"(
 (a '(b c))
@@ -109,6 +126,241 @@ int main() {
         }
         curr = curr->next;
     } // while
+    tsParsedSexpr_Free(parsed);
+    printf("\n----------------\n");
+
+    // locate the connection that refers to the missing node ADSR-2
+    lab::Text::SexprOptions options;
+    options.trackOffsets = true;
+    lab::Text::Sexpr located(lab::Text::StrView{test, strlen(test)}, options);
+    lab::Text::LineIndex lines(lab::Text::StrView{test, strlen(test)});
+    for (size_t i = 0; i < located.expr.size(); ++i) {
+        auto& e = located.expr[i];
+        if (e.token == tsSexprString && located.strings[e.ref] == "ADSR-2") {
+            lab::Text::SourceLocation loc = lines.Locate(located.offsets[i]);
+            printf("ADSR-2 referenced at %u:%u\n", loc.line, loc.column);
+        }
+    }
+
+    tsParsedSexpr_t* head = tsParsedSexpr_New();
+    tsSexprOffsets_t offsets = { NULL, 0, 0 };
+    str = (tsStrView_t){test, strlen(test)};
+    tsStrViewParseSexprWithOffsets(&str, head, 0, &offsets);
+    size_t n = 0;
+    for (curr = head->next; curr; curr = curr->next, ++n) {
+        if (curr->token == tsSexprString && curr->str.sz == 6 && !strncmp(curr->str.curr, "ADSR-2", 6)) {
+            uint32_t line, column;
+            tsStrViewLineColumn(&str, offsets.offsets[n], &line, &column);
+            printf("ADSR-2 referenced at %u:%u\n", line, column);
+        }
+    }
+    tsSexprOffsets_Free(&offsets);
+    tsParsedSexpr_Free(head);
+
+    // the sample is missing the paren closing ADSR-1's pins
+    for (auto& err : located.errors) {
+        printf("error %d at %u:%u, within", (int) err.kind,
+               lines.Locate(err.offset).line, lines.Locate(err.offset).column);
+        for (size_t o : err.path)
+            printf(" %u:%u", lines.Locate(o).line, lines.Locate(o).column);
+        printf("\n");
+    }
+
+    // in recovery mode, damaged forms are dropped and the rest survive
+    char const* broken = "(a 1 \"unterminated)\n(b 2))\n(c 3\n(d 4)\n";
+    options.recover = true;
+    lab::Text::Sexpr recovered(lab::Text::StrView{broken, strlen(broken)}, options);
+    for (auto& e : recovered.expr) {
+        switch (e.token) {
+        case tsSexprPushList: printf("("); break;
+        case tsSexprPopList: printf(")"); break;
+        case tsSexprInteger: printf("%d ", recovered.ints[e.ref]); break;
+        case tsSexprAtom: printf("%s ", recovered.strings[e.ref].c_str()); break;
+        default: break;
+        }
+    }
+    printf("\n%d errors\n", (int) recovered.errors.size());
+
+    tsSexprError_t error;
+    head = tsParsedSexpr_New();
+    str = (tsStrView_t){broken, strlen(broken)};
+    tsStrViewParseSexprChecked(&str, head, NULL, &error, true, 0);
+    for (curr = head->next; curr; curr = curr->next) {
+        switch (curr->token) {
+        case tsSexprPushList: printf("("); break;
+        case tsSexprPopList: printf(")"); break;
+        case tsSexprInteger: printf("%d ", (int) curr->i); break;
+        case tsSexprAtom: printf("%.*s ", (int) curr->str.sz, curr->str.curr); break;
+        default: break;
+        }
+    }
+    printf("\n%d errors, first %d at %d\n", error.errorCount, (int) error.kind, (int) error.offset);
+    tsParsedSexpr_Free(head);
+
+    // a valid document parses the same with recovery on, even with lists
+    // opening at the start of a line inside a form
+    char const* valid = "(ls-node\n(:name \"x\") (:pos 1 2))\n(ls-node (:name \"y\"))\n";
+    lab::Text::SexprOptions strict;
+    lab::Text::Sexpr plain(lab::Text::StrView{valid, strlen(valid)}, strict);
+    lab::Text::Sexpr tolerant(lab::Text::StrView{valid, strlen(valid)}, options);
+    head = tsParsedSexpr_New();
+    str = (tsStrView_t){valid, strlen(valid)};
+    tsStrViewParseSexprChecked(&str, head, NULL, &error, true, 0);
+    int cells = 0;
+    for (curr = head->next; curr; curr = curr->next)
+        ++cells;
+    tsParsedSexpr_Free(head);
+    printf("valid: %d elements %d errors, recovering %d elements %d errors, C %d cells %d errors\n",
+           (int) plain.expr.size(), (int) plain.errors.size(),
+           (int) tolerant.expr.size(), (int) tolerant.errors.size(), cells, error.errorCount);
+
+    // nesting costs no native stack, and can be limited
+    std::string deep = std::string(100000, '(') + std::string(100000, ')');
+    lab::Text::Sexpr nested(lab::Text::StrView{deep.data(), deep.size()});
+    options = lab::Text::SexprOptions();
+    options.maxDepth = 64;
+    lab::Text::Sexpr limited(lab::Text::StrView{deep.data(), deep.size()}, options);
+    printf("%d elements; limited to depth 64: error %d at %d\n", (int) nested.expr.size(),
+           (int) limited.errors[0].kind, (int) limited.errors[0].offset);
+
+    // a parser reuses its storage from one message to the next
+    lab::Text::SexprParser parser;
+    char const* messages[] = { "(set :gain 0.5)", "(set :frequency 440 :detune 0)" };
+    for (char const* m : messages) {
+        lab::Text::Sexpr const& msg = parser.Parse(lab::Text::StrView{m, strlen(m)});
+        printf("%s: %d elements, %s\n", m, (int) msg.expr.size(), msg.strings[0].c_str());
+    }
+
+    // visitors see each element as it is scanned, and nothing is stored
+    Tally tally;
+    lab::Text::VisitSexpr(lab::Text::StrView{test, strlen(test)}, tally);
+    Tally ctally;
+    tsSexprVisitor_t visitor = { TallyPush, NULL, NULL, TallyInt, NULL, NULL };
+    str = (tsStrView_t){test, strlen(test)};
+    tsStrViewVisitSexpr(&str, &visitor, &ctally, &error, 0);
+    printf("%d lists, integers sum to %lld; C visitor %d lists, %lld, error %d\n",
+           tally.lists, (long long) tally.sum, ctally.lists, (long long) ctally.sum, (int) error.kind);
+
+    // a tokenizer pulls one element at a time, here from input split mid-element
+    char const* chunks[] = { "(node :name \"Os", "cillator\" :freq 44", "0.5)" };
+    lab::Text::SexprTokenizer tokenizer;
+    for (char const* c : chunks) {
+        tokenizer.Feed(lab::Text::StrView{c, strlen(c)});
+        for (lab::Text::SexprToken const& tok : tokenizer) {
+            if (tok.token == tsSexprString || tok.token == tsSexprAtom)
+                printf("%.*s@%d ", (int) tok.text.sz, tok.text.curr, (int) tok.offset);
+            else if (tok.token == tsSexprFloat)
+                printf("%g@%d ", tok.f, (int) tok.offset);
+        }
+    }
+    tokenizer.Finish();
+    lab::Text::SexprToken last;
+    while (tokenizer.Next(last) == lab::Text::SexprTokenizer::Token) {}
+    printf("\ntokenizer state %d, depth %d\n", (int) tokenizer.State(), tokenizer.Depth());
+
+    // a frozen tree answers queries from any thread, indexing itself on first use
+    char const* graphText = "(graph (node :name \"osc\" :freq 440) (node :gain 0.5 :name \"amp\"))";
+    lab::Text::FrozenSexpr graph(lab::Text::StrView{graphText, strlen(graphText)});
+    for (int node = 1; node < graph.End(0) - 1; node = graph.End(node)) {
+        int name = graph.Find(node, ":name");
+        if (name < 0)
+            continue;   // the atom graph
+        printf("node %d: %s ", node, graph.SymbolText(graph.SymbolOf(name)).curr);
+    }
+    printf("; :name occurs %d times\n", (int) graph.Keyword(":name").size());
+
+    // the same tree packed into a word per element, walked through the shared accessors
+    lab::Text::PackedSexpr packed(graph.Tree());
+    for (int e = 0; e < packed.Count(); ++e)
+        if (packed.Token(e) == tsSexprFloat || packed.Token(e) == tsSexprInteger)
+            printf("%g ", packed.Token(e) == tsSexprFloat ? packed.Float(e) : (double) packed.Int(e));
+    printf("in %d words, %d symbols\n", packed.Count(), packed.SymbolCount());
+
+    // JSON reads into the same stream, objects' keys becoming keywords
+    char const* jsonText = "{\"graph\": [{\"name\": \"osc\", \"freq\": 440}, {\"name\": \"amp\"}]}";
+    lab::Text::SexprOptions json;
+    json.json = true;
+    lab::Text::FrozenSexpr jsonGraph(lab::Text::StrView{jsonText, strlen(jsonText)}, json);
+    int freq = jsonGraph.Find(3, ":freq");
+    printf("JSON: %d elements, :name occurs %d times, freq %d\n", (int) jsonGraph.Tree().expr.size(),
+           (int) jsonGraph.Keyword(":name").size(), freq < 0 ? -1 : jsonGraph.Tree().Int(freq));
+
+    // after an edit, only the enclosing form is parsed again
+    std::string source = "(osc :freq 440) (gain :value 0.5)";
+    lab::Text::SexprOptions tracked;
+    tracked.trackOffsets = true;
+    lab::Text::Sexpr edited(lab::Text::StrView{source.data(), source.size()}, tracked);
+    lab::Text::SexprEdit edit;
+    edit.offset = source.find("440");
+    edit.removed = 3;
+    edit.inserted = 4;
+    source.replace(edit.offset, edit.removed, "2200");
+    bool incremental = edited.Reparse(lab::Text::StrView{source.data(), source.size()}, edit, tracked);
+    printf("reparsed %s: freq %d, value at offset %d\n", incremental ? "incrementally" : "fully",
+           edited.ints[edited.expr[3].ref], (int) edited.offsets[8]);
+
+    // structural hashes compare subtrees as integers, and diff versions of a document
+    char const* nextText = "(graph (node :name \"osc\" :freq 220) (node :gain 0.5 :name \"amp\"))";
+    lab::Text::Sexpr next(lab::Text::StrView{nextText, strlen(nextText)});
+    lab::Text::SexprHashes before(graph.Tree());
+    lab::Text::SexprHashes after(next);
+    printf("amp node %s; changes:", before.Hash(9) == after.Hash(9) ? "unchanged" : "changed");
+    for (lab::Text::SexprChange const& change : lab::Text::DiffSexpr(before, after))
+        printf(" %d %d->%d", (int) change.kind, change.from, change.to);
+    printf("\n");
+
+    // config values: comments end unquoted values, quotes keep them, and a
+    // trailing backslash continues a value on the next line
+    char const* ini = "[a]\nempty = ; only a comment\nhash = # also a comment\nglued =;kept\n"
+                      "quoted = \"x ; y\" ; note\nlong = one \\\n    two ; note\n";
+    lab::Text::Config config(lab::Text::StrView{ini, strlen(ini)});
+    printf("config:");
+    for (lab::Text::Config::Entry const& e : config.Entries())
+        printf(" %.*s=[%.*s]", (int) e.key.sz, e.key.curr, (int) e.value.sz, e.value.curr);
     printf("\n");
+
+    // a schema checks the forms of a document in one pass, reporting offsets
+    char const* schemaText = "(form graph (:nodes? node *)) (form node (:name string) (:freq? number) (:gain? number))";
+    lab::Text::SexprSchema schema(lab::Text::StrView{schemaText, strlen(schemaText)});
+    char const* checkedText = "(graph :nodes (node :name \"osc\" :freq \"high\") (node :gain 0.5))";
+    std::vector<lab::Text::SchemaError> schemaErrors;
+    schema.Validate(lab::Text::StrView{checkedText, strlen(checkedText)}, schemaErrors);
+    printf("schema errors:");
+    for (lab::Text::SchemaError const& e : schemaErrors)
+        printf(" %d at %d (%.*s)", (int) e.kind, (int) e.offset, (int) e.name.sz, e.name.curr);
+    printf("\n");
+
+    // a binding decodes keyword forms into a struct; integers must fit their
+    // members, and a binding built at run time with a keyword twice fails
+    struct Pixel { uint8_t level; unsigned count; int mask; };
+    using namespace lab::Text::Bind;
+    constexpr auto pixelBinding = binding<Pixel>("px",
+        field(":level", &Pixel::level), field(":count", &Pixel::count), field(":mask", &Pixel::mask));
+    char const* pixels = "(px :level 200 :count 3 :mask 0xffffffff) (px :level 300) (px :count -1)";
+    lab::Text::Sexpr pixelTree(lab::Text::StrView{pixels, strlen(pixels)});
+    printf("bind:");
+    for (int elem = 0; elem < pixelTree.Count(); elem = pixelTree.End(elem)) {
+        Pixel px = { 1, 1, 1 };
+        bool ok = Decode(pixelBinding, pixelTree, elem, px);
+        printf(" %s %d %u %d", ok ? "ok" : "fail", px.level, px.count, px.mask);
+    }
+    auto twice = binding<Pixel>("px", field(":level", &Pixel::level), field(":level", &Pixel::level));
+    Pixel px = {};
+    printf("; duplicate keyword %s\n", Decode(twice, pixelTree, 0, px) ? "decoded" : "fails");
+
+#ifdef LABTEXT_INSTRUMENT
+    // with LABTEXT_INSTRUMENT, the parsers count their work and trace spans
+    tsParseStatsReset();
+    lab::Text::Sexpr counted(lab::Text::StrView{test, strlen(test)});
+    tsParseStats_t const* stats = tsParseStats();
+    printf("scanned %d bytes of white space, %d of atoms; %d lists, %d integers; depth %d; %d allocations\n",
+           (int) stats->bytesScanned[tsScanWhiteSpace], (int) stats->bytesScanned[tsScanAtom],
+           (int) stats->tokens[tsSexprPushList], (int) stats->tokens[tsSexprInteger],
+           stats->maxDepth, (int) stats->allocations);
+    // the trace is written only where LABTEXT_TRACE names a file, so that
+    // runs leave nothing in the working directory
+    if (char const* tracePath = getenv("LABTEXT_TRACE"))
+        tsTraceWriteChrome(tracePath);
+#endif
     return 0;
 }
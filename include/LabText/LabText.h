@@ -62,6 +62,17 @@ EXTERNC char const* tsGetTokenExt                   (char const* pCurr, char con
 EXTERNC char const* tsGetNameSpacedTokenAlphaNumeric(char const* pCurr, char const* pEnd,
                                                      char namespaceChar, char const** resultStringBegin, uint32_t* stringLength);
 
+// The AlphaNumeric tokens above are ASCII, and end at the first byte of a
+// UTF-8 sequence. These accept XID_Continue code points as well, which
+// includes letters and digits of every script, and '_'. ext, which may be
+// NULL, holds additional ASCII characters to accept. The namespaced form
+// accepts namespaceChar, '$' and '^'. ASCII runs are classified 16 bytes
+// at a time where SIMD is available.
+EXTERNC char const* tsGetTokenUtf8                  (char const* pCurr, char const* pEnd,
+                                                     char const* ext, char const** resultStringBegin, uint32_t* stringLength);
+EXTERNC char const* tsGetNameSpacedTokenUtf8        (char const* pCurr, char const* pEnd,
+                                                     char namespaceChar, char const** resultStringBegin, uint32_t* stringLength);
+
 // Get Value
 EXTERNC char const* tsGetString                     (char const* pCurr, char const* pEnd,
                                                      bool recognizeEscapes, char const** resultStringBegin, uint32_t* stringLength);
@@ -74,6 +85,85 @@ EXTERNC char const* tsGetUInt32                     (char const* pCurr, char con
 EXTERNC char const* tsGetHex                        (char const* pCurr, char const* pEnd, uint32_t* result);
 EXTERNC char const* tsGetFloat                      (char const* pcurr, char const* pEnd, float* result);
 
+// Number arrays
+typedef enum {
+    tsNumberSeparatorWhiteSpace = 0,    // 1 2 3
+    tsNumberSeparatorComma,             // 1, 2, 3 with optional white space around the commas
+    tsNumberSeparatorWhiteSpaceOrComma  // either, freely mixed
+} tsNumberSeparator_t;
+
+typedef enum {
+    tsNumberInteger = 0,
+    tsNumberFloat
+} tsNumberKind_t;
+
+typedef struct tsNumber_t {
+    tsNumberKind_t kind;
+    union {
+        int64_t i;
+        double f;
+    };
+} tsNumber_t;
+
+// Parse up to capacity separated numbers, stopping before the first token
+// that is not a number. *count receives the number of values written, and
+// the return points past the last number consumed. Digit runs are
+// classified and converted many bytes at a time where SIMD is available.
+EXTERNC char const* tsGetDoubleArray                (char const* pCurr, char const* pEnd, tsNumberSeparator_t separator,
+                                                     double* result, size_t capacity, size_t* count);
+EXTERNC char const* tsGetInt64Array                 (char const* pCurr, char const* pEnd, tsNumberSeparator_t separator,
+                                                     int64_t* result, size_t capacity, size_t* count);
+// As above, for the white space separated numbers of an s-expression. A
+// token counts as a float if it has a decimal point or an exponent, and as
+// an integer if it is all digits and fits in 32 bits, as tsScanSexprAtom
+// classifies tokens. Anything else ends the run. If offsets is not NULL, it
+// receives the distance from pCurr to the start of each number.
+EXTERNC char const* tsGetSexprNumbers               (char const* pCurr, char const* pEnd,
+                                                     tsNumber_t* result, size_t* offsets,
+                                                     size_t capacity, size_t* count);
+
+// Binary blobs
+// Decode up to capacity bytes of hex, or of base64, stopping before the
+// first character that is not part of the encoding, or at a byte that would
+// not fit. White space between digits is skipped. *count receives the number
+// of bytes written, and the return points past the last digit consumed, so
+// the input was valid if it returns pEnd. Hex needs capacity for
+// (pEnd - pCurr) / 2 bytes, and base64 for (pEnd - pCurr) / 4 * 3 + 2.
+// Base64 accepts the URL safe '-' and '_' as well as '+' and '/'; a short
+// final quantum may be padded with '=' or not. Blocks of digits are
+// validated and packed 16 or more at a time where SIMD is available.
+EXTERNC char const* tsDecodeHex                     (char const* pCurr, char const* pEnd,
+                                                     uint8_t* result, size_t capacity, size_t* count);
+EXTERNC char const* tsDecodeBase64                  (char const* pCurr, char const* pEnd,
+                                                     uint8_t* result, size_t capacity, size_t* count);
+// Encode sz bytes as lower case hex, 2 * sz characters, or as padded
+// base64, (sz + 2) / 3 * 4 characters, into result, which is not
+// terminated. Returns the end of the characters written.
+EXTERNC char*       tsEncodeHex                     (uint8_t const* data, size_t sz, char* result);
+EXTERNC char*       tsEncodeBase64                  (uint8_t const* data, size_t sz, char* result);
+
+// Sexpr atoms
+typedef enum {
+    tsLexAtom = 0,
+    tsLexInteger,   // [+-]digits
+    tsLexFloat,     // [+-]digits.[digits][exponent], or [+-]digits exponent
+    tsLexHex        // [+-]0x followed by up to 16 hex digits
+} tsLexKind_t;
+
+typedef struct tsLexeme_t {
+    tsLexKind_t kind;
+    union {
+        int64_t i;  // tsLexInteger and tsLexHex
+        double f;   // tsLexFloat
+    };
+} tsLexeme_t;
+
+// Delimit the atom at pCurr and classify it in the same pass, converting
+// numbers as they are scanned. An atom ends at white space, a paren, a
+// quote, or a semicolon. Integers too large for 64 bits are returned as
+// floats. Returns the end of the atom, which is pCurr if there is none.
+EXTERNC char const* tsScanSexprAtom                 (char const* pCurr, char const* pEnd, tsLexeme_t* result);
+
 // Scanning
 EXTERNC char const* tsScanForCharacter              (char const* pCurr, char const* pEnd, char delim);
 EXTERNC char const* tsScanBackwardsForCharacter     (char const* pCurr, char const* pEnd, char delim);
@@ -85,11 +175,31 @@ EXTERNC char const* tsScanForQuote                  (char const* pCurr, char con
 EXTERNC char const* tsScanForEndOfLine              (char const* pCurr, char const* pEnd);
 EXTERNC char const* tsScanForLastCharacterOnLine    (char const* pCurr, char const* pEnd);
 EXTERNC char const* tsScanForBeginningOfNextLine    (char const* pCurr, char const* pEnd);
+// The number of lines in [pCurr, pEnd): the '\n' characters, and one more
+// if the last line is not terminated. Counts 16 bytes at a time in byte
+// wide accumulators where SIMD is available, near memory bandwidth.
+EXTERNC size_t      tsCountLines                    (char const* pCurr, char const* pEnd);
 EXTERNC char const* tsScanPastCPPComments           (char const* pCurr, char const* pEnd);
 EXTERNC char const* tsSkipCommentsAndWhitespace     (char const* pCurr, char const*const pEnd);
 
+// Comment styles for tsSkipCommentsAndWhitespaceExt, combined as flags
+typedef enum {
+    tsCommentSlashSlash = 1,    // // to the end of the line
+    tsCommentSlashStar  = 2,    // /* to */, not nested
+    tsCommentSemicolon  = 4,    // ; to the end of the line, as in Lisp
+    tsCommentHash       = 8,    // # to the end of the line, as in shells and INI files
+    tsCommentCPP        = tsCommentSlashSlash | tsCommentSlashStar
+} tsCommentStyle_t;
+
+// Skips any mix of white space and comments of the given styles in a single
+// pass, never reading past pEnd. Long runs of white space, and the bodies of
+// comments, are crossed sixteen bytes at a time where SIMD is available.
+// tsSkipCommentsAndWhitespace is this with tsCommentCPP.
+EXTERNC char const* tsSkipCommentsAndWhitespaceExt  (char const* pCurr, char const* pEnd, unsigned styles);
+
 // Expect
 EXTERNC char const* tsExpect                        (char const* pCurr, char const*const pEnd, char const* pExpect);
+EXTERNC char const* tsExpectNoCase                  (char const* pCurr, char const*const pEnd, char const* pExpect);
 
 // Character checks
 EXTERNC _Bool tsIsWhiteSpace(char test);
@@ -101,6 +211,15 @@ EXTERNC _Bool tsIsIn        (const char* testString, char test);
 EXTERNC int32_t tsConvertUtf8ToUtf16(uint16_t* dst, int32_t dst_size, const char* src);
 EXTERNC int32_t tsConvertUtf16ToUtf8(char* dst, int32_t dst_size, const uint16_t* src);
 
+// The code point at p, and the end of its sequence in *next. Truncated or
+// malformed sequences, overlong forms and surrogates yield U+FFFD and
+// advance a single byte, so iteration always makes progress.
+EXTERNC uint32_t tsDecodeUtf8(char const* p, char const* end, char const** next);
+
+// Unicode identifier classes, from range tables generated from Unicode 14.
+EXTERNC _Bool tsIsXidStart   (uint32_t cp);
+EXTERNC _Bool tsIsXidContinue(uint32_t cp);
+
 //-----------------------------------------------------------------------------
 // String view wraps the raw string slice operations
 //-----------------------------------------------------------------------------
@@ -119,6 +238,28 @@ EXTERNC _Bool tsStrViewEqualCharPtr (const tsStrView_t *s, const char *rhs);
 EXTERNC _Bool tsStrViewLessThan     (const tsStrView_t *s, const tsStrView_t *rhs);
 EXTERNC _Bool tsStrViewIsEmpty      (const tsStrView_t *s);
 
+// Comparisons ignoring ASCII case. Only A-Z and a-z fold, so other bytes,
+// including UTF-8 sequences, compare exactly. Sixteen bytes fold at a time
+// where SIMD is available, eight otherwise. Begins has the argument order
+// of tsStrViewBegins; Compare orders as strcmp of the lower case forms;
+// the hash is equal for strings that are equal ignoring case. Find returns
+// the remainder of s from the first occurrence of needle, or an empty view
+// at the end of s.
+EXTERNC _Bool       tsStrViewEqualNoCase  (const tsStrView_t* s, const tsStrView_t* rhs);
+EXTERNC _Bool       tsStrViewBeginsNoCase (const tsStrView_t* s, const tsStrView_t* rhs);
+EXTERNC int         tsStrViewCompareNoCase(const tsStrView_t* s, const tsStrView_t* rhs);
+EXTERNC uint64_t    tsStrViewHashNoCase   (const tsStrView_t* s, uint64_t seed);
+EXTERNC tsStrView_t tsStrViewFindNoCase   (const tsStrView_t* s, const tsStrView_t* needle);
+
+// Simple Unicode case folding of UTF-8, one code point at a time, as the C
+// and S mappings of CaseFolding.txt, for the Latin, Greek, Cyrillic and
+// Armenian blocks and fullwidth ASCII. Other code points, and malformed
+// bytes, compare as they are. Runs of ASCII take the fast path above.
+EXTERNC uint32_t    tsFoldCodePoint       (uint32_t cp);
+EXTERNC _Bool       tsStrViewEqualFold    (const tsStrView_t* s, const tsStrView_t* rhs);
+EXTERNC int         tsStrViewCompareFold  (const tsStrView_t* s, const tsStrView_t* rhs);
+EXTERNC uint64_t    tsStrViewHashFold     (const tsStrView_t* s, uint64_t seed);
+
 // get token
 EXTERNC tsStrView_t tsStrViewGetToken                      (const tsStrView_t *s, char delim, tsStrView_t *result);
 EXTERNC tsStrView_t tsStrViewGetTokenExt                   (const tsStrView_t* s, char const* ext, tsStrView_t* result);
@@ -126,6 +267,9 @@ EXTERNC tsStrView_t tsStrViewGetTokenWSDelimited           (const tsStrView_t *s
 EXTERNC tsStrView_t tsStrViewGetTokenAlphaNumeric          (const tsStrView_t* s, tsStrView_t* result);
 EXTERNC tsStrView_t tsStrViewGetTokenAlphaNumericExt       (const tsStrView_t* s, char const* ext, tsStrView_t* result);
 EXTERNC tsStrView_t tsStrViewGetNameSpacedTokenAlphaNumeric(const tsStrView_t* s, char namespaceChar, tsStrView_t* result);
+EXTERNC tsStrView_t tsStrViewGetTokenUtf8                  (const tsStrView_t* s, char const* ext, tsStrView_t* result);
+EXTERNC tsStrView_t tsStrViewGetNameSpacedTokenUtf8        (const tsStrView_t* s, char namespaceChar, tsStrView_t* result);
+EXTERNC tsStrView_t tsStrViewGetCodePoint                  (const tsStrView_t* s, uint32_t* result);
 
 // get values
 EXTERNC tsStrView_t tsStrViewGetString (const tsStrView_t* s, bool recognizeEscapes, tsStrView_t* result);
@@ -138,6 +282,7 @@ EXTERNC tsStrView_t tsStrViewGetFloat  (const tsStrView_t* s, float* result);
 
 // Scanning
 EXTERNC tsStrView_t tsStrViewExpect                          (const tsStrView_t* s, const tsStrView_t* expect);
+EXTERNC tsStrView_t tsStrViewExpectNoCase                    (const tsStrView_t* s, const tsStrView_t* expect);
 EXTERNC tsStrView_t tsStrViewStrip                           (const tsStrView_t* s);
 EXTERNC tsStrView_t tsStrViewScanForCharacter                (const tsStrView_t* s, char c);
 EXTERNC tsStrView_t tsStrViewScanBackwardsForCharacter       (const tsStrView_t* s, char c);
@@ -154,6 +299,11 @@ EXTERNC tsStrView_t tsStrViewScanPastCPPComments             (const tsStrView_t*
 EXTERNC tsStrView_t tsStrViewScanPastCPPCommentsSkipped      (const tsStrView_t* s, tsStrView_t* skipped);
 EXTERNC tsStrView_t tsStrViewSkipCommentsAndWhiteSpace       (const tsStrView_t* s);
 EXTERNC tsStrView_t tsStrViewSkipCommentsAndWhiteSpaceSkipped(const tsStrView_t* s, tsStrView_t* skipped);
+EXTERNC tsStrView_t tsStrViewSkipCommentsAndWhiteSpaceExt    (const tsStrView_t* s, unsigned styles);
+
+// Hashing. A fast 64 bit hash of sz bytes, for content addressing; it is not
+// cryptographic, and depends on the byte order of the machine.
+EXTERNC uint64_t tsHashBytes(char const* p, size_t sz, uint64_t seed);
 
 //-----------------------------------------------------------------------------
 // Sexpr parser
@@ -182,6 +332,161 @@ typedef struct tsParsedSexpr_t {
 EXTERNC tsParsedSexpr_t* tsParsedSexpr_New();
 EXTERNC tsStrView_t tsStrViewParseSexpr(tsStrView_t* s, tsParsedSexpr_t* currCell, int balance);
 
+// Optional side table of source positions for a parse. offsets[n] is the byte
+// offset, from the start of the parsed input, of the n-th cell following the
+// cell handed to the parser. Zero initialize before parsing. If the table
+// cannot grow, it is freed and left empty, and no more offsets are recorded
+// during that parse.
+typedef struct tsSexprOffsets_t {
+    size_t* offsets;
+    size_t count;
+    size_t capacity;
+} tsSexprOffsets_t;
+
+EXTERNC tsStrView_t tsStrViewParseSexprWithOffsets(tsStrView_t* s, tsParsedSexpr_t* currCell, int balance, tsSexprOffsets_t* offsets);
+EXTERNC void tsSexprOffsets_Free(tsSexprOffsets_t* offsets);
+
+// Resolve a byte offset within s to a 1 based line and column.
+EXTERNC void tsStrViewLineColumn(const tsStrView_t* s, size_t offset, uint32_t* line, uint32_t* column);
+
+// Frees a cell and every cell following it.
+EXTERNC void tsParsedSexpr_Free(tsParsedSexpr_t* cell);
+
+typedef enum {
+    tsSexprErrorNone = 0,
+    tsSexprErrorUnexpectedCharacter,    // something other than a list at the top level
+    tsSexprErrorUnterminatedString,
+    tsSexprErrorUnbalancedClose,        // a ')' with no open list
+    tsSexprErrorUnclosedList,           // input ended, or a new top level list began, inside a list
+    tsSexprErrorDepthExceeded           // a list opened beyond the maximum depth
+} tsSexprErrorKind_t;
+
+#define TS_SEXPR_ERROR_PATH_MAX 16
+
+// Describes the first error of a parse. path holds the offsets of the
+// innermost open lists at the error, outermost first; depth is the full
+// nesting depth, of which pathCount entries are recorded.
+typedef struct tsSexprError_t {
+    tsSexprErrorKind_t kind;
+    size_t offset;
+    int depth;
+    int pathCount;
+    size_t path[TS_SEXPR_ERROR_PATH_MAX];
+    int errorCount;
+} tsSexprError_t;
+
+// Parses like tsStrViewParseSexpr, reporting errors. Without recover, parsing
+// stops at the first error. With recover, a form containing an error is
+// dropped from the output and parsing resumes at the next top level list,
+// being a '(' at the start of a line; for a form left unclosed, that is the
+// first such '(' within it. Recovery never alters the parse of valid input.
+// A maxDepth above zero limits list nesting. offsets and error may be NULL.
+EXTERNC tsStrView_t tsStrViewParseSexprChecked(tsStrView_t* s, tsParsedSexpr_t* currCell,
+                                               tsSexprOffsets_t* offsets, tsSexprError_t* error,
+                                               _Bool recover, int maxDepth);
+
+// Returns the nesting depth at offset within s, skipping strings and ';'
+// comments, and writes the offsets of up to maxPath innermost open lists.
+EXTERNC int tsSexprOpenLists(const tsStrView_t* s, size_t offset, size_t* path, int maxPath);
+
+// Returns a pointer to the next '(' that begins a line, or pEnd.
+EXTERNC char const* tsScanForTopLevelList(char const* pCurr, char const* pEnd);
+
+// Callbacks for tsStrViewVisitSexpr, each handed the user pointer. Any may
+// be NULL. Integers include hex literals; strings are the text between the
+// quotes, escapes intact.
+typedef struct tsSexprVisitor_t {
+    void (*onPush)(void* user);
+    void (*onPop)(void* user);
+    void (*onAtom)(void* user, tsStrView_t atom);
+    void (*onInt)(void* user, int64_t value);
+    void (*onFloat)(void* user, double value);
+    void (*onString)(void* user, tsStrView_t str);
+} tsSexprVisitor_t;
+
+// Parses s without building cells, calling the visitor for each element as
+// it is scanned, so that memory use is constant. Stops at the first error,
+// which is described in error if it is not NULL. A maxDepth above zero
+// limits list nesting. Returns the remainder of the input, which is empty
+// unless parsing stopped.
+EXTERNC tsStrView_t tsStrViewVisitSexpr(tsStrView_t* s, const tsSexprVisitor_t* visitor, void* user,
+                                        tsSexprError_t* error, int maxDepth);
+
+// A quick upper bound on the size of a parse, for reserving storage: counts
+// the '(' and the runs of non-delimiters, without interpreting strings.
+EXTERNC void tsSexprEstimate(char const* pCurr, char const* pEnd, size_t* lists, size_t* atoms);
+
+//-----------------------------------------------------------------------------
+// Instrumentation
+//-----------------------------------------------------------------------------
+
+// Define LABTEXT_INSTRUMENT, consistently in every translation unit, to have
+// the sexpr parsers count their work and record trace spans. Otherwise the
+// TS_STAT and TS_TRACE hooks compile to nothing.
+#ifdef LABTEXT_INSTRUMENT
+
+typedef enum {
+    tsScanWhiteSpace = 0,
+    tsScanComment,
+    tsScanString,
+    tsScanAtom,         // atoms and numbers, scanned singly
+    tsScanNumberRun,    // runs of numbers converted in bulk
+    tsScannerCount
+} tsScanner_t;
+
+typedef struct tsParseStats_t {
+    uint64_t bytesScanned[tsScannerCount];
+    uint64_t tokens[tsSexprString + 1];     // by tsSexprToken_t
+    uint64_t numberRetries;     // numbers the bulk converter declined, scanned again singly
+    uint64_t slowConversions;   // decimals outside the exact double fast path
+    uint64_t allocations;
+    uint64_t bytesAllocated;
+    int      maxDepth;
+} tsParseStats_t;
+
+// The counters of the calling thread, summed over the parses since the last
+// reset. Reset before a parse to see the counts of that parse alone.
+EXTERNC tsParseStats_t* tsParseStats(void);
+EXTERNC void tsParseStatsReset(void);
+
+// Trace spans, which nest, are recorded per thread.
+EXTERNC void tsTraceBegin(char const* name);
+EXTERNC void tsTraceEnd(void);
+
+// Also report spans to other tools, such as perf markers or a profiler's
+// zone API. name is the string given to tsTraceBegin.
+typedef struct tsTraceHooks_t {
+    void (*begin)(void* user, char const* name);
+    void (*end)(void* user, char const* name);
+    void* user;
+} tsTraceHooks_t;
+EXTERNC void tsTraceSetHooks(const tsTraceHooks_t* hooks);
+
+// Write the calling thread's spans as Chrome trace event JSON, for
+// chrome://tracing or Perfetto. Returns false if the file could not be
+// written. tsTraceClear discards the recorded spans.
+EXTERNC _Bool tsTraceWriteChrome(char const* path);
+EXTERNC void tsTraceClear(void);
+
+#define TS_STAT_ADD(field, n)       (tsParseStats()->field += (n))
+#define TS_STAT_SCAN(scanner, n)    (tsParseStats()->bytesScanned[scanner] += (uint64_t)(n))
+#define TS_STAT_TOKEN(token)        (++tsParseStats()->tokens[token])
+#define TS_STAT_DEPTH(depth)        do { tsParseStats_t* tsS = tsParseStats(); \
+                                         if ((depth) > tsS->maxDepth) tsS->maxDepth = (depth); } while (0)
+#define TS_TRACE_BEGIN(name)        tsTraceBegin(name)
+#define TS_TRACE_END()              tsTraceEnd()
+
+#else
+
+#define TS_STAT_ADD(field, n)       ((void) 0)
+#define TS_STAT_SCAN(scanner, n)    ((void) 0)
+#define TS_STAT_TOKEN(token)        ((void) 0)
+#define TS_STAT_DEPTH(depth)        ((void) 0)
+#define TS_TRACE_BEGIN(name)        ((void) 0)
+#define TS_TRACE_END()              ((void) 0)
+
+#endif // LABTEXT_INSTRUMENT
+
 
 
 //-----------------------------------------------------------------------------
@@ -190,9 +495,20 @@ EXTERNC tsStrView_t tsStrViewParseSexpr(tsStrView_t* s, tsParsedSexpr_t* currCel
 
 #ifdef __cplusplus
 
+#include <algorithm>
+#include <mutex>
 #include <string.h>
 #include <vector>
 
+#ifndef LABTEXT_CACHE_LINE
+#define LABTEXT_CACHE_LINE 64
+#endif
+
+// SexprCache needs std::filesystem
+#if (__cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)) && !defined(LABTEXT_NO_SEXPR_CACHE)
+#define LABTEXT_SEXPR_CACHE
+#endif
+
 namespace lab { namespace Text {
 
 // StrView provides a non-owning view on a memory range meant to be
@@ -269,6 +585,33 @@ struct StrView : public tsStrView_t
     bool IsEmpty() const {
         return tsStrViewIsEmpty(this);
     }
+
+    // ignoring ASCII case
+    bool EqualNoCase(StrView const& rhs) const {
+        return tsStrViewEqualNoCase(this, &rhs);
+    }
+    bool BeginsNoCase(StrView const& rhs) const {
+        return tsStrViewBeginsNoCase(this, &rhs);
+    }
+    int CompareNoCase(StrView const& rhs) const {
+        return tsStrViewCompareNoCase(this, &rhs);
+    }
+    uint64_t HashNoCase(uint64_t seed = 0) const {
+        return tsStrViewHashNoCase(this, seed);
+    }
+    StrView FindNoCase(StrView const& needle) const {
+        return tsStrViewFindNoCase(this, &needle);
+    }
+    // ignoring case by simple Unicode folding
+    bool EqualFold(StrView const& rhs) const {
+        return tsStrViewEqualFold(this, &rhs);
+    }
+    int CompareFold(StrView const& rhs) const {
+        return tsStrViewCompareFold(this, &rhs);
+    }
+    uint64_t HashFold(uint64_t seed = 0) const {
+        return tsStrViewHashFold(this, seed);
+    }
     StrView GetToken(char delim, StrView& result) const {
         return tsStrViewGetToken(this, delim, static_cast<tsStrView_t*>(&result));
     } 
@@ -287,6 +630,16 @@ struct StrView : public tsStrView_t
     StrView GetNameSpacedTokenAlphaNumeric(char namespaceChar, StrView& result) const {
         return tsStrViewGetNameSpacedTokenAlphaNumeric(this, namespaceChar, static_cast<tsStrView_t*>(&result));
     }
+    StrView GetTokenUtf8(char const* ext, StrView& result) const {
+        return tsStrViewGetTokenUtf8(this, ext, static_cast<tsStrView_t*>(&result));
+    }
+    StrView GetNameSpacedTokenUtf8(char namespaceChar, StrView& result) const {
+        return tsStrViewGetNameSpacedTokenUtf8(this, namespaceChar, static_cast<tsStrView_t*>(&result));
+    }
+    // the next code point; an empty view returns itself and 0
+    StrView GetCodePoint(uint32_t& result) const {
+        return tsStrViewGetCodePoint(this, &result);
+    }
     StrView GetString(bool recognizeEscapes, StrView& result) const {
         return tsStrViewGetString(this, recognizeEscapes, static_cast<tsStrView_t*>(&result));
     }
@@ -353,9 +706,16 @@ struct StrView : public tsStrView_t
     StrView SkipCommentsAndWhitespace(StrView& skipped) const {
         return tsStrViewSkipCommentsAndWhiteSpaceSkipped(this, static_cast<tsStrView_t*>(&skipped));
     }
+    // styles are tsCommentStyle_t flags
+    StrView SkipCommentsAndWhiteSpace(unsigned styles) const {
+        return tsStrViewSkipCommentsAndWhiteSpaceExt(this, styles);
+    }
     StrView Expect(const StrView& expect) const {
         return tsStrViewExpect(this, &expect);
     }
+    StrView ExpectNoCase(const StrView& expect) const {
+        return tsStrViewExpectNoCase(this, &expect);
+    }
     StrView Strip() const {
         return tsStrViewStrip(this);
     }
@@ -363,6 +723,309 @@ struct StrView : public tsStrView_t
 
 std::vector<StrView> Split(StrView s, char split);
 
+// Lines of large buffers, such as mapped logs. The work is split into one
+// contiguous range of s per thread; threads 0 means one per hardware
+// thread, and small inputs use fewer. LineOffsets counts the lines of each
+// range, then writes each range's line starts into its place in a single
+// array, so that the result is in document order: 0, and the offset after
+// every '\n' but a final one. SplitLines returns the same lines as
+// Split(s, '\n').
+size_t               CountLines(StrView s, unsigned threads = 0);
+std::vector<size_t>  LineOffsets(StrView s, unsigned threads = 0);
+std::vector<StrView> SplitLines(StrView s, unsigned threads = 0);
+
+// Hash and equality ignoring ASCII case, for unordered containers keyed by
+// StrView, such as std::unordered_map<StrView, T, NoCaseHash, NoCaseEqual>.
+struct NoCaseHash {
+    size_t operator()(StrView const& s) const { return (size_t) s.HashNoCase(); }
+};
+struct NoCaseEqual {
+    bool operator()(StrView const& a, StrView const& b) const { return a.EqualNoCase(b); }
+};
+
+// Append the separated numbers at the start of s to result, converting
+// directly into the vector's storage. Returns the unparsed remainder.
+StrView ParseNumberArray(StrView s, tsNumberSeparator_t separator, std::vector<double>& result);
+StrView ParseNumberArray(StrView s, tsNumberSeparator_t separator, std::vector<int64_t>& result);
+
+// Append the blob encoded at the start of s to result, decoding directly
+// into the vector's storage. Returns the undecoded remainder.
+StrView DecodeHex(StrView s, std::vector<uint8_t>& result);
+StrView DecodeBase64(StrView s, std::vector<uint8_t>& result);
+std::string EncodeHex(uint8_t const* data, size_t sz);
+std::string EncodeBase64(uint8_t const* data, size_t sz);
+
+// DelimitedReader reads delimited text, such as CSV or TSV, a record at a
+// time. Fields are views into the input, so nothing is copied. A quoted
+// field is the text between its quotes, with any doubled quotes left for
+// Unescape, and may contain delimiters and line breaks. Records end at LF
+// or CR LF; empty lines are skipped. Fields are found sixteen bytes at a
+// time where SIMD is available.
+//
+//     DelimitedReader reader(csv);
+//     std::vector<StrView> fields;
+//     while (reader.Next(fields)) { ... }
+//
+// Chunks splits a large input at record boundaries, so that a reader per
+// chunk can run on its own thread.
+class DelimitedReader {
+public:
+    explicit DelimitedReader(StrView s, char delimiter = ',', char quote = '"')
+    : curr(s.curr), end(s.curr + s.sz), delimiter(delimiter), quote(quote) {}
+
+    // Replace fields with the fields of the next record. Returns false at
+    // the end of input. fields keeps its storage, so once it has grown to
+    // the widest record, reading allocates nothing.
+    bool Next(std::vector<StrView>& fields);
+
+    // the input not yet read
+    StrView Remaining() const { return StrView(curr, (size_t)(end - curr)); }
+    // true once a quoted field has run to the end of input unclosed
+    bool Unterminated() const { return unterminated; }
+
+    // Split s into at most count pieces, each a run of whole records. A
+    // piece boundary is the start of a line that is outside any quoted
+    // field, found by the parity of the quotes before it.
+    static std::vector<StrView> Chunks(StrView s, size_t count, char quote = '"');
+
+    // Convert a numeric field with the sexpr number scanner, allowing white
+    // space around the number. GetInt takes decimal and 0x hex integers;
+    // GetDouble takes any number. False if the field is not such a number.
+    static bool GetInt(StrView field, int64_t& result);
+    static bool GetDouble(StrView field, double& result);
+
+    // Copy a field to result, collapsing doubled quotes.
+    static void Unescape(StrView field, std::string& result, char quote = '"');
+
+private:
+    char const* curr;
+    char const* end;
+    char delimiter;
+    char quote;
+    bool unterminated = false;
+};
+
+// Config parses INI style text into a table of (section, key, value)
+// views, grouped by section, with a hash index over section and key.
+//
+//     [audio]                     ; a comment, as is # at the start of a line
+//     rate = 48000
+//     device = "Built-in; Output" ; quoted, so the ; is part of the value
+//     latency: 5                  # ':' separates as '=' does
+//
+// Keys before the first section are in the section "". An unquoted value
+// ends at a ; or # that follows white space. A quoted value is the text
+// between the quotes, with escapes intact. A value whose line ends in a
+// backslash continues on the next line; it is joined without the
+// backslash, the line break, or the indentation of the next line. Joined
+// values are the only ones copied, into a buffer the Config owns; the other
+// views point into the input, which must outlive the Config.
+//
+// Where a key occurs more than once in a section, as when an override file
+// is appended to a base file, lookups find the last.
+class Config {
+public:
+    struct Entry {
+        StrView section;
+        StrView key;
+        StrView value;
+    };
+
+    explicit Config(StrView s);
+    Config(Config const&) = delete;
+    Config& operator=(Config const&) = delete;
+    Config(Config&&) = default;
+    Config& operator=(Config&&) = default;
+
+    // every entry in source order within its section, and the sections in
+    // the order they first appear
+    std::vector<Entry> const& Entries() const { return entries; }
+    // the entries of a section; empty if it is absent
+    struct Range {
+        Entry const* first = nullptr;
+        Entry const* last = nullptr;
+        Entry const* begin() const { return first; }
+        Entry const* end() const { return last; }
+        size_t size() const { return (size_t)(last - first); }
+        bool empty() const { return first == last; }
+    };
+    Range Section(StrView section) const;
+    // byte offsets of the lines that could not be parsed, which are skipped
+    std::vector<size_t> const& Errors() const { return errors; }
+
+    // The entry for a key, or null.
+    Entry const* Find(StrView section, StrView key) const;
+
+    // Typed lookups. Each returns false, leaving result alone, if the key is
+    // absent or its whole value does not convert. Booleans are true, yes,
+    // on or 1, and false, no, off or 0.
+    bool GetString(StrView section, StrView key, StrView& result) const;
+    bool GetInt32 (StrView section, StrView key, int32_t& result) const;
+    bool GetFloat (StrView section, StrView key, float& result) const;
+    bool GetBool  (StrView section, StrView key, bool& result) const;
+
+private:
+    std::vector<Entry>   entries;
+    std::vector<StrView> sections;      // the name of each section
+    std::vector<size_t>  sectionStart;  // per section, into entries; one extra at the end
+    std::vector<int>     table;         // open addressed; entry + 1, or 0
+    std::vector<int>     sectionTable;  // open addressed; section + 1, or 0
+    std::vector<char>    joined;        // the text of continued values
+    std::vector<size_t>  errors;
+
+    int FindSection(StrView name) const;
+    int AddSection(StrView name);
+};
+
+#ifdef LABTEXT_INSTRUMENT
+// a trace span covering a scope
+struct TraceScope {
+    explicit TraceScope(char const* name) { tsTraceBegin(name); }
+    ~TraceScope() { tsTraceEnd(); }
+    TraceScope(TraceScope const&) = delete;
+    TraceScope& operator=(TraceScope const&) = delete;
+};
+#define TS_TRACE_SCOPE(name) lab::Text::TraceScope tsTraceScope(name)
+
+// Append to a vector, counting the allocation if it grows
+template <class V, class T>
+inline void InstrumentedPush(V& v, T&& value)
+{
+    size_t capacity = v.capacity();
+    v.push_back(std::forward<T>(value));
+    if (v.capacity() != capacity) {
+        TS_STAT_ADD(allocations, 1);
+        TS_STAT_ADD(bytesAllocated, v.capacity() * sizeof(v[0]));
+    }
+}
+#define TS_PUSH(v, value) lab::Text::InstrumentedPush(v, value)
+
+// Append a range to a vector, counting the allocation if it grows
+template <class V, class T>
+inline void InstrumentedAppend(V& v, T const* first, T const* last)
+{
+    size_t capacity = v.capacity();
+    v.insert(v.end(), first, last);
+    if (v.capacity() != capacity) {
+        TS_STAT_ADD(allocations, 1);
+        TS_STAT_ADD(bytesAllocated, v.capacity() * sizeof(v[0]));
+    }
+}
+#define TS_APPEND(v, first, last) lab::Text::InstrumentedAppend(v, first, last)
+#else
+#define TS_TRACE_SCOPE(name) ((void) 0)
+#define TS_PUSH(v, value) (v).push_back(value)
+#define TS_APPEND(v, first, last) (v).insert((v).end(), first, last)
+#endif
+
+// SexprOptions selects optional work done while parsing. The defaults
+// reproduce the plain parse, and cost nothing extra.
+struct SexprOptions {
+    // record the byte offset of every element in Sexpr::offsets
+    bool trackOffsets = false;
+    // on error, drop the damaged top level form and resume at the next '('
+    // that begins a line, or the first within an unclosed form, instead of
+    // stopping. Valid input parses the same either way.
+    bool recover = false;
+    // lists nested deeper than this are an error; zero for no limit.
+    // Parsing never recurses, so depth is only limited on request.
+    int maxDepth = 0;
+    // read the input as JSON, into the same element stream; see
+    // Sexpr::ParseJson
+    bool json = false;
+};
+
+// A resolved position in a source buffer. line and column are 1 based,
+// column counts bytes, not code points.
+struct SourceLocation {
+    size_t   offset = 0;
+    uint32_t line = 0;
+    uint32_t column = 0;
+};
+
+// LineIndex records the start of every line in a buffer so that many
+// offsets can be resolved to line and column without rescanning. Build one
+// only when a location is actually needed.
+class LineIndex {
+    std::vector<size_t> lineStarts;
+public:
+    explicit LineIndex(StrView s);
+    SourceLocation Locate(size_t offset) const;
+};
+
+struct SexprError {
+    tsSexprErrorKind_t  kind = tsSexprErrorNone;
+    size_t              offset = 0;     // byte offset of the error in the input
+    std::vector<size_t> path;           // offsets of the enclosing open lists, outermost first
+};
+
+// Describe an error at `at`. formStart is the top level list the error is
+// within, or null at the top level. Offsets are relative to base.
+SexprError MakeSexprError(tsSexprErrorKind_t kind, char const* base, char const* formStart, char const* at);
+
+// A single lexical element of an s-expression. text is the element's source;
+// for a string, the text between the quotes with escapes intact.
+struct SexprToken {
+    tsSexprToken_t token = tsSexprAtom;
+    StrView        text;
+    int64_t        i = 0;       // tsSexprInteger
+    double         f = 0;       // tsSexprFloat
+    bool           hex = false; // the integer was written as a 0x literal
+    size_t         offset = 0;  // from the start of the input, set by SexprTokenizer
+};
+
+// The lexical step shared by Sexpr, VisitSexpr and SexprTokenizer. p must be
+// at neither white space nor a comment. Scans the element at p into tok and
+// returns its end, or null if p opens a string that is not closed by end.
+inline char const* ScanSexprToken(char const* p, char const* end, SexprToken& tok)
+{
+    char c = *p;
+    tok.text = StrView(p, 1);
+    if (c == '(') {
+        tok.token = tsSexprPushList;
+        return p + 1;
+    }
+    if (c == ')') {
+        tok.token = tsSexprPopList;
+        return p + 1;
+    }
+    if (c == '"') {
+        char const* close = tsScanForQuote(p + 1, end, '"', true);
+        if (close == end)
+            return nullptr;
+        tok.token = tsSexprString;
+        tok.text = StrView(p + 1, (size_t)(close - p - 1));
+        return close + 1;
+    }
+    tsLexeme_t lex;
+    char const* next = tsScanSexprAtom(p, end, &lex);
+    tok.text = StrView(p, (size_t)(next - p));
+    tok.hex = lex.kind == tsLexHex;
+    switch (lex.kind) {
+    case tsLexInteger:
+    case tsLexHex:
+        tok.token = tsSexprInteger;
+        tok.i = lex.i;
+        break;
+    case tsLexFloat:
+        tok.token = tsSexprFloat;
+        tok.f = lex.f;
+        break;
+    default:
+        tok.token = tsSexprAtom;
+        break;
+    }
+    return next;
+}
+
+// An edit to a source: removed bytes at offset were replaced by inserted
+// bytes.
+struct SexprEdit {
+    size_t offset = 0;
+    size_t removed = 0;
+    size_t inserted = 0;
+};
+
 struct Sexpr {
 
     struct Elem {
@@ -375,189 +1038,1286 @@ struct Sexpr {
     std::vector<float>       floats;
     std::vector<std::string> strings;
 
+    // byte offset of each element of expr from the start of the parsed
+    // input. Parallel to expr, and empty unless SexprOptions::trackOffsets
+    // was requested, so that the elements themselves stay small.
+    std::vector<size_t>      offsets;
+
+    // empty if the parse succeeded. Holds at most one error unless
+    // SexprOptions::recover was requested.
+    std::vector<SexprError>  errors;
+
     int balance = 0;
 
     explicit Sexpr(StrView s) {
-        Parse(s);
+        TS_TRACE_SCOPE("Sexpr::Parse");
+        ParseState st(s.curr, false, 0);
+        Parse<false>(s, st);
+    }
+
+    Sexpr(StrView s, SexprOptions const& options) {
+        Parse(s, options, nullptr);
+    }
+
+    // Resolve the location of expr[elem] within source, which must be the
+    // buffer that was parsed. Returns a zero location if offsets were not
+    // tracked. Each call scans the source up to the element; use a
+    // LineIndex to resolve many elements.
+    SourceLocation Location(StrView source, size_t elem) const;
+
+    // Accessors shared with PackedSexpr, so that a walk over a parse may be
+    // written once, as a template, for either layout. Int, Float and Text
+    // are valid for elements of the matching token; Text is that of an atom
+    // or string. End is one past the close of the list opened at elem, or
+    // elem + 1, as FrozenSexpr::End, but here it scans the list.
+    int            Count() const { return (int) expr.size(); }
+    tsSexprToken_t Token(int elem) const { return expr[elem].token; }
+    int            Int(int elem) const { return ints[expr[elem].ref]; }
+    float          Float(int elem) const { return floats[expr[elem].ref]; }
+    StrView        Text(int elem) const {
+        std::string const& str = strings[expr[elem].ref];
+        return StrView(str.data(), str.size());
     }
+    int            End(int elem) const;
+
+    // Bring the parse up to date after an edit to its source, for editors
+    // that reparse on every keystroke. source is the edited text. Only the
+    // smallest list enclosing the edit that still parses as a balanced
+    // whole is parsed again; its elements are spliced in and the offsets
+    // after it are moved. Only the parse is local: moving the offsets is a
+    // pass over every element after the edit, a few milliseconds near the
+    // start of a 10 MB document. Values of the new elements are appended to
+    // the side arrays. Offsets are always tracked. Returns false if the
+    // whole source had to be parsed, as when the previous parse had errors
+    // or the edit broke the structure around it.
+    bool Reparse(StrView source, SexprEdit const& edit, SexprOptions const& options = SexprOptions());
 
 private:
-    StrView Parse(StrView s) {
-        StrView curr = s;
-        while (true) {
-            curr = curr.ScanForNonWhiteSpace();
-            if (curr.sz == 0)
-                return curr; // parsing finished
-            if (*curr.curr == ';') {
-                curr = curr.ScanForBeginningOfNextLine(); // Lisp comment
-                continue;
+    friend class SexprParser;
+    friend class SexprCache;
+    Sexpr() = default;
+
+    // side array entries left unreferenced by Reparse; they are reclaimed
+    // by parsing the whole source once they outnumber the elements
+    size_t unreferenced = 0;
+
+    bool ReparseRange(StrView source, int lo, int hi, size_t start, size_t end,
+                      ptrdiff_t delta, SexprOptions const& options, int depth);
+
+    // bookkeeping for a single parse; the marks record the sizes of the
+    // output at the start of the current top level form so that recovery
+    // can discard it
+    struct ParseState {
+        char const* base;
+        char const* formStart = nullptr;
+        size_t exprMark = 0, intsMark = 0, floatsMark = 0, stringsMark = 0, offsetsMark = 0;
+        bool recover;
+        int maxDepth;
+        std::vector<std::string>* spare = nullptr;  // strings whose storage may be reused
+        tsNumber_t numbers[64];     // staging for runs of numbers
+        size_t numberOffsets[64];   // and where each began, when offsets are tracked
+        ParseState(char const* base, bool recover, int maxDepth)
+        : base(base), recover(recover), maxDepth(maxDepth) {}
+    };
+
+    void Parse(StrView s, SexprOptions const& options, std::vector<std::string>* spare) {
+        TS_TRACE_SCOPE("Sexpr::Parse");
+        ParseState st(s.curr, options.recover, options.maxDepth);
+        st.spare = spare;
+        if (options.json) {
+            if (options.trackOffsets)
+                ParseJson<true>(s, st);
+            else
+                ParseJson<false>(s, st);
+        }
+        else if (options.trackOffsets)
+            Parse<true>(s, st);
+        else
+            Parse<false>(s, st);
+    }
+
+    void PushString(char const* str, size_t sz, ParseState& st) {
+        if (st.spare && !st.spare->empty()) {
+            TS_PUSH(strings, std::move(st.spare->back()));
+            st.spare->pop_back();
+#ifdef LABTEXT_INSTRUMENT
+            if (sz > strings.back().capacity()) {
+                TS_STAT_ADD(allocations, 1);
+                TS_STAT_ADD(bytesAllocated, sz + 1);
             }
-            if (*curr.curr != '(') {
-                curr.sz = 0; // stop parsing
-                return curr; // error
+#endif
+            strings.back().assign(str, sz);
+        }
+        else {
+            TS_PUSH(strings, std::string(str, sz));
+#ifdef LABTEXT_INSTRUMENT
+            if (strings.back().capacity() > std::string().capacity()) {
+                TS_STAT_ADD(allocations, 1);
+                TS_STAT_ADD(bytesAllocated, strings.back().capacity() + 1);
             }
-            break;
+#endif
         }
-        ++balance;
-        expr.push_back({ tsSexprPushList, 0 });
+    }
 
-        curr.curr++;
-        curr.sz--;
+    template <bool TrackOffsets>
+    void Emit(tsSexprToken_t token, int ref, char const* at, ParseState const& st) {
+        TS_STAT_TOKEN(token);
+        TS_PUSH(expr, Elem({ token, ref }));
+        if (TrackOffsets)
+            TS_PUSH(offsets, (size_t)(at - st.base));
+    }
+
+    void MarkForm(ParseState& st, char const* at) {
+        st.formStart = at;
+        st.exprMark = expr.size();
+        st.intsMark = ints.size();
+        st.floatsMark = floats.size();
+        st.stringsMark = strings.size();
+        st.offsetsMark = offsets.size();
+    }
+
+    // Record an error. Returns false if parsing should stop, otherwise the
+    // damaged form has been discarded and curr moved to resume, or to the
+    // next top level list after resume if skip is set.
+    bool Fail(ParseState& st, tsSexprErrorKind_t kind, char const* at,
+              StrView& curr, char const* resume, bool skip) {
+        errors.push_back(MakeSexprError(kind, st.base, balance > 0 ? st.formStart : nullptr, at));
+
+        char const* end = curr.curr + curr.sz;
+        if (!st.recover) {
+            curr = StrView(end, 0);
+            return false;
+        }
+        if (balance > 0) {
+            expr.resize(st.exprMark);
+            ints.resize(st.intsMark);
+            floats.resize(st.floatsMark);
+            strings.resize(st.stringsMark);
+            offsets.resize(st.offsetsMark);
+            balance = 0;
+        }
+        if (skip)
+            resume = tsScanForTopLevelList(resume, end);
+        curr = StrView(resume, (size_t)(end - resume));
+        return true;
+    }
 
+    // A single loop over the input. The output is a flat token stream, so
+    // the only nesting state is the balance; no native recursion is needed,
+    // and nesting depth costs nothing but the optional maxDepth check.
+    template <bool TrackOffsets>
+    void Parse(StrView s, ParseState& st) {
+        StrView curr = s;
         while (true) {
-            curr = curr.ScanForNonWhiteSpace();
-            if (curr.sz == 0)
-                return curr;
+            curr = curr.SkipCommentsAndWhiteSpace(tsCommentSemicolon); // Lisp comments
+            if (curr.sz == 0) {
+                // in recovery mode, an unclosed form is dropped and parsing
+                // resumes at the first '(' beginning a line within it
+                if (balance > 0 &&
+                    Fail(st, tsSexprErrorUnclosedList, curr.curr, curr, st.formStart + 1, true))
+                    continue;
+                return; // parsing finished
+            }
 
-            if (*curr.curr == ';') {
-                curr = curr.ScanForBeginningOfNextLine().ScanForNonWhiteSpace();
+            char c = *curr.curr;
+            if (balance == 0 && c != '(' && c != ')') {
+                // only lists may appear at the top level
+                if (!Fail(st, tsSexprErrorUnexpectedCharacter, curr.curr, curr, curr.curr, true))
+                    return;
                 continue;
             }
-            if (*curr.curr == '"') {
-                StrView str;
-                curr = curr.GetString(true, str).ScanForNonWhiteSpace();
-                expr.push_back({ tsSexprString, (int)strings.size() });
-                strings.push_back(std::string(str.curr, str.sz));
-                if (curr.sz == 0)
-                    return curr;
+
+            char const* end = curr.curr + curr.sz;
+            if (tsIsNumeric(c) || c == '-' || c == '+') {
+                // runs of numbers, such as sample buffers, convert in bulk
+                tsNumber_t* numbers = st.numbers;
+                size_t count;
+                char const* next = tsGetSexprNumbers(curr.curr, end, numbers,
+                                                     TrackOffsets ? st.numberOffsets : nullptr, 64, &count);
+                if (count) {
+                    TS_STAT_SCAN(tsScanNumberRun, next - curr.curr);
+                    if (TrackOffsets) {
+                        size_t at = (size_t)(curr.curr - st.base);
+                        for (size_t n = 0; n < count; ++n)
+                            st.numberOffsets[n] += at;
+                        TS_APPEND(offsets, st.numberOffsets, st.numberOffsets + count);
+                    }
+                    for (size_t n = 0; n < count; ++n) {
+                        if (numbers[n].kind == tsNumberFloat) {
+                            TS_STAT_TOKEN(tsSexprFloat);
+                            TS_PUSH(expr, Elem({ tsSexprFloat, (int)floats.size() }));
+                            TS_PUSH(floats, (float) numbers[n].f);
+                        }
+                        else {
+                            TS_STAT_TOKEN(tsSexprInteger);
+                            TS_PUSH(expr, Elem({ tsSexprInteger, (int)ints.size() }));
+                            TS_PUSH(ints, (int) numbers[n].i);
+                        }
+                    }
+                    curr = StrView(next, (size_t)(end - next));
+                    continue;
+                }
+                if (tsIsNumeric(c) || ((c == '-' || c == '+') && curr.sz > 1 && tsIsNumeric(curr.curr[1])))
+                    TS_STAT_ADD(numberRetries, 1);
+            }
+
+            SexprToken tok;
+            char const* next = ScanSexprToken(curr.curr, end, tok);
+            if (!next) {
+                if (!Fail(st, tsSexprErrorUnterminatedString, curr.curr, curr, curr.curr + 1, true))
+                    return;
                 continue;
             }
-            if (*curr.curr == ')') {
+            if (tok.token == tsSexprString)
+                TS_STAT_SCAN(tsScanString, next - curr.curr);
+            else if (tok.token != tsSexprPushList && tok.token != tsSexprPopList)
+                TS_STAT_SCAN(tsScanAtom, next - curr.curr);
+            switch (tok.token) {
+            case tsSexprPushList:
+                if (balance == 0)
+                    MarkForm(st, curr.curr);
+                if (st.maxDepth && balance >= st.maxDepth) {
+                    if (!Fail(st, tsSexprErrorDepthExceeded, curr.curr, curr, next, true))
+                        return;
+                    continue;
+                }
+                ++balance;
+                TS_STAT_DEPTH(balance);
+                Emit<TrackOffsets>(tsSexprPushList, 0, curr.curr, st);
+                break;
+            case tsSexprPopList:
+                if (balance == 0) {
+                    if (!Fail(st, tsSexprErrorUnbalancedClose, curr.curr, curr, curr.curr, true))
+                        return;
+                    continue;
+                }
                 --balance;
-                expr.push_back({ tsSexprPopList, 0 });
-                curr.curr++;
-                curr.sz--;
-                continue;
+                Emit<TrackOffsets>(tsSexprPopList, 0, curr.curr, st);
+                break;
+            default:
+                EmitValue<TrackOffsets>(tok, curr.curr, st);
+                break;
             }
-            if (*curr.curr == '(') {
-                curr = Parse(curr);
-                continue;
+            curr = StrView(next, (size_t)(end - next));
+        }
+    }
+
+    // JSON arrays and objects become lists, so the structural indexes and
+    // queries work as they do on s-expressions. An object's keys become
+    // keyword atoms, so {"name": "osc", "freq": 440} reads as
+    // (:name "osc" :freq 440); strings keep their escapes intact, as
+    // s-expression strings do, and true, false and null are atoms. The
+    // input may hold any number of values, as JSON Lines does. Parsing
+    // stops at the first error; SexprOptions::recover does not apply.
+    template <bool TrackOffsets>
+    void ParseJson(StrView s, ParseState& st) {
+        char const* p = s.curr;
+        char const* end = s.curr + s.sz;
+        std::vector<size_t> open;   // offsets of the open arrays and objects
+        enum { Value, Key, Colon, Next } expect = Value;
+        bool opened = false;        // a close may follow directly
+        auto fail = [&](tsSexprErrorKind_t kind) {
+            SexprError err;
+            err.kind = kind;
+            err.offset = (size_t)(p - st.base);
+            err.path = open;
+            errors.push_back(std::move(err));
+            balance = (int) open.size();
+        };
+        while (true) {
+            char const* start = tsScanForNonWhiteSpace(p, end);
+            TS_STAT_SCAN(tsScanWhiteSpace, start - p);
+            p = start;
+            if (p == end) {
+                if (!open.empty())
+                    fail(tsSexprErrorUnclosedList);
+                return;
             }
 
-            StrView token = curr;
-            token.sz = 0;
-            while (curr.sz > 0) {
-                if (*curr.curr == '"')
-                    break;
-                if (*curr.curr == '(')
-                    break;
-                if (*curr.curr == ')')
-                    break;
-                if (tsIsWhiteSpace(*curr.curr))
-                    break;
-                if (*curr.curr == ';')
-                    break;
-                token.sz++;
-                curr.curr++;
-                curr.sz--;
+            char c = *p;
+            if ((c == ']' || c == '}') && (expect == Next || opened || open.empty())) {
+                if (open.empty() || st.base[open.back()] != (c == ']' ? '[' : '{'))
+                    return fail(tsSexprErrorUnbalancedClose);
+                open.pop_back();
+                Emit<TrackOffsets>(tsSexprPopList, 0, p, st);
+                ++p;
+                expect = open.empty() ? Value : Next;
+                opened = false;
+                continue;
             }
-            if (!token.sz)
+            opened = false;
+            switch (expect) {
+            case Next:
+                if (c != ',')
+                    return fail(tsSexprErrorUnexpectedCharacter);
+                ++p;
+                expect = st.base[open.back()] == '{' ? Key : Value;
+                continue;
+            case Colon:
+                if (c != ':')
+                    return fail(tsSexprErrorUnexpectedCharacter);
+                ++p;
+                expect = Value;
+                continue;
+            case Key: {
+                if (c != '"')
+                    return fail(tsSexprErrorUnexpectedCharacter);
+                char const* close = tsScanForQuote(p + 1, end, '"', true);
+                if (close == end)
+                    return fail(tsSexprErrorUnterminatedString);
+                TS_STAT_SCAN(tsScanString, close + 1 - p);
+                // the key with its opening quote, which becomes the ':'
+                Emit<TrackOffsets>(tsSexprAtom, (int) strings.size(), p, st);
+                PushString(p, (size_t)(close - p), st);
+                strings.back()[0] = ':';
+                p = close + 1;
+                expect = Colon;
                 continue;
+            }
+            case Value:
+                break;
+            }
 
-            float f;
-            StrView test = token.GetFloat(f);
-            if (test.curr != token.curr) {
-                expr.push_back({ tsSexprFloat, (int)floats.size() });
-                floats.push_back(f);
-                curr.curr = test.curr;
-                curr.sz -= test.sz;
+            if (c == '[' || c == '{') {
+                if (st.maxDepth && (int) open.size() >= st.maxDepth)
+                    return fail(tsSexprErrorDepthExceeded);
+                open.push_back((size_t)(p - st.base));
+                TS_STAT_DEPTH((int) open.size());
+                Emit<TrackOffsets>(tsSexprPushList, 0, p, st);
+                ++p;
+                expect = c == '[' ? Value : Key;
+                opened = true;
+                continue;
+            }
+            SexprToken tok;
+            char const* next;
+            if (c == '"') {
+                next = ScanSexprToken(p, end, tok);
+                if (!next)
+                    return fail(tsSexprErrorUnterminatedString);
+                TS_STAT_SCAN(tsScanString, next - p);
+            }
+            else if (c == '-' || tsIsNumeric(c)) {
+                // delimit the number, then scan it as an s-expression atom
+                next = p + 1;
+                while (next < end && (tsIsNumeric(*next) || *next == '.' || *next == 'e' || *next == 'E' ||
+                                      *next == '-' || *next == '+'))
+                    ++next;
+                tsLexeme_t lex;
+                if (tsScanSexprAtom(p, next, &lex) != next || lex.kind == tsLexAtom || lex.kind == tsLexHex)
+                    return fail(tsSexprErrorUnexpectedCharacter);
+                tok.token = lex.kind == tsLexFloat ? tsSexprFloat : tsSexprInteger;
+                tok.i = lex.i;
+                tok.f = lex.f;
+                TS_STAT_SCAN(tsScanAtom, next - p);
             }
             else {
-                int32_t i;
-                StrView test = token.GetInt32(i);
-                if (test.curr != token.curr) {
-                    expr.push_back({ tsSexprInteger, (int)ints.size() });
-                    ints.push_back(i);
-                    curr.curr = test.curr;
-                    curr.sz -= test.sz;
-                }
-                else {
-                    expr.push_back({ tsSexprAtom, (int)strings.size() });
-                    strings.push_back(std::string(token.curr, token.sz));
+                static char const* const literals[] = { "true", "false", "null" };
+                next = nullptr;
+                for (char const* literal : literals) {
+                    size_t n = strlen(literal);
+                    if ((size_t)(end - p) >= n && !memcmp(p, literal, n) &&
+                        ((size_t)(end - p) == n || !tsIsAlpha(p[n]))) {
+                        tok.token = tsSexprAtom;
+                        tok.text = StrView(p, n);
+                        next = p + n;
+                        break;
+                    }
                 }
+                if (!next)
+                    return fail(tsSexprErrorUnexpectedCharacter);
+                TS_STAT_SCAN(tsScanAtom, next - p);
+            }
+            EmitValue<TrackOffsets>(tok, p, st);
+            p = next;
+            expect = open.empty() ? Value : Next;
+        }
+    }
+
+    // Integers are held in 32 bits; hex literals keep their bit pattern, so
+    // 0xffffffff reads as -1. Integers out of range are kept as floats.
+    template <bool TrackOffsets>
+    void EmitValue(SexprToken const& tok, char const* at, ParseState& st) {
+        switch (tok.token) {
+        case tsSexprInteger:
+            if (tok.i >= INT32_MIN && tok.i <= (tok.hex ? (int64_t) UINT32_MAX : INT32_MAX)) {
+                Emit<TrackOffsets>(tsSexprInteger, (int)ints.size(), at, st);
+                TS_PUSH(ints, (int)(uint32_t) tok.i);
             }
-            curr = curr.ScanForNonWhiteSpace();
+            else {
+                Emit<TrackOffsets>(tsSexprFloat, (int)floats.size(), at, st);
+                TS_PUSH(floats, (float) tok.i);
+            }
+            break;
+        case tsSexprFloat:
+            Emit<TrackOffsets>(tsSexprFloat, (int)floats.size(), at, st);
+            TS_PUSH(floats, (float) tok.f);
+            break;
+        default:
+            Emit<TrackOffsets>(tok.token, (int)strings.size(), at, st);
+            PushString(tok.text.curr, tok.text.sz, st);
+            break;
         }
     }
 };
 
+// SexprParser parses a stream of documents into storage that is kept from
+// one parse to the next, including the buffers of parsed strings. Once the
+// buffers have grown to fit the messages being parsed, parsing does no heap
+// allocation, except to report errors.
+class SexprParser {
+    Sexpr result;
+    std::vector<std::string> spare;
+    size_t reserved = 0;    // the largest input the storage has been sized for
+public:
+    // Parse s, replacing the previous result. The result remains valid
+    // until the next call to Parse or Reset.
+    Sexpr const& Parse(StrView s);
+    Sexpr const& Parse(StrView s, SexprOptions const& options);
+
+    // Empty the result, retaining all storage.
+    void Reset();
+
+    // Size the storage for a parse of s from a quick count of its lists and
+    // atoms. Parse does this itself for inputs larger than any seen so far.
+    void Reserve(StrView s, bool trackOffsets = false);
+
+    Sexpr const& Result() const { return result; }
+};
 
+#ifdef LABTEXT_SEXPR_CACHE
+// SexprCache keeps binary images of parses in a directory, keyed by a hash
+// of the input bytes and the parse options, so that input parsed before, by
+// this or another process, is loaded from its image instead of parsed.
+// Images are written to a temporary file and renamed into place, so that a
+// reader never sees a partial image and processes may share a directory.
+// The directory is kept under maxBytes by evicting the least recently used
+// images. Parses with errors are not cached. An object is not itself
+// thread safe; give each thread its own.
+class SexprCache {
+public:
+    explicit SexprCache(std::string directory, uint64_t maxBytes = 256ull << 20);
 
-}} // lab::Text
+    // Parse s, or load the parse of identical input from the cache.
+    Sexpr Parse(StrView s, SexprOptions const& options = SexprOptions());
 
-#endif // cplusplus
+    // Remove every image.
+    void Clear();
 
+    size_t Hits() const { return hits; }
+    size_t Misses() const { return misses; }
 
-#endif // LABTEXT_H
+private:
+    std::string ImagePath(uint64_t key) const;
+    bool Load(std::string const& path, uint64_t key, size_t inputSize, Sexpr& result);
+    void Store(std::string const& path, uint64_t key, size_t inputSize, Sexpr const& tree);
+    void Evict();
+
+    std::string directory;
+    uint64_t maxBytes;
+    uint64_t bytes = 0;     // the size of the images, as last seen plus written since
+    size_t hits = 0;
+    size_t misses = 0;
+};
+#endif
 
-#ifdef LABTEXT_ODR
+// FrozenSexpr holds a parsed Sexpr that will no longer change, so that it
+// can be queried from many threads at once. The indexes over it are built
+// lazily, each exactly once under std::call_once, whichever thread asks
+// first; after that every query is a plain read, without locks. Each index
+// occupies its own cache lines, so readers do not false share. (Heap
+// allocation honours that alignment from C++17.)
+//
+// Elements are identified by their position in Tree().expr.
+class FrozenSexpr {
+public:
+    explicit FrozenSexpr(StrView s, SexprOptions const& options = SexprOptions())
+    : tree(s, options) {}
+    explicit FrozenSexpr(Sexpr&& s) : tree(std::move(s)) {}
+    FrozenSexpr(FrozenSexpr const&) = delete;
+    FrozenSexpr& operator=(FrozenSexpr const&) = delete;
+
+    Sexpr const& Tree() const { return tree; }
+
+    // Build every index now, for example before sharing the tree, so that
+    // no reader pays for the first use.
+    void BuildIndexes() const;
+
+    // Structure. End is one past the close of the list opened at elem, or
+    // elem + 1 for any other element; the elements of a list are visited
+    // by stepping from list + 1 to End(list) - 1 with End.
+    int End(int elem) const { return Structure().end[elem]; }
+    // the list enclosing elem, or -1 at the top level
+    int Parent(int elem) const { return Structure().parent[elem]; }
+
+    // Interning. Every atom and string with the same text has the same
+    // symbol, numbered from zero.
+    int Symbol(StrView text) const;              // -1 if the text never occurs
+    int SymbolOf(int elem) const;                // -1 for lists and numbers
+    int SymbolCount() const { return (int) Symbols().text.size(); }
+    StrView SymbolText(int symbol) const;
+
+    // Keywords, atoms beginning with ':'. Keyword returns the elements at
+    // which the keyword occurs, in order.
+    struct Range {
+        int const* first = nullptr;
+        int const* last = nullptr;
+        int const* begin() const { return first; }
+        int const* end() const { return last; }
+        size_t size() const { return (size_t)(last - first); }
+        bool empty() const { return first == last; }
+    };
+    Range Keyword(StrView keyword) const;
 
-//------------------------------------------------------------------------------
-// IMPLEMENTATION
-//------------------------------------------------------------------------------
+    // The element following keyword among the immediate elements of list,
+    // as in (node :name "a" :gain 0.5), or -1.
+    int Find(int list, StrView keyword) const;
 
-#include <math.h>
-#include <stdbool.h>
+private:
+    struct alignas(LABTEXT_CACHE_LINE) StructureIndex {
+        std::once_flag   once;
+        std::vector<int> end;
+        std::vector<int> parent;
+    };
+    struct alignas(LABTEXT_CACHE_LINE) SymbolIndex {
+        std::once_flag        once;
+        std::vector<int>      ofString;   // the symbol of each of tree.strings
+        std::vector<StrView>  text;       // the text of each symbol
+        std::vector<int>      table;      // open addressed; symbol + 1, or 0
+    };
+    struct alignas(LABTEXT_CACHE_LINE) KeywordIndex {
+        std::once_flag   once;
+        std::vector<int> start;           // per symbol, into elems; one extra at the end
+        std::vector<int> elems;
+    };
 
-//! @todo replace Assert with custom error reporting mechanism
-#include <assert.h>
-#define Assert assert
+    StructureIndex const& Structure() const {
+        std::call_once(structure.once, [this]() { BuildStructure(); });
+        return structure;
+    }
+    SymbolIndex const& Symbols() const {
+        std::call_once(symbols.once, [this]() { BuildSymbols(); });
+        return symbols;
+    }
+    KeywordIndex const& Keywords() const {
+        std::call_once(keywords.once, [this]() { BuildKeywords(); });
+        return keywords;
+    }
+    void BuildStructure() const;
+    void BuildSymbols() const;
+    void BuildKeywords() const;
+
+    Sexpr tree;
+    mutable StructureIndex structure;
+    mutable SymbolIndex    symbols;
+    mutable KeywordIndex   keywords;
+};
+
+// PackedSexpr holds a parse in a single 32 bit word per element, so that
+// walking a large graph touches one array rather than the elements and
+// three side arrays of a Sexpr. The low three bits of a word are the
+// element's tsSexprToken_t, and the upper 28 bits its value: an integer
+// that fits, the upper bits of a float whose low four bits are zero, the
+// symbol of an atom or string, or for a list the distance to its End. A
+// value that does not fit is kept in an overflow table, and bit 3 marks a
+// word whose upper bits index that table instead. Atoms and strings are
+// interned into one buffer of text.
+//
+// The accessors are those of Sexpr, plus O(1) End and the symbols. The
+// source offsets of a parse are not kept.
+class PackedSexpr {
+public:
+    explicit PackedSexpr(StrView s, SexprOptions const& options = SexprOptions());
+    explicit PackedSexpr(Sexpr const& tree);
+
+    // empty if the parse succeeded, as for Sexpr
+    std::vector<SexprError> errors;
+
+    int            Count() const { return (int) words.size(); }
+    tsSexprToken_t Token(int elem) const { return (tsSexprToken_t)(words[elem] & TokenMask); }
+    int            Int(int elem) const {
+        uint32_t w = words[elem];
+        return w & Overflow ? (int) overflow[w >> ValueShift] : (int32_t)(w & ValueMask) / (1 << ValueShift);
+    }
+    float          Float(int elem) const {
+        uint32_t w = words[elem];
+        uint32_t bits = w & Overflow ? overflow[w >> ValueShift] : w & ValueMask;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+    StrView        Text(int elem) const { return SymbolText(SymbolOf(elem)); }
+    int            End(int elem) const {
+        uint32_t w = words[elem];
+        return (w & TokenMask) == tsSexprPushList ? elem + (int) Value(w) : elem + 1;
+    }
 
+    // Every atom and string with the same text has the same symbol,
+    // numbered from zero.
+    int     Symbol(StrView text) const;   // -1 if the text never occurs
+    int     SymbolOf(int elem) const {    // -1 for lists and numbers
+        uint32_t w = words[elem];
+        uint32_t token = w & TokenMask;
+        return token == tsSexprAtom || token == tsSexprString ? (int) Value(w) : -1;
+    }
+    int     SymbolCount() const { return (int) textStart.size() - 1; }
+    StrView SymbolText(int symbol) const {
+        return StrView(text.data() + textStart[symbol], textStart[symbol + 1] - textStart[symbol]);
+    }
 
-/*
-* The two functions, tsConvertUtf16ToUtf8 and tsConvertUtf8ToUtf16 are
-* originally from the Effekseer library, and bear the following license:
+    // the words, overflow, text and tables, in bytes
+    size_t Bytes() const;
 
-The MIT License (MIT)
+private:
+    enum : uint32_t { TokenMask = 7, Overflow = 8, ValueShift = 4, ValueMask = ~15u };
+
+    uint32_t Value(uint32_t w) const { return w & Overflow ? overflow[w >> ValueShift] : w >> ValueShift; }
+    uint32_t Encode(tsSexprToken_t token, uint32_t value);  // inline if the value fits
+    uint32_t Spill(tsSexprToken_t token, uint32_t value);   // always to the overflow table
+    int      Intern(std::string const& str);
+    void     Pack(Sexpr const& tree);
+
+    std::vector<uint32_t> words;
+    std::vector<uint32_t> overflow;
+    std::string           text;           // the text of every symbol, end to end
+    std::vector<uint32_t> textStart;      // per symbol, into text; one extra at the end
+    std::vector<int>      table;          // open addressed; symbol + 1, or 0
+};
 
-Copyright (c) 2011 Effekseer Project
+// SexprHashes gives every element of a parse a 64 bit structural hash, of
+// its token and value, and for a list, of everything within it in order.
+// Equal subtrees hash equally wherever they occur, in one parse or in two,
+// so comparing subtrees is comparing integers: different hashes are
+// certainly different subtrees, and equal hashes are equal subtrees but for
+// a 64 bit collision. Built when needed, in one pass over the elements of a
+// Sexpr or PackedSexpr, and independent of it afterwards.
+class SexprHashes {
+public:
+    explicit SexprHashes(Sexpr const& tree);
+    explicit SexprHashes(PackedSexpr const& tree);
+
+    int            Count() const { return (int) hashes.size(); }
+    uint64_t       Hash(int elem) const { return hashes[elem]; }
+    tsSexprToken_t Token(int elem) const { return (tsSexprToken_t) tokens[elem]; }
+    // one past the close of the list opened at elem, or elem + 1
+    int            End(int elem) const { return ends[elem]; }
+    // for a list, the first list of the parse with the same hash, so that
+    // identical subtrees can share one copy; elem itself for a value
+    int            Canonical(int elem) const { return canonical[elem]; }
+    // the hash of the whole sequence of top level forms
+    uint64_t       Document() const { return document; }
 
-Permission is hereby granted, free of charge, to any person obtaining a copy of
-this software and associated documentation files (the "Software"), to deal in
-the Software without restriction, including without limitation the rights to
-use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
-the Software, and to permit persons to whom the Software is furnished to do so,
-subject to the following conditions:
+private:
+    template <class Tree>
+    void Build(Tree const& tree);
+
+    std::vector<uint64_t> hashes;
+    std::vector<int>      ends;
+    std::vector<int>      canonical;
+    std::vector<uint8_t>  tokens;
+    uint64_t              document = 0;
+};
 
-The above copyright notice and this permission notice shall be included in all
-copies or substantial portions of the Software.
+// One difference found by DiffSexpr. from and to are elements of the two
+// parses, or -1. An element only in to was Added, and one only in from was
+// Removed. Changed pairs two lists with the same head and the same first
+// string, typically a name, or two values of the same token, in the same
+// place; the differences within a changed list follow it.
+struct SexprChange {
+    enum Kind { Added, Removed, Changed };
+    Kind kind = Changed;
+    int  from = -1;
+    int  to = -1;
+};
 
-THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
-IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
-FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
-COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
-IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
-CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// The differences between two parses, in document order.
+// Runs of equal forms at the start and end of each list are skipped by
+// comparing hashes, and equal forms elsewhere are matched through a hash
+// table, so that the work is in proportion to the lists along the paths to
+// the changes rather than to the documents. Moved forms are not reported.
+std::vector<SexprChange> DiffSexpr(SexprHashes const& from, SexprHashes const& to);
+
+// A problem found by SexprSchema. offset is a byte offset in the source
+// validated, or in the schema for errors in the schema itself; it is 0 for
+// a Sexpr parsed without trackOffsets. elem is the element of a validated
+// Sexpr, or -1. name is the form or keyword concerned, viewing the schema.
+struct SchemaError {
+    enum Kind {
+        Syntax,             // the source does not parse
+        Schema,             // a declaration in the schema that does not compile
+        UnknownForm,        // a list whose head is not a form allowed there; name is the form expected, if any
+        UnknownKeyword,
+        DuplicateKeyword,
+        MissingKeyword,     // a required keyword absent from the list at offset
+        UnexpectedValue,    // a value before the first keyword, or beyond a field's values
+        WrongType,
+        MissingValue        // fewer values than the field takes, after the keyword at offset
+    };
+    Kind    kind = Syntax;
+    size_t  offset = 0;
+    int     elem = -1;
+    StrView name;
+};
 
-*/
+// SexprSchema compiles a description of the forms a document may hold into
+// tables of forms, fields and value types, indexed by one open addressed
+// table over heads and keywords. The schema is itself s-expressions:
+//
+//     (form ls-node
+//         (:name string)              ; required, one string
+//         (:pos number number)        ; required, two numbers
+//         (:value? number)            ; optional
+//         (:tags? atom *)             ; any number of atoms; + for one or more
+//         (:env? env))                ; a list checked as the form env
+//     (form env open                  ; open: other keywords are allowed
+//         (:attack number))
+//     (top ls-node)                   ; the forms allowed at the top level; all if absent
+//
+// Value types are int, number, string, atom, bool, list and any, or the
+// name of a form, whose list may begin with its head or go straight to its
+// keywords. A repetition mark applies to the last type. A form has at most
+// 64 fields.
+//
+// Validate checks a document in one pass over its elements, with a stack of
+// the open lists and one table probe per head and keyword. Validating
+// source text fuses the check into tokenizing, so that no tree is built; a
+// syntax error ends it. Use a LineIndex to turn offsets into lines.
+class SexprSchema {
+public:
+    explicit SexprSchema(StrView schema);
+
+    // empty if the schema compiled
+    std::vector<SchemaError> errors;
+
+    // Each appends the problems found to errors, and returns true if there
+    // were none.
+    bool Validate(Sexpr const& tree, std::vector<SchemaError>& errors) const;
+    bool Validate(StrView source, std::vector<SchemaError>& errors) const;
 
-/**
-    @brief    Convert UTF16 into UTF8
-    @param    dst    a pointer to destination buffer
-    @param    dst_size    a length of destination buffer
-    @param    src            a source buffer
-    @return    length except 0
-*/
-int32_t tsConvertUtf16ToUtf8(char* dst, int32_t dst_size, const uint16_t* src)
-{
-    int32_t cnt = 0;
-    const uint16_t* wp = src;
-    char* cp = dst;
+private:
+    friend class SchemaCheck;
+    enum Type : uint16_t { TypeInt, TypeNumber, TypeString, TypeAtom, TypeBool, TypeList, TypeAny, TypeForm };
+    struct Form {
+        StrView  head;
+        int      firstField = 0;
+        int      fieldCount = 0;
+        bool     open = false;
+        bool     top = true;
+        uint64_t required = 0;      // a bit per field
+    };
+    struct Field {
+        StrView  keyword;
+        int      typeStart = 0;     // into types; TypeForm + form for a form
+        int      typeCount = 0;
+        char     repeat = 0;        // '*', '+' or 0
+    };
 
-    if (dst_size == 0)
-        return 0;
+    // the form with head text when form is -1, or the field of form with
+    // keyword text; -1 if there is none
+    int  Lookup(int form, StrView text) const;
+    void Insert(int form, int index);
+    void Fail(int elem, StrView name);
 
-    dst_size -= 3;
+    struct Slot {
+        int form = -1;              // of a field, or -1 for a head
+        int index = 0;              // form or field + 1, or 0 if empty
+    };
 
-    for (cnt = 0; cnt < dst_size;)
-    {
-        uint16_t wc = *wp++;
-        if (wc == 0)
-        {
+    Sexpr                 source;
+    std::vector<Form>     forms;
+    std::vector<Field>    fields;
+    std::vector<uint16_t> types;
+    std::vector<Slot>     table;    // open addressed, over heads and keywords
+};
+
+// VisitSexpr parses s without storing anything, handing each element to the
+// visitor as it is scanned:
+//
+//     void OnPush();                  // '('
+//     void OnPop();                   // ')'
+//     void OnAtom(StrView atom);
+//     void OnInt(int64_t value);      // integers and hex literals
+//     void OnFloat(double value);
+//     void OnString(StrView str);     // the text between the quotes, escapes intact
+//
+// The visitor is a template parameter so that the calls inline. Parsing
+// stops at the first error, which is returned; there is no recovery, as
+// elements already delivered cannot be withdrawn. Memory use is constant.
+template <class Visitor>
+SexprError VisitSexpr(StrView s, Visitor& visitor, int maxDepth = 0)
+{
+    char const* base = s.curr;
+    char const* end = s.curr + s.sz;
+    char const* p = s.curr;
+    char const* formStart = p;
+    int balance = 0;
+    while (true) {
+        p = tsSkipCommentsAndWhitespaceExt(p, end, tsCommentSemicolon);
+        if (p == end) {
+            if (balance > 0)
+                return MakeSexprError(tsSexprErrorUnclosedList, base, formStart, p);
+            return SexprError();
+        }
+        SexprToken tok;
+        char const* next = ScanSexprToken(p, end, tok);
+        if (balance == 0 && (!next || (tok.token != tsSexprPushList && tok.token != tsSexprPopList)))
+            return MakeSexprError(tsSexprErrorUnexpectedCharacter, base, nullptr, p);
+        if (!next)
+            return MakeSexprError(tsSexprErrorUnterminatedString, base, formStart, p);
+        switch (tok.token) {
+        case tsSexprPushList:
+            if (balance == 0)
+                formStart = p;
+            if (maxDepth && balance >= maxDepth)
+                return MakeSexprError(tsSexprErrorDepthExceeded, base, formStart, p);
+            ++balance;
+            visitor.OnPush();
             break;
+        case tsSexprPopList:
+            if (balance == 0)
+                return MakeSexprError(tsSexprErrorUnbalancedClose, base, nullptr, p);
+            --balance;
+            visitor.OnPop();
+            break;
+        case tsSexprInteger: visitor.OnInt(tok.i); break;
+        case tsSexprFloat: visitor.OnFloat(tok.f); break;
+        case tsSexprString: visitor.OnString(tok.text); break;
+        default: visitor.OnAtom(tok.text); break;
         }
-        if ((wc & ~0x7f) == 0)
-        {
+        p = next;
+    }
+}
+
+// SexprTokenizer yields the elements of an s-expression one at a time, so
+// that a consumer can interleave parsing with its own work, stop early, or
+// run many documents in turn on one thread. Input is either a complete
+// buffer, or a sequence of chunks handed to Feed as they arrive; an element
+// split across chunks is reassembled in a carry buffer that is reused, so
+// there are no allocations per element.
+//
+//     SexprTokenizer t;
+//     t.Feed(chunk);
+//     SexprToken tok;
+//     while (true) {
+//         switch (t.Next(tok)) {
+//         case SexprTokenizer::Token: ...; continue;
+//         case SexprTokenizer::NeedInput: t.Feed(more); /* or t.Finish() */ continue;
+//         default: break;   // End or Error
+//         }
+//         break;
+//     }
+//
+// A token's text remains valid until the next call to Next or Feed, and
+// while the chunk it came from is alive. Errors stop tokenizing; they carry
+// a kind and offset, but no path, as earlier chunks may be gone.
+class SexprTokenizer {
+public:
+    enum Status { Token, NeedInput, End, Error };
+
+    // tokenize a complete buffer
+    explicit SexprTokenizer(StrView s, int maxDepth = 0)
+    : chunk(s.curr), p(s.curr), chunkEnd(s.curr + s.sz), maxDepth(maxDepth), finished(true) {}
+
+    // tokenize chunks handed to Feed, followed by Finish
+    explicit SexprTokenizer(int maxDepth = 0) : maxDepth(maxDepth) {}
+
+    // Supply the next chunk of input. The previous chunk must be exhausted,
+    // as signalled by NeedInput.
+    void Feed(StrView s);
+
+    // Signal that there is no more input.
+    void Finish();
+
+    Status Next(SexprToken& tok);
+
+    Status State() const { return status; }
+    SexprError const& LastError() const { return error; }
+    int Depth() const { return balance; }
+
+    // C++14 iteration over tokens up to the next status other than Token
+    class iterator {
+        SexprTokenizer* t = nullptr;
+        SexprToken tok;
+    public:
+        iterator() = default;
+        explicit iterator(SexprTokenizer* t) : t(t) { ++*this; }
+        SexprToken const& operator*() const { return tok; }
+        SexprToken const* operator->() const { return &tok; }
+        iterator& operator++() {
+            if (t && t->Next(tok) != Token)
+                t = nullptr;
+            return *this;
+        }
+        bool operator==(iterator const& rhs) const { return t == rhs.t; }
+        bool operator!=(iterator const& rhs) const { return t != rhs.t; }
+    };
+    iterator begin() { return iterator(this); }
+    iterator end() { return iterator(); }
+
+private:
+    enum Carry { CarryNone, CarryAtom, CarryString, CarryComment };
+
+    Status Fail(tsSexprErrorKind_t kind, size_t offset);
+    Status Element(SexprToken& tok, char const* at, char const* next);
+
+    char const* chunk = nullptr;    // the current chunk
+    char const* p = nullptr;        // scan position within it
+    char const* chunkEnd = nullptr;
+    size_t chunkOffset = 0;         // offset of the chunk within the whole input
+    std::string carry;              // an element split across chunks
+    Carry carrying = CarryNone;
+    size_t carryOffset = 0;
+    bool carryReady = false;        // carry holds a complete element
+    int balance = 0;
+    int maxDepth;
+    bool finished = false;
+    Status status = NeedInput;
+    SexprError error;
+};
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define LABTEXT_COROUTINES
+#endif
+#endif
+
+#ifdef LABTEXT_COROUTINES
+}} // lab::Text
+#include <coroutine>
+#include <exception>
+namespace lab { namespace Text {
+
+// A C++20 generator over a tokenizer, for consumers written as coroutines.
+// It ends at the first status other than Token, leaving the tokenizer to be
+// fed and resumed with a new generator. The coroutine frame is allocated
+// once per generator; tokens cost no allocations.
+//
+//     for (SexprToken const& tok : SexprTokens(tokenizer)) ...
+class SexprTokenGenerator {
+public:
+    struct promise_type {
+        SexprToken const* current = nullptr;
+        SexprTokenGenerator get_return_object() {
+            return SexprTokenGenerator(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(SexprToken const& tok) noexcept {
+            current = &tok;
+            return {};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() { std::terminate(); }
+    };
+    using handle = std::coroutine_handle<promise_type>;
+
+    class iterator {
+        handle h;
+    public:
+        explicit iterator(handle h = nullptr) : h(h) {}
+        SexprToken const& operator*() const { return *h.promise().current; }
+        SexprToken const* operator->() const { return h.promise().current; }
+        iterator& operator++() {
+            h.resume();
+            if (h.done())
+                h = nullptr;
+            return *this;
+        }
+        bool operator==(iterator const& rhs) const { return h == rhs.h; }
+        bool operator!=(iterator const& rhs) const { return h != rhs.h; }
+    };
+
+    explicit SexprTokenGenerator(handle h) : h(h) {}
+    SexprTokenGenerator(SexprTokenGenerator&& rhs) noexcept : h(rhs.h) { rhs.h = nullptr; }
+    SexprTokenGenerator(SexprTokenGenerator const&) = delete;
+    SexprTokenGenerator& operator=(SexprTokenGenerator const&) = delete;
+    ~SexprTokenGenerator() {
+        if (h)
+            h.destroy();
+    }
+
+    iterator begin() {
+        h.resume();
+        return h.done() ? iterator() : iterator(h);
+    }
+    iterator end() { return iterator(); }
+
+private:
+    handle h;
+};
+
+inline SexprTokenGenerator SexprTokens(SexprTokenizer& tokenizer)
+{
+    SexprToken tok;
+    while (tokenizer.Next(tok) == SexprTokenizer::Token)
+        co_yield tok;
+}
+#endif // LABTEXT_COROUTINES
+
+
+
+}} // lab::Text
+
+#endif // cplusplus
+
+
+#endif // LABTEXT_H
+
+#if defined(LABTEXT_ODR) && !defined(LABTEXT_ODR_IMPLEMENTED)
+#define LABTEXT_ODR_IMPLEMENTED
+
+//------------------------------------------------------------------------------
+// IMPLEMENTATION
+//------------------------------------------------------------------------------
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// define LABTEXT_ASSERT to route internal consistency checks elsewhere
+#ifdef LABTEXT_ASSERT
+#define Assert LABTEXT_ASSERT
+#else
+#include <assert.h>
+#define Assert assert
+#endif
+
+//----------------------------------------------------------------------------
+// SIMD support. Kernels are written for SSE2 and AArch64 NEON, and every
+// caller keeps a scalar path for other targets, for the tail of a buffer,
+// and for builds defining LABTEXT_NO_SIMD.
+//----------------------------------------------------------------------------
+
+#if !defined(LABTEXT_NO_SIMD)
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define LABTEXT_SSE2 1
+        #include <emmintrin.h>
+    #elif (defined(__aarch64__) || defined(_M_ARM64)) && \
+          (!defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+        #define LABTEXT_NEON 1
+        #include <arm_neon.h>
+    #endif
+    #if defined(LABTEXT_SSE2) || defined(LABTEXT_NEON)
+        #define LABTEXT_SIMD 1
+    #endif
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    #include <intrin.h>
+    #define TS_NOINLINE __declspec(noinline)
+#else
+    #define TS_NOINLINE __attribute__((noinline))
+#endif
+
+// index of the lowest set bit; x must not be zero
+static inline uint32_t tsCtz32(uint32_t x)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (uint32_t) i;
+#else
+    return (uint32_t) __builtin_ctz(x);
+#endif
+}
+
+// the number of set bits
+static inline uint32_t tsPopCount32(uint32_t x)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    x = x - ((x >> 1) & 0x55555555u);
+    x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+    return (((x + (x >> 4)) & 0x0f0f0f0fu) * 0x01010101u) >> 24;
+#else
+    return (uint32_t) __builtin_popcount(x);
+#endif
+}
+
+static inline char tsToLowerAscii(char c)
+{
+    return c >= 'A' && c <= 'Z' ? (char)(c + 32) : c;
+}
+
+// the eight bytes of w with A-Z folded to a-z, in parallel
+static inline uint64_t tsToLowerAscii8(uint64_t w)
+{
+    const uint64_t ones = 0x0101010101010101ull;
+    uint64_t low = w & (0x7f * ones);
+    uint64_t geA = low + (0x80 - 'A') * ones;       // bit 7 set where low >= 'A'
+    uint64_t gtZ = low + (0x80 - 'Z' - 1) * ones;   // bit 7 set where low > 'Z'
+    uint64_t upper = geA & ~gtZ & ~w & (0x80 * ones);
+    return w | (upper >> 2);
+}
+
+#ifdef LABTEXT_SIMD
+
+#ifdef LABTEXT_NEON
+static inline uint32_t tsNeonMovemask(uint8x16_t v)
+{
+    static const uint8_t weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t m = vandq_u8(v, vld1q_u8(weights));
+    return (uint32_t) vaddv_u8(vget_low_u8(m)) | ((uint32_t) vaddv_u8(vget_high_u8(m)) << 8);
+}
+#endif
+
+// bit i is set if p[i] is within [lo, hi]; both bounds must be ASCII
+static inline uint32_t tsRangeMask16(char const* p, char lo, char hi)
+{
+#ifdef LABTEXT_SSE2
+    __m128i v = _mm_loadu_si128((__m128i const*) p);
+    __m128i ge = _mm_cmpgt_epi8(v, _mm_set1_epi8((char)(lo - 1)));
+    __m128i le = _mm_cmplt_epi8(v, _mm_set1_epi8((char)(hi + 1)));
+    return (uint32_t) _mm_movemask_epi8(_mm_and_si128(ge, le));
+#else
+    uint8x16_t v = vld1q_u8((uint8_t const*) p);
+    return tsNeonMovemask(vcleq_u8(vsubq_u8(v, vdupq_n_u8((uint8_t) lo)), vdupq_n_u8((uint8_t)(hi - lo))));
+#endif
+}
+
+// bit i is set if p[i] is white space, or a comma when commas is set
+static inline uint32_t tsSeparatorMask16(char const* p, bool commas)
+{
+#ifdef LABTEXT_SSE2
+    __m128i v = _mm_loadu_si128((__m128i const*) p);
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+    if (commas)
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(',')));
+    return (uint32_t) _mm_movemask_epi8(m);
+#else
+    uint8x16_t v = vld1q_u8((uint8_t const*) p);
+    uint8x16_t m = vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')), vceqq_u8(v, vdupq_n_u8('\n')));
+    m = vorrq_u8(m, vorrq_u8(vceqq_u8(v, vdupq_n_u8('\t')), vceqq_u8(v, vdupq_n_u8('\r'))));
+    if (commas)
+        m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8(',')));
+    return tsNeonMovemask(m);
+#endif
+}
+
+// bit i is set if p[i] is a or b
+static inline uint32_t tsEitherMask16(char const* p, char a, char b)
+{
+#ifdef LABTEXT_SSE2
+    __m128i v = _mm_loadu_si128((__m128i const*) p);
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(a)), _mm_cmpeq_epi8(v, _mm_set1_epi8(b)));
+    return (uint32_t) _mm_movemask_epi8(m);
+#else
+    uint8x16_t v = vld1q_u8((uint8_t const*) p);
+    return tsNeonMovemask(vorrq_u8(vceqq_u8(v, vdupq_n_u8((uint8_t) a)), vceqq_u8(v, vdupq_n_u8((uint8_t) b))));
+#endif
+}
+
+// bit i is set if p[i] is a, b or c
+static inline uint32_t tsAnyOf3Mask16(char const* p, char a, char b, char c)
+{
+#ifdef LABTEXT_SSE2
+    __m128i v = _mm_loadu_si128((__m128i const*) p);
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(a)), _mm_cmpeq_epi8(v, _mm_set1_epi8(b)));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+    return (uint32_t) _mm_movemask_epi8(m);
+#else
+    uint8x16_t v = vld1q_u8((uint8_t const*) p);
+    uint8x16_t m = vorrq_u8(vceqq_u8(v, vdupq_n_u8((uint8_t) a)), vceqq_u8(v, vdupq_n_u8((uint8_t) b)));
+    return tsNeonMovemask(vorrq_u8(m, vceqq_u8(v, vdupq_n_u8((uint8_t) c))));
+#endif
+}
+
+// bit i is set if p[i] and q[i] are equal once A-Z are folded to a-z
+static inline uint32_t tsEqualNoCaseMask16(char const* p, char const* q)
+{
+#ifdef LABTEXT_SSE2
+    __m128i a = _mm_loadu_si128((__m128i const*) p);
+    __m128i b = _mm_loadu_si128((__m128i const*) q);
+    __m128i A = _mm_set1_epi8('A' - 1), Z = _mm_set1_epi8('Z' + 1), bit = _mm_set1_epi8(0x20);
+    // bytes of 0x80 and up are negative, so never within A-Z
+    a = _mm_or_si128(a, _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi8(a, A), _mm_cmplt_epi8(a, Z)), bit));
+    b = _mm_or_si128(b, _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi8(b, A), _mm_cmplt_epi8(b, Z)), bit));
+    return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+#else
+    uint8x16_t a = vld1q_u8((uint8_t const*) p);
+    uint8x16_t b = vld1q_u8((uint8_t const*) q);
+    uint8x16_t A = vdupq_n_u8('A'), range = vdupq_n_u8('Z' - 'A'), bit = vdupq_n_u8(0x20);
+    a = vorrq_u8(a, vandq_u8(vcleq_u8(vsubq_u8(a, A), range), bit));
+    b = vorrq_u8(b, vandq_u8(vcleq_u8(vsubq_u8(b, A), range), bit));
+    return tsNeonMovemask(vceqq_u8(a, b));
+#endif
+}
+
+// Converts the n (1 to 8) ASCII digits at the bottom of val, first digit in
+// the lowest byte, in a handful of multiplies.
+static inline uint32_t tsParseDigitsSwarValue(uint64_t val, uint32_t n)
+{
+    val <<= 8 * (8 - n);    // the digits move to the top, zero bytes read as leading zeros
+    val = (val & 0x0F0F0F0F0F0F0F0FULL) * 2561 >> 8;
+    val = (val & 0x00FF00FF00FF00FFULL) * 6553601 >> 16;
+    return (uint32_t)((val & 0x0000FFFF0000FFFFULL) * 42949672960001ULL >> 32);
+}
+
+// Converts the n (1 to 8) ASCII digits at p. Eight bytes must be readable at p.
+static inline uint32_t tsParseDigitsSwar(char const* p, uint32_t n)
+{
+    uint64_t val;
+    memcpy(&val, p, 8);
+    return tsParseDigitsSwarValue(val, n);
+}
+
+#endif // LABTEXT_SIMD
+
+
+/*
+* The two functions, tsConvertUtf16ToUtf8 and tsConvertUtf8ToUtf16 are
+* originally from the Effekseer library, and bear the following license:
+
+The MIT License (MIT)
+
+Copyright (c) 2011 Effekseer Project
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/**
+    @brief    Convert UTF16 into UTF8
+    @param    dst    a pointer to destination buffer
+    @param    dst_size    a length of destination buffer
+    @param    src            a source buffer
+    @return    length except 0
+*/
+int32_t tsConvertUtf16ToUtf8(char* dst, int32_t dst_size, const uint16_t* src)
+{
+    int32_t cnt = 0;
+    const uint16_t* wp = src;
+    char* cp = dst;
+
+    if (dst_size == 0)
+        return 0;
+
+    dst_size -= 3;
+
+    for (cnt = 0; cnt < dst_size;)
+    {
+        uint16_t wc = *wp++;
+        if (wc == 0)
+        {
+            break;
+        }
+        if ((wc & ~0x7f) == 0)
+        {
             if (cp)
                 *cp++ = wc & 0x7f;
             cnt += 1;
@@ -650,6 +2410,321 @@ int32_t tsConvertUtf8ToUtf16(uint16_t* dst, int32_t dst_size, const char* src)
     return i;
 }
 
+//----------------------------------------------------------------------------
+// Code points and identifier classes
+
+// As tsDecodeUtf8, but a malformed sequence returns UINT32_MAX.
+static inline uint32_t tsDecodeUtf8Strict(char const* p, char const* end, char const** next)
+{
+    unsigned char c = (unsigned char) *p;
+    *next = p + 1;
+    if (c < 0x80)
+        return c;
+    int n = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc2 ? 1 : 0;
+    if (n == 0 || c > 0xf4 || end - p <= n)
+        return UINT32_MAX;
+    uint32_t cp = c & (0x3f >> n);
+    for (int i = 1; i <= n; ++i) {
+        unsigned char b = (unsigned char) p[i];
+        if ((b & 0xc0) != 0x80)
+            return UINT32_MAX;
+        cp = (cp << 6) | (b & 0x3f);
+    }
+    // overlong forms, surrogates, and beyond U+10FFFF
+    if ((n == 2 && cp < 0x800) || (n == 3 && (cp < 0x10000 || cp > 0x10ffff)) ||
+        (cp >= 0xd800 && cp <= 0xdfff))
+        return UINT32_MAX;
+    *next = p + n + 1;
+    return cp;
+}
+
+uint32_t tsDecodeUtf8(char const* p, char const* end, char const** next)
+{
+    uint32_t cp = tsDecodeUtf8Strict(p, end, next);
+    return cp == UINT32_MAX ? 0xfffd : cp;
+}
+
+// Sorted ranges of the code points from U+0080 up, one word each, holding
+// the first code point in the upper 21 bits and the length less one in the
+// lower 11. Longer ranges are split. Generated from Python's unicodedata,
+// Unicode 14, with str.isidentifier.
+static const uint32_t tsXidStartRanges[702] = {
+    0x00055000, 0x0005a800, 0x0005d000, 0x00060016, 0x0006c01e, 0x0007c1c9, 0x0016300b, 0x00170004,
+    0x00176000, 0x00177000, 0x001b8004, 0x001bb001, 0x001bd802, 0x001bf800, 0x001c3000, 0x001c4002,
+    0x001c6000, 0x001c7013, 0x001d1852, 0x001fb88a, 0x002450a5, 0x00298825, 0x002ac800, 0x002b0028,
+    0x002e801a, 0x002f7803, 0x0031002a, 0x00337001, 0x00338862, 0x0036a800, 0x00372801, 0x00377001,
+    0x0037d002, 0x0037f800, 0x00388000, 0x0038901d, 0x003a6858, 0x003d8800, 0x003e5020, 0x003fa001,
+    0x003fd000, 0x00400015, 0x0040d000, 0x00412000, 0x00414000, 0x00420018, 0x0043000a, 0x00438017,
+    0x00444805, 0x00450029, 0x00482035, 0x0049e800, 0x004a8000, 0x004ac009, 0x004b880f, 0x004c2807,
+    0x004c7801, 0x004c9815, 0x004d5006, 0x004d9000, 0x004db003, 0x004de800, 0x004e7000, 0x004ee001,
+    0x004ef802, 0x004f8001, 0x004fe000, 0x00502805, 0x00507801, 0x00509815, 0x00515006, 0x00519001,
+    0x0051a801, 0x0051c001, 0x0052c803, 0x0052f000, 0x00539002, 0x00542808, 0x00547802, 0x00549815,
+    0x00555006, 0x00559001, 0x0055a804, 0x0055e800, 0x00568000, 0x00570001, 0x0057c800, 0x00582807,
+    0x00587801, 0x00589815, 0x00595006, 0x00599001, 0x0059a804, 0x0059e800, 0x005ae001, 0x005af802,
+    0x005b8800, 0x005c1800, 0x005c2805, 0x005c7002, 0x005c9003, 0x005cc801, 0x005ce000, 0x005cf001,
+    0x005d1801, 0x005d4002, 0x005d700b, 0x005e8000, 0x00602807, 0x00607002, 0x00609016, 0x0061500f,
+    0x0061e800, 0x0062c002, 0x0062e800, 0x00630001, 0x00640000, 0x00642807, 0x00647002, 0x00649016,
+    0x00655009, 0x0065a804, 0x0065e800, 0x0066e801, 0x00670001, 0x00678801, 0x00682008, 0x00687002,
+    0x00689028, 0x0069e800, 0x006a7000, 0x006aa002, 0x006af802, 0x006bd005, 0x006c2811, 0x006cd017,
+    0x006d9808, 0x006de800, 0x006e0006, 0x0070082f, 0x00719000, 0x00720006, 0x00740801, 0x00742000,
+    0x00743004, 0x00746017, 0x00752800, 0x00753809, 0x00759000, 0x0075e800, 0x00760004, 0x00763000,
+    0x0076e003, 0x00780000, 0x007a0007, 0x007a4823, 0x007c4004, 0x0080002a, 0x0081f800, 0x00828005,
+    0x0082d003, 0x00830800, 0x00832801, 0x00837002, 0x0083a80c, 0x00847000, 0x00850025, 0x00863800,
+    0x00866800, 0x0086802a, 0x0087e14c, 0x00925003, 0x00928006, 0x0092c000, 0x0092d003, 0x00930028,
+    0x00945003, 0x00948020, 0x00959003, 0x0095c006, 0x00960000, 0x00961003, 0x0096400e, 0x0096c038,
+    0x00989003, 0x0098c042, 0x009c000f, 0x009d0055, 0x009fc005, 0x00a00a6b, 0x00b37810, 0x00b40819,
+    0x00b5004a, 0x00b7700a, 0x00b80011, 0x00b8f812, 0x00ba0011, 0x00bb000c, 0x00bb7002, 0x00bc0033,
+    0x00beb800, 0x00bee000, 0x00c10058, 0x00c40028, 0x00c55000, 0x00c58045, 0x00c8001e, 0x00ca801d,
+    0x00cb8004, 0x00cc002b, 0x00cd8019, 0x00d00016, 0x00d10034, 0x00d53800, 0x00d8282e, 0x00da2807,
+    0x00dc181d, 0x00dd7001, 0x00ddd02b, 0x00e00023, 0x00e26802, 0x00e2d023, 0x00e40008, 0x00e4802a,
+    0x00e5e802, 0x00e74803, 0x00e77005, 0x00e7a801, 0x00e7d000, 0x00e800bf, 0x00f00115, 0x00f8c005,
+    0x00f90025, 0x00fa4005, 0x00fa8007, 0x00fac800, 0x00fad800, 0x00fae800, 0x00faf81e, 0x00fc0034,
+    0x00fdb006, 0x00fdf000, 0x00fe1002, 0x00fe3006, 0x00fe8003, 0x00feb005, 0x00ff000c, 0x00ff9002,
+    0x00ffb006, 0x01038800, 0x0103f800, 0x0104800c, 0x01081000, 0x01083800, 0x01085009, 0x0108a800,
+    0x0108c005, 0x01092000, 0x01093000, 0x01094000, 0x0109500f, 0x0109e003, 0x010a2804, 0x010a7000,
+    0x010b0028, 0x016000e4, 0x01675803, 0x01679001, 0x01680025, 0x01693800, 0x01696800, 0x01698037,
+    0x016b7800, 0x016c0016, 0x016d0006, 0x016d4006, 0x016d8006, 0x016dc006, 0x016e0006, 0x016e4006,
+    0x016e8006, 0x016ec006, 0x01802802, 0x01810808, 0x01818804, 0x0181c004, 0x01820855, 0x0184e802,
+    0x01850859, 0x0187e003, 0x0188282a, 0x0189885d, 0x018d001f, 0x018f800f, 0x01a007ff, 0x01e007ff,
+    0x022007ff, 0x026001bf, 0x027007ff, 0x02b007ff, 0x02f007ff, 0x033007ff, 0x037007ff, 0x03b007ff,
+    0x03f007ff, 0x043007ff, 0x047007ff, 0x04b007ff, 0x04f0068c, 0x0526802d, 0x0528010c, 0x0530800f,
+    0x05315001, 0x0532002e, 0x0533f81e, 0x0535004f, 0x0538b808, 0x05391066, 0x053c583f, 0x053e8001,
+    0x053e9800, 0x053ea804, 0x053f900f, 0x05401802, 0x05403803, 0x05406016, 0x05420033, 0x05441031,
+    0x05479005, 0x0547d800, 0x0547e801, 0x0548501b, 0x05498016, 0x054b001c, 0x054c202e, 0x054e7800,
+    0x054f0004, 0x054f3009, 0x054fd004, 0x05500028, 0x05520002, 0x05522007, 0x05530016, 0x0553d000,
+    0x0553f031, 0x05558800, 0x0555a801, 0x0555c804, 0x05560000, 0x05561000, 0x0556d802, 0x0557000a,
+    0x05579002, 0x05580805, 0x05584805, 0x05588805, 0x05590006, 0x05594006, 0x0559802a, 0x055ae00d,
+    0x055b8072, 0x056007ff, 0x05a007ff, 0x05e007ff, 0x062007ff, 0x066007ff, 0x06a003a3, 0x06bd8016,
+    0x06be5830, 0x07c8016d, 0x07d38069, 0x07d80006, 0x07d89804, 0x07d8e800, 0x07d8f809, 0x07d9500c,
+    0x07d9c004, 0x07d9f000, 0x07da0001, 0x07da1801, 0x07da306b, 0x07de988a, 0x07e320d9, 0x07ea803f,
+    0x07ec9035, 0x07ef8009, 0x07f38800, 0x07f39800, 0x07f3b800, 0x07f3c800, 0x07f3d800, 0x07f3e800,
+    0x07f3f87d, 0x07f90819, 0x07fa0819, 0x07fb3037, 0x07fd001e, 0x07fe1005, 0x07fe5005, 0x07fe9005,
+    0x07fed002, 0x0800000b, 0x08006819, 0x08014012, 0x0801e001, 0x0801f80e, 0x0802800d, 0x0804007a,
+    0x080a0034, 0x0814001c, 0x08150030, 0x0818001f, 0x0819681d, 0x081a8025, 0x081c001d, 0x081d0023,
+    0x081e4007, 0x081e8804, 0x0820009d, 0x08258023, 0x0826c023, 0x08280027, 0x08298033, 0x082b800a,
+    0x082be00e, 0x082c6006, 0x082ca001, 0x082cb80a, 0x082d180e, 0x082d9806, 0x082dd801, 0x08300136,
+    0x083a0015, 0x083b0007, 0x083c0005, 0x083c3829, 0x083d9008, 0x08400005, 0x08404000, 0x0840502b,
+    0x0841b801, 0x0841e000, 0x0841f816, 0x08430016, 0x0844001e, 0x08470012, 0x0847a001, 0x08480015,
+    0x08490019, 0x084c0037, 0x084df001, 0x08500000, 0x08508003, 0x0850a802, 0x0850c81c, 0x0853001c,
+    0x0854001c, 0x08560007, 0x0856481b, 0x08580035, 0x085a0015, 0x085b0012, 0x085c0011, 0x08600048,
+    0x08640032, 0x08660032, 0x08680023, 0x08740029, 0x08758001, 0x0878001c, 0x08793800, 0x08798015,
+    0x087b8011, 0x087d8014, 0x087f0016, 0x08801834, 0x08838801, 0x0883a800, 0x0884182c, 0x08868018,
+    0x08881823, 0x088a2000, 0x088a3800, 0x088a8022, 0x088bb000, 0x088c182f, 0x088e0803, 0x088ed000,
+    0x088ee000, 0x08900011, 0x08909818, 0x08940006, 0x08944000, 0x08945003, 0x0894780e, 0x0894f809,
+    0x0895802e, 0x08982807, 0x08987801, 0x08989815, 0x08995006, 0x08999001, 0x0899a804, 0x0899e800,
+    0x089a8000, 0x089ae804, 0x08a00034, 0x08a23803, 0x08a2f802, 0x08a4002f, 0x08a62001, 0x08a63800,
+    0x08ac002e, 0x08aec003, 0x08b0002f, 0x08b22000, 0x08b4002a, 0x08b5c000, 0x08b8001a, 0x08ba0006,
+    0x08c0002b, 0x08c5003f, 0x08c7f807, 0x08c84800, 0x08c86007, 0x08c8a801, 0x08c8c017, 0x08c9f800,
+    0x08ca0800, 0x08cd0007, 0x08cd5026, 0x08cf0800, 0x08cf1800, 0x08d00000, 0x08d05827, 0x08d1d000,
+    0x08d28000, 0x08d2e02d, 0x08d4e800, 0x08d58048, 0x08e00008, 0x08e05024, 0x08e20000, 0x08e3901d,
+    0x08e80006, 0x08e84001, 0x08e85825, 0x08ea3000, 0x08eb0005, 0x08eb3801, 0x08eb501f, 0x08ecc000,
+    0x08f70012, 0x08fd8000, 0x09000399, 0x0920006e, 0x092400c3, 0x097c8060, 0x0980042e, 0x0a200246,
+    0x0b400238, 0x0b52001e, 0x0b53804e, 0x0b56801d, 0x0b58002f, 0x0b5a0003, 0x0b5b1814, 0x0b5be812,
+    0x0b72003f, 0x0b78004a, 0x0b7a8000, 0x0b7c980c, 0x0b7f0001, 0x0b7f1800, 0x0b8007ff, 0x0bc007ff,
+    0x0c0007f7, 0x0c4004d5, 0x0c680008, 0x0d7f8003, 0x0d7fa806, 0x0d7fe801, 0x0d800122, 0x0d8a8002,
+    0x0d8b2003, 0x0d8b818b, 0x0de0006a, 0x0de3800c, 0x0de40008, 0x0de48009, 0x0ea00054, 0x0ea2b046,
+    0x0ea4f001, 0x0ea51000, 0x0ea52801, 0x0ea54803, 0x0ea5700b, 0x0ea5d800, 0x0ea5e806, 0x0ea62840,
+    0x0ea83803, 0x0ea86807, 0x0ea8b006, 0x0ea8f01b, 0x0ea9d803, 0x0eaa0004, 0x0eaa3000, 0x0eaa5006,
+    0x0eaa9153, 0x0eb54018, 0x0eb61018, 0x0eb6e01e, 0x0eb7e018, 0x0eb8b01e, 0x0eb9b018, 0x0eba801e,
+    0x0ebb8018, 0x0ebc501e, 0x0ebd5018, 0x0ebe2007, 0x0ef8001e, 0x0f08002c, 0x0f09b806, 0x0f0a7000,
+    0x0f14801d, 0x0f16002b, 0x0f3f0006, 0x0f3f4003, 0x0f3f6801, 0x0f3f800e, 0x0f4000c4, 0x0f480043,
+    0x0f4a5800, 0x0f700003, 0x0f70281a, 0x0f710801, 0x0f712000, 0x0f713800, 0x0f714809, 0x0f71a003,
+    0x0f71c800, 0x0f71d800, 0x0f721000, 0x0f723800, 0x0f724800, 0x0f725800, 0x0f726802, 0x0f728801,
+    0x0f72a000, 0x0f72b800, 0x0f72c800, 0x0f72d800, 0x0f72e800, 0x0f72f800, 0x0f730801, 0x0f732000,
+    0x0f733803, 0x0f736006, 0x0f73a003, 0x0f73c803, 0x0f73f000, 0x0f740009, 0x0f745810, 0x0f750802,
+    0x0f752804, 0x0f755810, 0x100007ff, 0x104007ff, 0x108007ff, 0x10c007ff, 0x110007ff, 0x114007ff,
+    0x118007ff, 0x11c007ff, 0x120007ff, 0x124007ff, 0x128007ff, 0x12c007ff, 0x130007ff, 0x134007ff,
+    0x138007ff, 0x13c007ff, 0x140007ff, 0x144007ff, 0x148007ff, 0x14c007ff, 0x150006df, 0x153807ff,
+    0x157807ff, 0x15b80038, 0x15ba00dd, 0x15c107ff, 0x160107ff, 0x16410681, 0x167587ff, 0x16b587ff,
+    0x16f587ff, 0x17358530, 0x17c0021d, 0x180007ff, 0x184007ff, 0x1880034a,
+};
+
+static const uint32_t tsXidContinueRanges[808] = {
+    0x00055000, 0x0005a800, 0x0005b800, 0x0005d000, 0x00060016, 0x0006c01e, 0x0007c1c9, 0x0016300b,
+    0x00170004, 0x00176000, 0x00177000, 0x00180074, 0x001bb001, 0x001bd802, 0x001bf800, 0x001c3004,
+    0x001c6000, 0x001c7013, 0x001d1852, 0x001fb88a, 0x00241804, 0x002450a5, 0x00298825, 0x002ac800,
+    0x002b0028, 0x002c882c, 0x002df800, 0x002e0801, 0x002e2001, 0x002e3800, 0x002e801a, 0x002f7803,
+    0x0030800a, 0x00310049, 0x00337065, 0x0036a807, 0x0036f809, 0x00375012, 0x0037f800, 0x0038803a,
+    0x003a6864, 0x003e0035, 0x003fd000, 0x003fe800, 0x0040002d, 0x0042001b, 0x0043000a, 0x00438017,
+    0x00444805, 0x0044c049, 0x00471880, 0x004b3009, 0x004b8812, 0x004c2807, 0x004c7801, 0x004c9815,
+    0x004d5006, 0x004d9000, 0x004db003, 0x004de008, 0x004e3801, 0x004e5803, 0x004eb800, 0x004ee001,
+    0x004ef804, 0x004f300b, 0x004fe000, 0x004ff000, 0x00500802, 0x00502805, 0x00507801, 0x00509815,
+    0x00515006, 0x00519001, 0x0051a801, 0x0051c001, 0x0051e000, 0x0051f004, 0x00523801, 0x00525802,
+    0x00528800, 0x0052c803, 0x0052f000, 0x0053300f, 0x00540802, 0x00542808, 0x00547802, 0x00549815,
+    0x00555006, 0x00559001, 0x0055a804, 0x0055e009, 0x00563802, 0x00565802, 0x00568000, 0x00570003,
+    0x00573009, 0x0057c806, 0x00580802, 0x00582807, 0x00587801, 0x00589815, 0x00595006, 0x00599001,
+    0x0059a804, 0x0059e008, 0x005a3801, 0x005a5802, 0x005aa802, 0x005ae001, 0x005af804, 0x005b3009,
+    0x005b8800, 0x005c1001, 0x005c2805, 0x005c7002, 0x005c9003, 0x005cc801, 0x005ce000, 0x005cf001,
+    0x005d1801, 0x005d4002, 0x005d700b, 0x005df004, 0x005e3002, 0x005e5003, 0x005e8000, 0x005eb800,
+    0x005f3009, 0x0060000c, 0x00607002, 0x00609016, 0x0061500f, 0x0061e008, 0x00623002, 0x00625003,
+    0x0062a801, 0x0062c002, 0x0062e800, 0x00630003, 0x00633009, 0x00640003, 0x00642807, 0x00647002,
+    0x00649016, 0x00655009, 0x0065a804, 0x0065e008, 0x00663002, 0x00665003, 0x0066a801, 0x0066e801,
+    0x00670003, 0x00673009, 0x00678801, 0x0068000c, 0x00687002, 0x00689032, 0x006a3002, 0x006a5004,
+    0x006aa003, 0x006af804, 0x006b3009, 0x006bd005, 0x006c0802, 0x006c2811, 0x006cd017, 0x006d9808,
+    0x006de800, 0x006e0006, 0x006e5000, 0x006e7805, 0x006eb000, 0x006ec007, 0x006f3009, 0x006f9001,
+    0x00700839, 0x0072000e, 0x00728009, 0x00740801, 0x00742000, 0x00743004, 0x00746017, 0x00752800,
+    0x00753816, 0x00760004, 0x00763000, 0x00764005, 0x00768009, 0x0076e003, 0x00780000, 0x0078c001,
+    0x00790009, 0x0079a800, 0x0079b800, 0x0079c800, 0x0079f009, 0x007a4823, 0x007b8813, 0x007c3011,
+    0x007cc823, 0x007e3000, 0x00800049, 0x0082804d, 0x00850025, 0x00863800, 0x00866800, 0x0086802a,
+    0x0087e14c, 0x00925003, 0x00928006, 0x0092c000, 0x0092d003, 0x00930028, 0x00945003, 0x00948020,
+    0x00959003, 0x0095c006, 0x00960000, 0x00961003, 0x0096400e, 0x0096c038, 0x00989003, 0x0098c042,
+    0x009ae802, 0x009b4808, 0x009c000f, 0x009d0055, 0x009fc005, 0x00a00a6b, 0x00b37810, 0x00b40819,
+    0x00b5004a, 0x00b7700a, 0x00b80015, 0x00b8f815, 0x00ba0013, 0x00bb000c, 0x00bb7002, 0x00bb9001,
+    0x00bc0053, 0x00beb800, 0x00bee001, 0x00bf0009, 0x00c05802, 0x00c0780a, 0x00c10058, 0x00c4002a,
+    0x00c58045, 0x00c8001e, 0x00c9000b, 0x00c9800b, 0x00ca3027, 0x00cb8004, 0x00cc002b, 0x00cd8019,
+    0x00ce800a, 0x00d0001b, 0x00d1003e, 0x00d3001c, 0x00d3f80a, 0x00d48009, 0x00d53800, 0x00d5800d,
+    0x00d5f80f, 0x00d8004c, 0x00da8009, 0x00db5808, 0x00dc0073, 0x00e00037, 0x00e20009, 0x00e26830,
+    0x00e40008, 0x00e4802a, 0x00e5e802, 0x00e68002, 0x00e6a026, 0x00e80215, 0x00f8c005, 0x00f90025,
+    0x00fa4005, 0x00fa8007, 0x00fac800, 0x00fad800, 0x00fae800, 0x00faf81e, 0x00fc0034, 0x00fdb006,
+    0x00fdf000, 0x00fe1002, 0x00fe3006, 0x00fe8003, 0x00feb005, 0x00ff000c, 0x00ff9002, 0x00ffb006,
+    0x0101f801, 0x0102a000, 0x01038800, 0x0103f800, 0x0104800c, 0x0106800c, 0x01070800, 0x0107280b,
+    0x01081000, 0x01083800, 0x01085009, 0x0108a800, 0x0108c005, 0x01092000, 0x01093000, 0x01094000,
+    0x0109500f, 0x0109e003, 0x010a2804, 0x010a7000, 0x010b0028, 0x016000e4, 0x01675808, 0x01680025,
+    0x01693800, 0x01696800, 0x01698037, 0x016b7800, 0x016bf817, 0x016d0006, 0x016d4006, 0x016d8006,
+    0x016dc006, 0x016e0006, 0x016e4006, 0x016e8006, 0x016ec006, 0x016f001f, 0x01802802, 0x0181080e,
+    0x01818804, 0x0181c004, 0x01820855, 0x0184c801, 0x0184e802, 0x01850859, 0x0187e003, 0x0188282a,
+    0x0189885d, 0x018d001f, 0x018f800f, 0x01a007ff, 0x01e007ff, 0x022007ff, 0x026001bf, 0x027007ff,
+    0x02b007ff, 0x02f007ff, 0x033007ff, 0x037007ff, 0x03b007ff, 0x03f007ff, 0x043007ff, 0x047007ff,
+    0x04b007ff, 0x04f0068c, 0x0526802d, 0x0528010c, 0x0530801b, 0x0532002f, 0x0533a009, 0x0533f872,
+    0x0538b808, 0x05391066, 0x053c583f, 0x053e8001, 0x053e9800, 0x053ea804, 0x053f9035, 0x05416000,
+    0x05420033, 0x05440045, 0x05468009, 0x05470017, 0x0547d800, 0x0547e830, 0x05498023, 0x054b001c,
+    0x054c0040, 0x054e780a, 0x054f001e, 0x05500036, 0x0552000d, 0x05528009, 0x05530016, 0x0553d048,
+    0x0556d802, 0x0557000f, 0x05579004, 0x05580805, 0x05584805, 0x05588805, 0x05590006, 0x05594006,
+    0x0559802a, 0x055ae00d, 0x055b807a, 0x055f6001, 0x055f8009, 0x056007ff, 0x05a007ff, 0x05e007ff,
+    0x062007ff, 0x066007ff, 0x06a003a3, 0x06bd8016, 0x06be5830, 0x07c8016d, 0x07d38069, 0x07d80006,
+    0x07d89804, 0x07d8e80b, 0x07d9500c, 0x07d9c004, 0x07d9f000, 0x07da0001, 0x07da1801, 0x07da306b,
+    0x07de988a, 0x07e320d9, 0x07ea803f, 0x07ec9035, 0x07ef8009, 0x07f0000f, 0x07f1000f, 0x07f19801,
+    0x07f26802, 0x07f38800, 0x07f39800, 0x07f3b800, 0x07f3c800, 0x07f3d800, 0x07f3e800, 0x07f3f87d,
+    0x07f88009, 0x07f90819, 0x07f9f800, 0x07fa0819, 0x07fb3058, 0x07fe1005, 0x07fe5005, 0x07fe9005,
+    0x07fed002, 0x0800000b, 0x08006819, 0x08014012, 0x0801e001, 0x0801f80e, 0x0802800d, 0x0804007a,
+    0x080a0034, 0x080fe800, 0x0814001c, 0x08150030, 0x08170000, 0x0818001f, 0x0819681d, 0x081a802a,
+    0x081c001d, 0x081d0023, 0x081e4007, 0x081e8804, 0x0820009d, 0x08250009, 0x08258023, 0x0826c023,
+    0x08280027, 0x08298033, 0x082b800a, 0x082be00e, 0x082c6006, 0x082ca001, 0x082cb80a, 0x082d180e,
+    0x082d9806, 0x082dd801, 0x08300136, 0x083a0015, 0x083b0007, 0x083c0005, 0x083c3829, 0x083d9008,
+    0x08400005, 0x08404000, 0x0840502b, 0x0841b801, 0x0841e000, 0x0841f816, 0x08430016, 0x0844001e,
+    0x08470012, 0x0847a001, 0x08480015, 0x08490019, 0x084c0037, 0x084df001, 0x08500003, 0x08502801,
+    0x08506007, 0x0850a802, 0x0850c81c, 0x0851c002, 0x0851f800, 0x0853001c, 0x0854001c, 0x08560007,
+    0x0856481d, 0x08580035, 0x085a0015, 0x085b0012, 0x085c0011, 0x08600048, 0x08640032, 0x08660032,
+    0x08680027, 0x08698009, 0x08740029, 0x08755801, 0x08758001, 0x0878001c, 0x08793800, 0x08798020,
+    0x087b8015, 0x087d8014, 0x087f0016, 0x08800046, 0x0883300f, 0x0883f83b, 0x08861000, 0x08868018,
+    0x08878009, 0x08880034, 0x0889b009, 0x088a2003, 0x088a8023, 0x088bb000, 0x088c0044, 0x088e4803,
+    0x088e700c, 0x088ee000, 0x08900011, 0x08909824, 0x0891f000, 0x08940006, 0x08944000, 0x08945003,
+    0x0894780e, 0x0894f809, 0x0895803a, 0x08978009, 0x08980003, 0x08982807, 0x08987801, 0x08989815,
+    0x08995006, 0x08999001, 0x0899a804, 0x0899d809, 0x089a3801, 0x089a5802, 0x089a8000, 0x089ab800,
+    0x089ae806, 0x089b3006, 0x089b8004, 0x08a0004a, 0x08a28009, 0x08a2f003, 0x08a40045, 0x08a63800,
+    0x08a68009, 0x08ac0035, 0x08adc008, 0x08aec005, 0x08b00040, 0x08b22000, 0x08b28009, 0x08b40038,
+    0x08b60009, 0x08b8001a, 0x08b8e80e, 0x08b98009, 0x08ba0006, 0x08c0003a, 0x08c50049, 0x08c7f807,
+    0x08c84800, 0x08c86007, 0x08c8a801, 0x08c8c01d, 0x08c9b801, 0x08c9d808, 0x08ca8009, 0x08cd0007,
+    0x08cd502d, 0x08ced007, 0x08cf1801, 0x08d0003e, 0x08d23800, 0x08d28049, 0x08d4e800, 0x08d58048,
+    0x08e00008, 0x08e0502c, 0x08e1c008, 0x08e28009, 0x08e3901d, 0x08e49015, 0x08e5480d, 0x08e80006,
+    0x08e84001, 0x08e8582b, 0x08e9d000, 0x08e9e001, 0x08e9f808, 0x08ea8009, 0x08eb0005, 0x08eb3801,
+    0x08eb5024, 0x08ec8001, 0x08ec9805, 0x08ed0009, 0x08f70016, 0x08fd8000, 0x09000399, 0x0920006e,
+    0x092400c3, 0x097c8060, 0x0980042e, 0x0a200246, 0x0b400238, 0x0b52001e, 0x0b530009, 0x0b53804e,
+    0x0b560009, 0x0b56801d, 0x0b578004, 0x0b580036, 0x0b5a0003, 0x0b5a8009, 0x0b5b1814, 0x0b5be812,
+    0x0b72003f, 0x0b78004a, 0x0b7a7838, 0x0b7c7810, 0x0b7f0001, 0x0b7f1801, 0x0b7f8001, 0x0b8007ff,
+    0x0bc007ff, 0x0c0007f7, 0x0c4004d5, 0x0c680008, 0x0d7f8003, 0x0d7fa806, 0x0d7fe801, 0x0d800122,
+    0x0d8a8002, 0x0d8b2003, 0x0d8b818b, 0x0de0006a, 0x0de3800c, 0x0de40008, 0x0de48009, 0x0de4e801,
+    0x0e78002d, 0x0e798016, 0x0e8b2804, 0x0e8b6805, 0x0e8bd807, 0x0e8c2806, 0x0e8d5003, 0x0e921002,
+    0x0ea00054, 0x0ea2b046, 0x0ea4f001, 0x0ea51000, 0x0ea52801, 0x0ea54803, 0x0ea5700b, 0x0ea5d800,
+    0x0ea5e806, 0x0ea62840, 0x0ea83803, 0x0ea86807, 0x0ea8b006, 0x0ea8f01b, 0x0ea9d803, 0x0eaa0004,
+    0x0eaa3000, 0x0eaa5006, 0x0eaa9153, 0x0eb54018, 0x0eb61018, 0x0eb6e01e, 0x0eb7e018, 0x0eb8b01e,
+    0x0eb9b018, 0x0eba801e, 0x0ebb8018, 0x0ebc501e, 0x0ebd5018, 0x0ebe2007, 0x0ebe7031, 0x0ed00036,
+    0x0ed1d831, 0x0ed3a800, 0x0ed42000, 0x0ed4d804, 0x0ed5080e, 0x0ef8001e, 0x0f000006, 0x0f004010,
+    0x0f00d806, 0x0f011801, 0x0f013004, 0x0f08002c, 0x0f09800d, 0x0f0a0009, 0x0f0a7000, 0x0f14801e,
+    0x0f160039, 0x0f3f0006, 0x0f3f4003, 0x0f3f6801, 0x0f3f800e, 0x0f4000c4, 0x0f468006, 0x0f48004b,
+    0x0f4a8009, 0x0f700003, 0x0f70281a, 0x0f710801, 0x0f712000, 0x0f713800, 0x0f714809, 0x0f71a003,
+    0x0f71c800, 0x0f71d800, 0x0f721000, 0x0f723800, 0x0f724800, 0x0f725800, 0x0f726802, 0x0f728801,
+    0x0f72a000, 0x0f72b800, 0x0f72c800, 0x0f72d800, 0x0f72e800, 0x0f72f800, 0x0f730801, 0x0f732000,
+    0x0f733803, 0x0f736006, 0x0f73a003, 0x0f73c803, 0x0f73f000, 0x0f740009, 0x0f745810, 0x0f750802,
+    0x0f752804, 0x0f755810, 0x0fdf8009, 0x100007ff, 0x104007ff, 0x108007ff, 0x10c007ff, 0x110007ff,
+    0x114007ff, 0x118007ff, 0x11c007ff, 0x120007ff, 0x124007ff, 0x128007ff, 0x12c007ff, 0x130007ff,
+    0x134007ff, 0x138007ff, 0x13c007ff, 0x140007ff, 0x144007ff, 0x148007ff, 0x14c007ff, 0x150006df,
+    0x153807ff, 0x157807ff, 0x15b80038, 0x15ba00dd, 0x15c107ff, 0x160107ff, 0x16410681, 0x167587ff,
+    0x16b587ff, 0x16f587ff, 0x17358530, 0x17c0021d, 0x180007ff, 0x184007ff, 0x1880034a, 0x700800ef,
+};
+
+// XID_Continue from U+0080 to U+07FF, the two byte sequences, as a bit
+// set, since the Latin, Greek and Cyrillic names are most of the non-ASCII
+// identifiers in practice.
+static const uint32_t tsXidContinue2Byte[60] = {
+    0x00000000, 0x04a00400, 0xff7fffff, 0xff7fffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0x0003ffc3, 0x0000501f, 0xffffffff, 0xffffffff, 0xffffffff, 0xb8dfffff,
+    0xffffd7c0, 0xfffffffb, 0xffffffff, 0xffbfffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xfffffcfb, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xfffeffff, 0x027fffff, 0xffffffff, 0xfffe01ff, 0xbfffffff,
+    0xffff00b6, 0x000787ff, 0x07ff0000, 0xffffffff, 0xffffffff, 0xffffc3ff,
+    0xffffffff, 0xffffffff, 0x9fefffff, 0x9ffffdff, 0xffff0000, 0xffffffff,
+    0xffffe7ff, 0xffffffff, 0xffffffff, 0x0003ffff, 0xffffffff, 0x243fffff,
+};
+
+static _Bool tsInRanges(uint32_t const* ranges, size_t count, uint32_t cp)
+{
+    // the last range starting at or before cp
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if ((ranges[mid] >> 11) <= cp)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo > 0 && cp - (ranges[lo - 1] >> 11) <= (ranges[lo - 1] & 0x7ff);
+}
+
+_Bool tsIsXidStart(uint32_t cp)
+{
+    if (cp < 0x80)
+        return tsIsAlpha((char) cp);
+    return tsInRanges(tsXidStartRanges, sizeof(tsXidStartRanges) / sizeof(uint32_t), cp);
+}
+
+_Bool tsIsXidContinue(uint32_t cp)
+{
+    if (cp < 0x80)
+        return tsIsAlpha((char) cp) || tsIsNumeric((char) cp) || cp == '_';
+    if (cp < 0x800)
+        return (tsXidContinue2Byte[(cp - 0x80) >> 5] >> ((cp - 0x80) & 31)) & 1;
+    if (cp >= 0x4e00 && cp <= 0x9fff)
+        return true;    // CJK Unified Ideographs
+    return tsInRanges(tsXidContinueRanges, sizeof(tsXidContinueRanges) / sizeof(uint32_t), cp);
+}
+
+// The end of the run of ASCII letters, digits, '_' and characters of ext,
+// and XID_Continue code points, from p.
+static char const* tsScanForEndOfUtf8Token(char const* p, char const* end, char const* ext)
+{
+    while (p < end) {
+#ifdef LABTEXT_SIMD
+        for (; end - p >= 16; p += 16) {
+            uint32_t word = tsRangeMask16(p, 'a', 'z') | tsRangeMask16(p, 'A', 'Z') |
+                            tsRangeMask16(p, '0', '9') | tsEitherMask16(p, '_', '_');
+            for (char const* e = ext; e && *e; ++e)
+                word |= tsEitherMask16(p, *e, *e);
+            if (word != 0xffff) {
+                p += tsCtz32(~word);
+                break;
+            }
+        }
+        if (p == end)
+            break;
+#endif
+        unsigned char c = (unsigned char) *p;
+        if (c < 0x80) {
+            if (!tsIsXidContinue(c) && !(ext && c && tsIsIn(ext, (char) c)))
+                break;
+            ++p;
+            continue;
+        }
+        char const* next;
+        if (!tsIsXidContinue(tsDecodeUtf8Strict(p, end, &next)))
+            break;
+        p = next;
+    }
+    return p;
+}
+
 //----------------------------------------------------------------------------
 
 char const* tsScanForQuote(
@@ -667,7 +2742,8 @@ char const* tsScanForQuote(
         ++pCurr;
     }
 
-    return pCurr;
+    // an escape as the final character must not step past the end
+    return pCurr < pEnd ? pCurr : pEnd;
 }
 
 char const* tsScanForWhiteSpace(
@@ -681,17 +2757,94 @@ char const* tsScanForWhiteSpace(
     return pCurr+1;
 }
 
+// Long runs of white space, such as indentation. Kept out of line, so that
+// the short scan inlines into the number and token readers.
+static TS_NOINLINE char const* tsScanForNonWhiteSpaceWide(char const* pCurr, char const* pEnd)
+{
+#ifdef LABTEXT_SIMD
+    for (; pEnd - pCurr >= 16; pCurr += 16) {
+        uint32_t other = tsSeparatorMask16(pCurr, false) ^ 0xffff;
+        if (other)
+            return pCurr + tsCtz32(other);
+    }
+#endif
+    while (pCurr < pEnd && tsIsWhiteSpace(*pCurr))
+        ++pCurr;
+
+    return pCurr;
+}
+
 char const* tsScanForNonWhiteSpace(
    char const* pCurr, char const* pEnd)
 {
     Assert(pCurr && pEnd && pEnd >= pCurr);
 
-    while (pCurr < pEnd && tsIsWhiteSpace(*pCurr))
-        ++pCurr;
+    // most runs are a separator or two between tokens, so the first eight
+    // bytes are tested one at a time, and only longer runs go wide
+    char const* pNarrow = pEnd - pCurr > 8 ? pCurr + 8 : pEnd;
+    for (; pCurr < pNarrow; ++pCurr)
+        if (!tsIsWhiteSpace(*pCurr))
+            return pCurr;
+
+    return tsScanForNonWhiteSpaceWide(pCurr, pEnd);
+}
 
+// the first a or b at or after pCurr, or pEnd
+static char const* tsScanForEither(char const* pCurr, char const* pEnd, char a, char b)
+{
+#ifdef LABTEXT_SIMD
+    for (; pEnd - pCurr >= 16; pCurr += 16) {
+        uint32_t m = tsEitherMask16(pCurr, a, b);
+        if (m)
+            return pCurr + tsCtz32(m);
+    }
+#endif
+    while (pCurr < pEnd && *pCurr != a && *pCurr != b)
+        ++pCurr;
     return pCurr;
 }
 
+// the number of c in [p, end)
+static size_t tsCountCharacter(char const* p, char const* end, char c)
+{
+    size_t count = 0;
+#if defined(LABTEXT_SSE2)
+    // each lane counts in a byte, summed before it can wrap at 255
+    __m128i target = _mm_set1_epi8(c);
+    while (end - p >= 16) {
+        size_t blocks = (size_t)(end - p) / 16;
+        if (blocks > 255)
+            blocks = 255;
+        __m128i lanes = _mm_setzero_si128();
+        for (size_t i = 0; i < blocks; ++i, p += 16)
+            lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const*) p), target));
+        __m128i sums = _mm_sad_epu8(lanes, _mm_setzero_si128());
+        count += (size_t) _mm_cvtsi128_si32(sums) + (size_t) _mm_extract_epi16(sums, 4);
+    }
+#elif defined(LABTEXT_NEON)
+    uint8x16_t target = vdupq_n_u8((uint8_t) c);
+    while (end - p >= 16) {
+        size_t blocks = (size_t)(end - p) / 16;
+        if (blocks > 255)
+            blocks = 255;
+        uint8x16_t lanes = vdupq_n_u8(0);
+        for (size_t i = 0; i < blocks; ++i, p += 16)
+            lanes = vsubq_u8(lanes, vceqq_u8(vld1q_u8((uint8_t const*) p), target));
+        count += vaddlvq_u8(lanes);
+    }
+#endif
+    for (; p < end; ++p)
+        count += *p == c;
+    return count;
+}
+
+size_t tsCountLines(char const* pCurr, char const* pEnd)
+{
+    if (pCurr >= pEnd)
+        return 0;
+    return tsCountCharacter(pCurr, pEnd, '\n') + (pEnd[-1] != '\n');
+}
+
 char const* tsScanBackwardsForWhiteSpace(
     char const* pCurr, char const* pStart)
 {
@@ -720,10 +2873,7 @@ char const* tsScanForCharacter(
 {
     Assert(pCurr && pEnd);
 
-    while (pCurr < pEnd && *pCurr != delim)
-        ++pCurr;
-
-    return pCurr;
+    return tsScanForEither(pCurr, pEnd, delim, delim);
 }
 
 char const* tsScanBackwardsForCharacter(
@@ -741,24 +2891,13 @@ char const* tsScanBackwardsForCharacter(
 char const* tsScanForEndOfLine(
     char const* pCurr, char const* pEnd)
 {
-    while (pCurr < pEnd)
+    pCurr = tsScanForEither(pCurr, pEnd, '\n', '\r');
+    if (pCurr < pEnd)
     {
-        if (*pCurr == '\r')
-        {
-            ++pCurr;
-            if (*pCurr == '\n')
-                ++pCurr;
-            break;
-        }
-        if (*pCurr == '\n')
-        {
+        // a CR LF or LF CR pair ends a single line
+        char c = *pCurr++;
+        if (pCurr < pEnd && *pCurr == (c == '\r' ? '\n' : '\r'))
             ++pCurr;
-            if (*pCurr == '\r')
-                ++pCurr;
-            break;
-        }
-
-        ++pCurr;
     }
     return pCurr;
 }
@@ -766,7 +2905,7 @@ char const* tsScanForEndOfLine(
 char const* tsScanForLastCharacterOnLine(
     char const* pCurr, char const* pEnd)
 {
-    while (pCurr < pEnd)
+    while (pCurr + 1 < pEnd)
     {
         if (pCurr[1] == '\r' || pCurr[1] == '\n' || pCurr[1] == '\0')
         {
@@ -785,49 +2924,64 @@ char const* tsScanForBeginningOfNextLine(
     return (tsScanForNonWhiteSpace(pCurr, pEnd));
 }
 
+// past the */ closing a comment whose body starts at pCurr, or pEnd
+static char const* tsScanPastBlockComment(char const* pCurr, char const* pEnd)
+{
+    while (true)
+    {
+        pCurr = tsScanForEither(pCurr, pEnd, '*', '*');
+        if (pEnd - pCurr < 2)
+            return pEnd;
+        if (pCurr[1] == '/')
+            return pCurr + 2;
+        ++pCurr;
+    }
+}
+
 char const* tsScanPastCPPComments(
     char const* pCurr, char const* pEnd)
 {
-    if (*pCurr == '/')
+    if (pEnd - pCurr >= 2 && *pCurr == '/')
     {
         if (pCurr[1] == '/')
-        {
             pCurr = tsScanForEndOfLine(pCurr, pEnd);
-        }
         else if (pCurr[1] == '*')
-        {
-            pCurr = &pCurr[2];
-            while (pCurr < pEnd)
-            {
-                if (pCurr[0] == '*' && pCurr[1] == '/')
-                {
-                    pCurr = &pCurr[2];
-                    break;
-                }
-
-                ++pCurr;
-            }
-        }
+            pCurr = tsScanPastBlockComment(pCurr + 2, pEnd);
     }
 
     return pCurr;
 }
 
-char const* tsSkipCommentsAndWhitespace(
-    char const* curr, char const*const end)
+char const* tsSkipCommentsAndWhitespaceExt(
+    char const* pCurr, char const* pEnd, unsigned styles)
 {
-    bool moved = true;
-    while (moved)
+    while (true)
     {
-        char const* past = tsScanForNonWhiteSpace(curr, end);
-        curr = past;
-
-        past = tsScanPastCPPComments(curr, end);
-        moved = past != curr;
-        curr = past;
+        char const* start = pCurr;
+        pCurr = tsScanForNonWhiteSpace(pCurr, pEnd);
+        TS_STAT_SCAN(tsScanWhiteSpace, pCurr - start);
+        if (pCurr == pEnd)
+            return pCurr;
+
+        start = pCurr;
+        char c = *pCurr;
+        if ((c == ';' && (styles & tsCommentSemicolon)) || (c == '#' && (styles & tsCommentHash)))
+            pCurr = tsScanForEither(pCurr + 1, pEnd, '\n', '\r');
+        else if (c == '/' && pEnd - pCurr >= 2 && pCurr[1] == '/' && (styles & tsCommentSlashSlash))
+            pCurr = tsScanForEither(pCurr + 2, pEnd, '\n', '\r');
+        else if (c == '/' && pEnd - pCurr >= 2 && pCurr[1] == '*' && (styles & tsCommentSlashStar))
+            pCurr = tsScanPastBlockComment(pCurr + 2, pEnd);
+        else
+            return pCurr;
+        TS_STAT_SCAN(tsScanComment, pCurr - start);
+        (void) start; // read only by the instrumented build
     }
+}
 
-    return tsScanForNonWhiteSpace(curr, end);
+char const* tsSkipCommentsAndWhitespace(
+    char const* curr, char const*const end)
+{
+    return tsSkipCommentsAndWhitespaceExt(curr, end, tsCommentCPP);
 }
 
 char const* tsGetToken(
@@ -981,6 +3135,29 @@ char const* tsGetNameSpacedTokenAlphaNumeric(
     return pCurr;
 }
 
+char const* tsGetTokenUtf8(
+    char const* pCurr, char const* pEnd,
+    char const* ext,
+    char const** resultStringBegin, uint32_t* stringLength)
+{
+    Assert(pCurr && pEnd);
+
+    pCurr = tsScanForNonWhiteSpace(pCurr, pEnd);
+    *resultStringBegin = pCurr;
+    pCurr = tsScanForEndOfUtf8Token(pCurr, pEnd, ext);
+    *stringLength = (uint32_t)(pCurr - *resultStringBegin);
+    return pCurr;
+}
+
+char const* tsGetNameSpacedTokenUtf8(
+    char const* pCurr, char const* pEnd,
+    char namespaceChar,
+    char const** resultStringBegin, uint32_t* stringLength)
+{
+    char ext[4] = { '$', '^', namespaceChar, '\0' };
+    return tsGetTokenUtf8(pCurr, pEnd, ext, resultStringBegin, stringLength);
+}
+
 char const* tsGetString(
     char const* pCurr, char const* pEnd,
     bool recognizeEscapes,
@@ -997,12 +3174,12 @@ char const* tsGetString(
 
         pCurr = tsScanForQuote(pCurr, pEnd, '\"', recognizeEscapes);
 
-        if (pCurr <= pEnd)
+        if (pCurr < pEnd) {
             *stringLength = (uint32_t)(pCurr - *resultStringBegin);
+            ++pCurr;    // point past closing quote
+        }
         else
-            *stringLength = 0;
-
-        ++pCurr;    // point past closing quote
+            *stringLength = 0;  // unterminated
     }
     else
         *stringLength = 0;
@@ -1027,12 +3204,12 @@ char const* tsGetString2(
 
         pCurr = tsScanForQuote(pCurr, pEnd, delim, recognizeEscapes);
 
-        if (pCurr <= pEnd)
+        if (pCurr < pEnd) {
             *stringLength = (uint32_t)(pCurr - *resultStringBegin);
+            ++pCurr;    // point past closing quote
+        }
         else
-            *stringLength = 0;
-
-        ++pCurr;    // point past closing quote
+            *stringLength = 0;  // unterminated
     }
     else
         *stringLength = 0;
@@ -1055,6 +3232,18 @@ char const* tsExpect(
     return (*pExpect == '\0' ? pScan : pCurr);
 }
 
+char const* tsExpectNoCase(
+    char const* pCurr, char const*const pEnd,
+    char const* pExpect)
+{
+    char const* pScan = pCurr;
+    while (pScan != pEnd && *pExpect != '\0' && tsToLowerAscii(*pScan) == tsToLowerAscii(*pExpect)) {
+        ++pScan;
+        ++pExpect;
+    }
+    return (*pExpect == '\0' ? pScan : pCurr);
+}
+
 char const* tsGetInt16(
     char const* pCurr, char const* pEnd,
     int16_t* result)
@@ -1243,6 +3432,727 @@ char const* tsGetHex(
     return pCurr;
 }
 
+
+//----------------------------------------------------------------------------
+// Decimal numbers
+//----------------------------------------------------------------------------
+
+static const uint64_t tsPow10u[20] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL };
+
+static const double tsPow10d[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+// a decimal number as scanned, valued mant * 10^exp10
+typedef struct {
+    uint64_t mant;
+    int32_t  exp10;
+    int      digits;    // digits held in mant
+    bool     inexact;   // digits beyond the 19 that mant can hold were dropped
+    bool     neg;
+    bool     point;     // a decimal point was present
+    bool     exponent;  // an exponent was present
+} tsDecimal_t;
+
+// Appends the digit run at p to *mant, keeping up to 19 digits. Returns the
+// end of the run, and the number of digits that did not fit in *dropped.
+static char const* tsAccumulateDigits(char const* p, char const* end,
+                                      uint64_t* mant, int* digits, int* dropped)
+{
+#ifdef LABTEXT_SIMD
+    while (end - p >= 16) {
+        uint32_t run = tsCtz32(~tsRangeMask16(p, '0', '9'));
+        if (run == 0 || *digits + (int) run > 19)
+            break;
+        if (run <= 8)
+            *mant = *mant * tsPow10u[run] + tsParseDigitsSwar(p, run);
+        else
+            *mant = (*mant * tsPow10u[8] + tsParseDigitsSwar(p, 8)) * tsPow10u[run - 8]
+                    + tsParseDigitsSwar(p + 8, run - 8);
+        *digits += (int) run;
+        p += run;
+        if (run < 16)
+            return p;
+    }
+#endif
+    for (; p < end && (unsigned char)(*p - '0') < 10; ++p) {
+        if (*digits < 19) {
+            *mant = *mant * 10 + (uint64_t)(*p - '0');
+            ++*digits;
+        }
+        else
+            ++*dropped;
+    }
+    return p;
+}
+
+// Scans [+-]digits[.digits][(e|E)[+-]digits] in one pass, requiring a digit
+// before any decimal point. An e not followed by digits is left unconsumed.
+// Returns p if there is no number at p.
+static char const* tsScanDecimal(char const* p, char const* end, tsDecimal_t* d)
+{
+    char const* start = p;
+    memset(d, 0, sizeof(tsDecimal_t));
+    if (p < end && (*p == '-' || *p == '+')) {
+        d->neg = *p == '-';
+        ++p;
+    }
+    char const* intStart = p;
+    while (p < end && *p == '0')
+        ++p;
+    int dropped = 0;
+    p = tsAccumulateDigits(p, end, &d->mant, &d->digits, &dropped);
+    if (p == intStart)
+        return start;
+    d->exp10 = dropped;
+    d->inexact = dropped > 0;
+
+    if (p < end && *p == '.') {
+        d->point = true;
+        ++p;
+        if (d->mant == 0) {
+            // leading zeros of a fraction only scale the value
+            while (p < end && *p == '0') {
+                --d->exp10;
+                ++p;
+            }
+        }
+        int before = d->digits;
+        dropped = 0;
+        p = tsAccumulateDigits(p, end, &d->mant, &d->digits, &dropped);
+        d->exp10 -= d->digits - before;
+        d->inexact |= dropped > 0;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        char const* e = p + 1;
+        bool eneg = false;
+        if (e < end && (*e == '-' || *e == '+')) {
+            eneg = *e == '-';
+            ++e;
+        }
+        if (e < end && (unsigned char)(*e - '0') < 10) {
+            int32_t x = 0;
+            for (; e < end && (unsigned char)(*e - '0') < 10; ++e)
+                if (x < 100000)
+                    x = x * 10 + (*e - '0');
+            d->exp10 += eneg ? -x : x;
+            d->exponent = true;
+            p = e;
+        }
+    }
+    return p;
+}
+
+static double tsDecimalToDouble(tsDecimal_t const* d)
+{
+    double v = (double) d->mant;
+    if (d->mant <= (1ULL << 53) && d->exp10 >= -22 && d->exp10 <= 22) {
+        // exact operands, so a single correctly rounded operation
+        if (d->exp10 < 0)
+            v /= tsPow10d[-d->exp10];
+        else
+            v *= tsPow10d[d->exp10];
+    }
+    else if (d->mant != 0) {
+        TS_STAT_ADD(slowConversions, 1);
+        if (d->exp10 < 0)
+            v /= pow(10.0, (double) -d->exp10);
+        else
+            v *= pow(10.0, (double) d->exp10);
+    }
+    return d->neg ? -v : v;
+}
+
+// the mode of tsScanNumberArray
+typedef enum {
+    tsNumberArrayDouble,
+    tsNumberArrayInt64,
+    tsNumberArraySexpr
+} tsNumberArrayMode_t;
+
+static bool tsIsSeparator(char c, tsNumberSeparator_t separator)
+{
+    return tsIsWhiteSpace(c) || (c == ',' && separator != tsNumberSeparatorWhiteSpace);
+}
+
+// Skip the separator following a number. Returns p if there is none.
+static char const* tsSkipNumberSeparator(char const* p, char const* end, tsNumberSeparator_t separator)
+{
+    char const* start = p;
+    if (separator == tsNumberSeparatorComma) {
+        p = tsScanForNonWhiteSpace(p, end);
+        if (p == end || *p != ',')
+            return start;
+        return tsScanForNonWhiteSpace(p + 1, end);
+    }
+    while (p < end && tsIsSeparator(*p, separator))
+        ++p;
+    return p;
+}
+
+// does c end a sexpr atom?
+static inline bool tsIsSexprDelimiter(char c)
+{
+    // everything that delimits sorts at or below ';'
+    return (unsigned char) c <= ';' &&
+           (c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '(' || c == ')' || c == '"' || c == ';');
+}
+
+// could c continue the token that a number ended in?
+static bool tsContinuesToken(char c, tsNumberArrayMode_t mode)
+{
+    if (mode == tsNumberArraySexpr)
+        return !tsIsSexprDelimiter(c);
+    return tsIsNumeric(c) || tsIsAlpha(c) || c == '_' || c == '.';
+}
+
+static char const* tsScanNumberArray(char const* pCurr, char const* pEnd, tsNumberSeparator_t separator,
+                                     tsNumberArrayMode_t mode, void* result, size_t* offsets,
+                                     size_t capacity, size_t* count)
+{
+    size_t n = 0;
+    char const* last = pCurr;
+    char const* p = tsScanForNonWhiteSpace(pCurr, pEnd);
+    double* doubles = (double*) result;
+    int64_t* ints = (int64_t*) result;
+    tsNumber_t* numbers = (tsNumber_t*) result;
+
+    while (n < capacity && p < pEnd) {
+#ifdef LABTEXT_SIMD
+        // Several short numbers per block, classified by masks alone. Tokens
+        // begin where separators end, so each is found from the masks rather
+        // than from the end of the one before, and they convert independently.
+        // Any token the masks cannot settle goes to the general path below.
+        if (separator != tsNumberSeparatorComma && pEnd - p >= 40) {
+            bool commas = separator == tsNumberSeparatorWhiteSpaceOrComma;
+            uint32_t digits = tsRangeMask16(p, '0', '9') | tsRangeMask16(p + 16, '0', '9') << 16;
+            uint32_t seps = tsSeparatorMask16(p, commas) | tsSeparatorMask16(p + 16, commas) << 16;
+            uint32_t minus = tsEitherMask16(p, '-', '-') | tsEitherMask16(p + 16, '-', '-') << 16;
+            uint32_t points = tsEitherMask16(p, '.', '.') | tsEitherMask16(p + 16, '.', '.') << 16;
+            uint32_t starts = ~seps & (seps << 1 | 1);  // p is at the start of a token
+            uint32_t pos = 0;
+            for (; starts && n < capacity; starts &= starts - 1) {
+                // [-]digits[.digits], at most 15 digits so that mant is exact as a double
+                uint32_t at = tsCtz32(starts);
+                uint32_t after = seps >> at;
+                if (!after)
+                    break;  // the token runs past the window
+                uint32_t end = at + tsCtz32(after);
+                at += (minus >> at) & 1;
+                // a separator ends the token, so every run below ends by end
+                uint32_t len = tsCtz32(~(digits >> at));
+                if (len == 0 || len > 8)
+                    break;
+                uint64_t word;
+                memcpy(&word, p + at, 8);
+                uint64_t mant;
+                uint32_t frac = 0;
+                if (at + len == end)
+                    mant = tsParseDigitsSwarValue(word, len);
+                else {
+                    if (mode == tsNumberArrayInt64 || !((points >> (at + len)) & 1))
+                        break;
+                    frac = tsCtz32(~(digits >> (at + len + 1)));
+                    if (frac == 0 || frac > 8 || len + frac > 15 || at + len + 1 + frac != end)
+                        break;
+                    if (len + frac < 8) {
+                        // close up the point, and convert both runs at once
+                        uint64_t below = (1ULL << 8 * len) - 1;
+                        mant = tsParseDigitsSwarValue((word & below) | (word >> 8 & ~below), len + frac);
+                    }
+                    else
+                        mant = (uint64_t) tsParseDigitsSwarValue(word, len) * tsPow10u[frac] +
+                               tsParseDigitsSwar(p + at + len + 1, frac);
+                }
+                bool neg = (minus >> tsCtz32(starts)) & 1;
+                if (offsets)
+                    offsets[n] = (size_t)(p - pCurr) + tsCtz32(starts);
+                if (mode == tsNumberArrayInt64)
+                    ints[n] = neg ? -(int64_t) mant : (int64_t) mant;
+                else {
+                    double f = (double) mant;
+                    if (frac)
+                        f /= tsPow10d[frac];
+                    f = neg ? -f : f;
+                    if (mode == tsNumberArrayDouble)
+                        doubles[n] = f;
+                    else if (frac) {
+                        numbers[n].kind = tsNumberFloat;
+                        numbers[n].f = f;
+                    }
+                    else {
+                        numbers[n].kind = tsNumberInteger;
+                        numbers[n].i = neg ? -(int64_t) mant : (int64_t) mant;
+                    }
+                }
+                ++n;
+                pos = end;
+            }
+            if (pos) {
+                last = p + pos;
+                p += pos;
+                while (p < pEnd && tsIsSeparator(*p, separator))
+                    ++p;
+                continue;
+            }
+        }
+#endif
+        tsDecimal_t d;
+        char const* q = tsScanDecimal(p, pEnd, &d);
+        if (q == p || (q < pEnd && tsContinuesToken(*q, mode)))
+            break;
+        if (offsets)
+            offsets[n] = (size_t)(p - pCurr);
+        if (mode == tsNumberArrayDouble)
+            doubles[n] = tsDecimalToDouble(&d);
+        else if (mode == tsNumberArrayInt64) {
+            if (d.point || d.exponent || d.inexact ||
+                d.mant > (uint64_t) INT64_MAX + (d.neg ? 1 : 0))
+                break;
+            ints[n] = d.neg ? (int64_t)(0 - d.mant) : (int64_t) d.mant;
+        }
+        else {
+            if (d.point || d.exponent) {
+                numbers[n].kind = tsNumberFloat;
+                numbers[n].f = tsDecimalToDouble(&d);
+            }
+            else {
+                // integers the sexpr parsers hold in 32 bits
+                if (d.digits > 9)
+                    break;
+                numbers[n].kind = tsNumberInteger;
+                numbers[n].i = d.neg ? -(int64_t) d.mant : (int64_t) d.mant;
+            }
+        }
+        ++n;
+        last = q;
+        p = tsSkipNumberSeparator(q, pEnd, separator);
+        if (p == q)
+            break;
+    }
+    *count = n;
+    return last;
+}
+
+char const* tsGetDoubleArray(char const* pCurr, char const* pEnd, tsNumberSeparator_t separator,
+                             double* result, size_t capacity, size_t* count)
+{
+    return tsScanNumberArray(pCurr, pEnd, separator, tsNumberArrayDouble, result, NULL, capacity, count);
+}
+
+char const* tsGetInt64Array(char const* pCurr, char const* pEnd, tsNumberSeparator_t separator,
+                            int64_t* result, size_t capacity, size_t* count)
+{
+    return tsScanNumberArray(pCurr, pEnd, separator, tsNumberArrayInt64, result, NULL, capacity, count);
+}
+
+char const* tsGetSexprNumbers(char const* pCurr, char const* pEnd,
+                              tsNumber_t* result, size_t* offsets, size_t capacity, size_t* count)
+{
+    return tsScanNumberArray(pCurr, pEnd, tsNumberSeparatorWhiteSpace, tsNumberArraySexpr,
+                             result, offsets, capacity, count);
+}
+
+//----------------------------------------------------------------------------
+// Binary blobs
+
+static int tsHexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+static int tsBase64Digit(char c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == '+' || c == '-')
+        return 62;
+    if (c == '/' || c == '_')
+        return 63;
+    return -1;
+}
+
+static char const* tsSkipBlobWhiteSpace(char const* p, char const* end)
+{
+    while (p < end && tsIsWhiteSpace(*p))
+        ++p;
+    return p;
+}
+
+#ifdef LABTEXT_SSE2
+// the values of 16 hex digits at p; *valid is set if all of them are digits
+static inline __m128i tsHexValues16(char const* p, bool* valid)
+{
+    __m128i v = _mm_loadu_si128((__m128i const*) p);
+    __m128i l = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    // bytes of 0x80 and up are negative, and in neither range
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(l, _mm_set1_epi8('f' + 1)));
+    *valid = _mm_movemask_epi8(_mm_or_si128(digit, letter)) == 0xffff;
+    return _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+                        _mm_and_si128(letter, _mm_sub_epi8(l, _mm_set1_epi8('a' - 10))));
+}
+
+// the characters of the 16 hex digit values of n
+static inline __m128i tsHexChars16(__m128i n)
+{
+    __m128i letter = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+    return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')), _mm_and_si128(letter, _mm_set1_epi8('a' - '0' - 10)));
+}
+
+// the values of 16 base64 digits at p; *valid is set if all of them are
+static inline __m128i tsBase64Values16(char const* p, bool* valid)
+{
+    __m128i v = _mm_loadu_si128((__m128i const*) p);
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i plus = _mm_cmpeq_epi8(v, _mm_set1_epi8('+'));
+    __m128i minus = _mm_cmpeq_epi8(v, _mm_set1_epi8('-'));
+    __m128i slash = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+    __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    __m128i any = _mm_or_si128(_mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, plus)),
+                               _mm_or_si128(_mm_or_si128(minus, slash), under));
+    *valid = _mm_movemask_epi8(any) == 0xffff;
+    // the offset from each character to its value
+    __m128i offset = _mm_or_si128(
+        _mm_or_si128(_mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-'A')), _mm_and_si128(lower, _mm_set1_epi8(26 - 'a'))),
+                     _mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(52 - '0')), _mm_and_si128(plus, _mm_set1_epi8(62 - '+')))),
+        _mm_or_si128(_mm_or_si128(_mm_and_si128(minus, _mm_set1_epi8(62 - '-')), _mm_and_si128(slash, _mm_set1_epi8(63 - '/'))),
+                     _mm_and_si128(under, _mm_set1_epi8(63 - '_'))));
+    return _mm_add_epi8(v, offset);
+}
+#endif
+
+#ifdef LABTEXT_NEON
+static inline uint8x16_t tsHexValues16(uint8x16_t v, uint8x16_t* valid)
+{
+    uint8x16_t d = vsubq_u8(v, vdupq_n_u8('0'));
+    uint8x16_t l = vsubq_u8(vorrq_u8(v, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    uint8x16_t digit = vcleq_u8(d, vdupq_n_u8(9));
+    uint8x16_t letter = vcleq_u8(l, vdupq_n_u8(5));
+    *valid = vandq_u8(*valid, vorrq_u8(digit, letter));
+    return vbslq_u8(digit, d, vaddq_u8(l, vdupq_n_u8(10)));
+}
+
+static inline uint8x16_t tsHexChars16(uint8x16_t n)
+{
+    uint8x16_t letter = vcgtq_u8(n, vdupq_n_u8(9));
+    return vaddq_u8(vaddq_u8(n, vdupq_n_u8('0')), vandq_u8(letter, vdupq_n_u8('a' - '0' - 10)));
+}
+
+static inline uint8x16_t tsBase64Values16(uint8x16_t v, uint8x16_t* valid)
+{
+    uint8x16_t upper = vcleq_u8(vsubq_u8(v, vdupq_n_u8('A')), vdupq_n_u8(25));
+    uint8x16_t lower = vcleq_u8(vsubq_u8(v, vdupq_n_u8('a')), vdupq_n_u8(25));
+    uint8x16_t digit = vcleq_u8(vsubq_u8(v, vdupq_n_u8('0')), vdupq_n_u8(9));
+    uint8x16_t plus = vorrq_u8(vceqq_u8(v, vdupq_n_u8('+')), vceqq_u8(v, vdupq_n_u8('-')));
+    uint8x16_t slash = vorrq_u8(vceqq_u8(v, vdupq_n_u8('/')), vceqq_u8(v, vdupq_n_u8('_')));
+    *valid = vandq_u8(*valid, vorrq_u8(vorrq_u8(upper, lower), vorrq_u8(digit, vorrq_u8(plus, slash))));
+    uint8x16_t value = vandq_u8(upper, vsubq_u8(v, vdupq_n_u8('A')));
+    value = vbslq_u8(lower, vsubq_u8(v, vdupq_n_u8('a' - 26)), value);
+    value = vbslq_u8(digit, vaddq_u8(v, vdupq_n_u8(52 - '0')), value);
+    value = vbslq_u8(plus, vdupq_n_u8(62), value);
+    return vbslq_u8(slash, vdupq_n_u8(63), value);
+}
+#endif
+
+char const* tsDecodeHex(char const* pCurr, char const* pEnd,
+                        uint8_t* result, size_t capacity, size_t* count)
+{
+    uint8_t* out = result;
+    uint8_t* outEnd = result + capacity;
+    char const* p = pCurr;
+    char const* consumed = pCurr;
+    while (true) {
+#if defined(LABTEXT_SSE2)
+        while (pEnd - p >= 32 && outEnd - out >= 16) {
+            bool valid0, valid1;
+            __m128i n0 = tsHexValues16(p, &valid0);
+            __m128i n1 = tsHexValues16(p + 16, &valid1);
+            if (!valid0 || !valid1)
+                break;
+            // each 16 bit lane holds the high digit in its low byte
+            __m128i low = _mm_set1_epi16(0xff);
+            n0 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(n0, low), 4), _mm_srli_epi16(n0, 8));
+            n1 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(n1, low), 4), _mm_srli_epi16(n1, 8));
+            _mm_storeu_si128((__m128i*) out, _mm_packus_epi16(n0, n1));
+            p += 32;
+            out += 16;
+            consumed = p;
+        }
+#elif defined(LABTEXT_NEON)
+        while (pEnd - p >= 32 && outEnd - out >= 16) {
+            uint8x16x2_t v = vld2q_u8((uint8_t const*) p);
+            uint8x16_t valid = vdupq_n_u8(0xff);
+            uint8x16_t hi = tsHexValues16(v.val[0], &valid);
+            uint8x16_t lo = tsHexValues16(v.val[1], &valid);
+            if (vminvq_u8(valid) != 0xff)
+                break;
+            vst1q_u8(out, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+            p += 32;
+            out += 16;
+            consumed = p;
+        }
+#endif
+        // a byte at a time, around white space and at the end
+        p = tsSkipBlobWhiteSpace(p, pEnd);
+        if (p == pEnd || out == outEnd)
+            break;
+        int hi = tsHexDigit(*p);
+        if (hi < 0)
+            break;
+        char const* q = tsSkipBlobWhiteSpace(p + 1, pEnd);
+        if (q == pEnd)
+            break;
+        int lo = tsHexDigit(*q);
+        if (lo < 0)
+            break;
+        *out++ = (uint8_t)((hi << 4) | lo);
+        p = q + 1;
+        consumed = p;
+    }
+    *count = (size_t)(out - result);
+    return consumed;
+}
+
+char const* tsDecodeBase64(char const* pCurr, char const* pEnd,
+                           uint8_t* result, size_t capacity, size_t* count)
+{
+    uint8_t* out = result;
+    uint8_t* outEnd = result + capacity;
+    char const* p = pCurr;
+    char const* consumed = pCurr;
+    while (true) {
+#if defined(LABTEXT_SSE2)
+        while (pEnd - p >= 16 && outEnd - out >= 12) {
+            bool valid;
+            __m128i v = tsBase64Values16(p, &valid);
+            if (!valid)
+                break;
+            // merge pairs of six bits into 16 bit lanes, then pairs of
+            // those into 24 bits in each 32 bit lane
+            v = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x3f)), 6), _mm_srli_epi16(v, 8));
+            v = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0xffff)), 12), _mm_srli_epi32(v, 16));
+            uint32_t w[4];
+            _mm_storeu_si128((__m128i*) w, v);
+            for (int i = 0; i < 4; ++i, out += 3) {
+                out[0] = (uint8_t)(w[i] >> 16);
+                out[1] = (uint8_t)(w[i] >> 8);
+                out[2] = (uint8_t) w[i];
+            }
+            p += 16;
+            consumed = p;
+        }
+#elif defined(LABTEXT_NEON)
+        while (pEnd - p >= 64 && outEnd - out >= 48) {
+            uint8x16x4_t v = vld4q_u8((uint8_t const*) p);
+            uint8x16_t valid = vdupq_n_u8(0xff);
+            uint8x16_t a = tsBase64Values16(v.val[0], &valid);
+            uint8x16_t b = tsBase64Values16(v.val[1], &valid);
+            uint8x16_t c = tsBase64Values16(v.val[2], &valid);
+            uint8x16_t d = tsBase64Values16(v.val[3], &valid);
+            if (vminvq_u8(valid) != 0xff)
+                break;
+            uint8x16x3_t bytes;
+            bytes.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+            bytes.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+            bytes.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+            vst3q_u8(out, bytes);
+            p += 64;
+            out += 48;
+            consumed = p;
+        }
+#endif
+        // a quantum of four digits at a time, around white space and at
+        // the end, where it may be short, and padded with '='
+        int value[4];
+        int n = 0;
+        char const* q = p;
+        for (; n < 4; ++n, ++q) {
+            q = tsSkipBlobWhiteSpace(q, pEnd);
+            if (q == pEnd || (value[n] = tsBase64Digit(*q)) < 0)
+                break;
+        }
+        if (n < 2 || outEnd - out < n - 1)
+            break;
+        uint32_t bits = ((uint32_t) value[0] << 18) | ((uint32_t) value[1] << 12) |
+                        (n > 2 ? (uint32_t) value[2] << 6 : 0) | (n > 3 ? (uint32_t) value[3] : 0);
+        *out++ = (uint8_t)(bits >> 16);
+        if (n > 2)
+            *out++ = (uint8_t)(bits >> 8);
+        if (n > 3)
+            *out++ = (uint8_t) bits;
+        p = q;
+        consumed = p;
+        if (n == 4)
+            continue;
+        // a short quantum ends the encoding; consume its padding, if whole
+        char const* pad = q;
+        for (; n < 4; ++n, ++pad) {
+            pad = tsSkipBlobWhiteSpace(pad, pEnd);
+            if (pad == pEnd || *pad != '=')
+                break;
+        }
+        if (n == 4)
+            consumed = pad;
+        break;
+    }
+    *count = (size_t)(out - result);
+    return consumed;
+}
+
+char* tsEncodeHex(uint8_t const* data, size_t sz, char* result)
+{
+    uint8_t const* end = data + sz;
+#if defined(LABTEXT_SSE2)
+    for (; end - data >= 16; data += 16, result += 32) {
+        __m128i v = _mm_loadu_si128((__m128i const*) data);
+        __m128i hi = tsHexChars16(_mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0f)));
+        __m128i lo = tsHexChars16(_mm_and_si128(v, _mm_set1_epi8(0x0f)));
+        _mm_storeu_si128((__m128i*) result, _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i*)(result + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+#elif defined(LABTEXT_NEON)
+    for (; end - data >= 16; data += 16, result += 32) {
+        uint8x16_t v = vld1q_u8(data);
+        uint8x16x2_t chars;
+        chars.val[0] = tsHexChars16(vshrq_n_u8(v, 4));
+        chars.val[1] = tsHexChars16(vandq_u8(v, vdupq_n_u8(0x0f)));
+        vst2q_u8((uint8_t*) result, chars);
+    }
+#endif
+    static char const digits[] = "0123456789abcdef";
+    for (; data < end; ++data) {
+        *result++ = digits[*data >> 4];
+        *result++ = digits[*data & 0x0f];
+    }
+    return result;
+}
+
+static char const tsBase64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+char* tsEncodeBase64(uint8_t const* data, size_t sz, char* result)
+{
+    uint8_t const* end = data + sz;
+#if defined(LABTEXT_SSE2)
+    for (; end - data >= 12; data += 12, result += 16) {
+        // 24 bits to each 32 bit lane, then six to each of its bytes
+        __m128i v = _mm_setr_epi32(
+            (data[0] << 16) | (data[1] << 8) | data[2], (data[3] << 16) | (data[4] << 8) | data[5],
+            (data[6] << 16) | (data[7] << 8) | data[8], (data[9] << 16) | (data[10] << 8) | data[11]);
+        __m128i i = _mm_or_si128(
+            _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 18), _mm_set1_epi32(0x3f)),
+                         _mm_and_si128(_mm_srli_epi32(v, 4), _mm_set1_epi32(0x3f00))),
+            _mm_or_si128(_mm_and_si128(_mm_slli_epi32(v, 10), _mm_set1_epi32(0x3f0000)),
+                         _mm_and_si128(_mm_slli_epi32(v, 24), _mm_set1_epi32(0x3f000000))));
+        // the offset from each value to its character, by range
+        __m128i offset = _mm_set1_epi8('A');
+        offset = _mm_add_epi8(offset, _mm_and_si128(_mm_cmpgt_epi8(i, _mm_set1_epi8(25)), _mm_set1_epi8('a' - 26 - 'A')));
+        offset = _mm_add_epi8(offset, _mm_and_si128(_mm_cmpgt_epi8(i, _mm_set1_epi8(51)), _mm_set1_epi8('0' - 52 - ('a' - 26))));
+        offset = _mm_add_epi8(offset, _mm_and_si128(_mm_cmpgt_epi8(i, _mm_set1_epi8(61)), _mm_set1_epi8('+' - 62 - ('0' - 52))));
+        offset = _mm_add_epi8(offset, _mm_and_si128(_mm_cmpgt_epi8(i, _mm_set1_epi8(62)), _mm_set1_epi8('/' - 63 - ('+' - 62))));
+        _mm_storeu_si128((__m128i*) result, _mm_add_epi8(i, offset));
+    }
+#elif defined(LABTEXT_NEON)
+    uint8x16x4_t table;
+    for (int t = 0; t < 4; ++t)
+        table.val[t] = vld1q_u8((uint8_t const*) tsBase64Alphabet + 16 * t);
+    for (; end - data >= 48; data += 48, result += 64) {
+        uint8x16x3_t v = vld3q_u8(data);
+        uint8x16x4_t chars;
+        chars.val[0] = vqtbl4q_u8(table, vshrq_n_u8(v.val[0], 2));
+        chars.val[1] = vqtbl4q_u8(table, vandq_u8(vorrq_u8(vshlq_n_u8(v.val[0], 4), vshrq_n_u8(v.val[1], 4)), vdupq_n_u8(0x3f)));
+        chars.val[2] = vqtbl4q_u8(table, vandq_u8(vorrq_u8(vshlq_n_u8(v.val[1], 2), vshrq_n_u8(v.val[2], 6)), vdupq_n_u8(0x3f)));
+        chars.val[3] = vqtbl4q_u8(table, vandq_u8(v.val[2], vdupq_n_u8(0x3f)));
+        vst4q_u8((uint8_t*) result, chars);
+    }
+#endif
+    for (; end - data >= 3; data += 3, result += 4) {
+        uint32_t bits = ((uint32_t) data[0] << 16) | ((uint32_t) data[1] << 8) | data[2];
+        result[0] = tsBase64Alphabet[bits >> 18];
+        result[1] = tsBase64Alphabet[(bits >> 12) & 0x3f];
+        result[2] = tsBase64Alphabet[(bits >> 6) & 0x3f];
+        result[3] = tsBase64Alphabet[bits & 0x3f];
+    }
+    if (data < end) {
+        uint32_t bits = ((uint32_t) data[0] << 16) | (end - data > 1 ? (uint32_t) data[1] << 8 : 0);
+        *result++ = tsBase64Alphabet[bits >> 18];
+        *result++ = tsBase64Alphabet[(bits >> 12) & 0x3f];
+        *result++ = end - data > 1 ? tsBase64Alphabet[(bits >> 6) & 0x3f] : '=';
+        *result++ = '=';
+    }
+    return result;
+}
+
+char const* tsScanSexprAtom(char const* pCurr, char const* pEnd, tsLexeme_t* result)
+{
+    char const* p = pCurr;
+    result->kind = tsLexAtom;
+    result->i = 0;
+    if (p == pEnd)
+        return p;
+
+    bool neg = *p == '-';
+    char const* digits = p + (*p == '-' || *p == '+');
+    if (pEnd - digits > 2 && digits[0] == '0' && (digits[1] | 0x20) == 'x') {
+        uint64_t v = 0;
+        char const* q = digits + 2;
+        for (; q < pEnd; ++q) {
+            unsigned char c = (unsigned char) *q;
+            unsigned char lower = c | 0x20;
+            if ((unsigned char)(c - '0') < 10)
+                v = v << 4 | (uint64_t)(c - '0');
+            else if ((unsigned char)(lower - 'a') < 6)
+                v = v << 4 | (uint64_t)(lower - 'a' + 10);
+            else
+                break;
+        }
+        ptrdiff_t count = q - digits - 2;
+        if (count > 0 && count <= 16 && (q == pEnd || tsIsSexprDelimiter(*q))) {
+            result->kind = tsLexHex;
+            result->i = neg ? (int64_t)(0 - v) : (int64_t) v;
+            return q;
+        }
+        p = q;
+    }
+    else {
+        tsDecimal_t d;
+        char const* q = tsScanDecimal(p, pEnd, &d);
+        if (q > p && (q == pEnd || tsIsSexprDelimiter(*q))) {
+            if (d.point || d.exponent || d.inexact || d.mant > (uint64_t) INT64_MAX + (d.neg ? 1 : 0)) {
+                result->kind = tsLexFloat;
+                result->f = tsDecimalToDouble(&d);
+            }
+            else {
+                result->kind = tsLexInteger;
+                result->i = d.neg ? (int64_t)(0 - d.mant) : (int64_t) d.mant;
+            }
+            return q;
+        }
+        p = q;
+    }
+
+    // not a number; the atom continues from wherever the number scan stopped
+    while (p < pEnd && !tsIsSexprDelimiter(*p))
+        ++p;
+    return p;
+}
+
 _Bool tsIsIn(const char* testString, char test)
 {
     for (; *testString != '\0'; ++testString)
@@ -1303,50 +4213,338 @@ _Bool tsStrViewIsEmpty(const tsStrView_t *s) {
     return (s->curr == NULL) || (s->sz == 0);
 }
 
-tsStrView_t tsStrViewGetToken(const tsStrView_t *s, char delim, tsStrView_t *result) {
-    if (!s || !result) {
-        return (tsStrView_t){ NULL, 0 };
-    }
-    uint32_t sz;
-    char const* next = tsGetToken(s->curr, s->curr + s->sz, delim, &result->curr, &sz);
-    result->sz = sz;
-    return (tsStrView_t){ next, (size_t) (s->curr + s->sz - next) };
+static inline uint64_t tsHashMix(uint64_t h, uint64_t w) {
+    h ^= w * 0x9e3779b97f4a7c15ull;
+    h = (h << 31) | (h >> 33);
+    return h * 0xff51afd7ed558ccdull;
 }
 
-tsStrView_t tsStrViewGetTokenWSDelimited(const tsStrView_t *s, tsStrView_t *result) {
-    if (!s || !result) {
-        return (tsStrView_t){ NULL, 0 };
+// The body of tsHashBytes, optionally folding ASCII case; fold is constant
+// in each caller, so the test compiles away.
+static inline uint64_t tsHashBytesImpl(char const* p, size_t sz, uint64_t seed, _Bool fold) {
+    // four independent lanes over 32 byte blocks, so that the multiplies
+    // overlap, then single words, then the tail
+    uint64_t a = seed ^ 0x243f6a8885a308d3ull;
+    uint64_t b = seed ^ 0x13198a2e03707344ull;
+    uint64_t c = seed ^ 0xa4093822299f31d0ull;
+    uint64_t d = seed ^ 0x082efa98ec4e6c89ull;
+    size_t n = sz;
+    uint64_t w[4];
+    for (; n >= 32; n -= 32, p += 32) {
+        memcpy(w, p, 32);
+        if (fold) {
+            w[0] = tsToLowerAscii8(w[0]);
+            w[1] = tsToLowerAscii8(w[1]);
+            w[2] = tsToLowerAscii8(w[2]);
+            w[3] = tsToLowerAscii8(w[3]);
+        }
+        a = tsHashMix(a, w[0]);
+        b = tsHashMix(b, w[1]);
+        c = tsHashMix(c, w[2]);
+        d = tsHashMix(d, w[3]);
     }
-    uint32_t sz;
-    char const* next = tsGetTokenWSDelimited(s->curr, s->curr + s->sz, &result->curr, &sz);
-    result->sz = sz;
-    return (tsStrView_t){ next, (size_t) (s->curr + s->sz - next) };
+    uint64_t h = tsHashMix(tsHashMix(tsHashMix(a, b), c), d);
+    for (; n >= 8; n -= 8, p += 8) {
+        memcpy(w, p, 8);
+        h = tsHashMix(h, fold ? tsToLowerAscii8(w[0]) : w[0]);
+    }
+    if (n) {
+        w[0] = 0;
+        memcpy(w, p, n);
+        h = tsHashMix(h, fold ? tsToLowerAscii8(w[0]) : w[0]);
+    }
+    h ^= (uint64_t) sz;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
 }
 
-tsStrView_t tsStrViewGetTokenAlphaNumeric(const tsStrView_t* s, tsStrView_t* result) {
-    if (!s || !result) {
-        return (tsStrView_t){ NULL, 0 };
-    }
-    uint32_t sz;
-    char const* next = tsGetTokenAlphaNumeric(s->curr, s->curr + s->sz, &result->curr, &sz);
-    result->sz = sz;
-    return (tsStrView_t){ next, (size_t) (s->curr + s->sz - next) };
+uint64_t tsHashBytes(char const* p, size_t sz, uint64_t seed) {
+    return tsHashBytesImpl(p, sz, seed, false);
 }
 
-tsStrView_t tsStrViewGetTokenAlphaNumericExt(const tsStrView_t* s, char const* ext,  tsStrView_t* result) {
-    if (!s || !result) {
-        return (tsStrView_t){ NULL, 0 };
+// the length of the common prefix of a and b, ignoring ASCII case
+static size_t tsMatchNoCase(char const* a, char const* b, size_t sz) {
+    size_t i = 0;
+#ifdef LABTEXT_SIMD
+    for (; sz - i >= 16; i += 16) {
+        uint32_t differ = tsEqualNoCaseMask16(a + i, b + i) ^ 0xffff;
+        if (differ)
+            return i + tsCtz32(differ);
     }
-    uint32_t sz;
-    char const* next = tsGetTokenAlphaNumericExt(s->curr, s->curr + s->sz, ext, &result->curr, &sz);
-    result->sz = sz;
-    return (tsStrView_t){ next, (size_t) (s->curr + s->sz - next) };
+#endif
+    for (; sz - i >= 8; i += 8) {
+        uint64_t x, y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        if (tsToLowerAscii8(x) != tsToLowerAscii8(y))
+            break;
+    }
+    while (i < sz && tsToLowerAscii(a[i]) == tsToLowerAscii(b[i]))
+        ++i;
+    return i;
 }
 
-tsStrView_t tsStrViewGetTokenExt(const tsStrView_t* s, char const* ext, tsStrView_t* result) {
-    if (!s || !result) {
-        return (tsStrView_t){ NULL, 0 };
-    }
+_Bool tsStrViewEqualNoCase(const tsStrView_t* s, const tsStrView_t* rhs) {
+    return s->sz == rhs->sz && tsMatchNoCase(s->curr, rhs->curr, s->sz) == s->sz;
+}
+
+_Bool tsStrViewBeginsNoCase(const tsStrView_t* s, const tsStrView_t* rhs) {
+    return s->sz <= rhs->sz && tsMatchNoCase(s->curr, rhs->curr, s->sz) == s->sz;
+}
+
+int tsStrViewCompareNoCase(const tsStrView_t* s, const tsStrView_t* rhs) {
+    size_t sz = s->sz < rhs->sz ? s->sz : rhs->sz;
+    size_t i = tsMatchNoCase(s->curr, rhs->curr, sz);
+    if (i < sz)
+        return (int)(unsigned char) tsToLowerAscii(s->curr[i]) - (int)(unsigned char) tsToLowerAscii(rhs->curr[i]);
+    return s->sz < rhs->sz ? -1 : s->sz > rhs->sz ? 1 : 0;
+}
+
+uint64_t tsStrViewHashNoCase(const tsStrView_t* s, uint64_t seed) {
+    return tsHashBytesImpl(s->curr, s->sz, seed, true);
+}
+
+tsStrView_t tsStrViewFindNoCase(const tsStrView_t* s, const tsStrView_t* needle) {
+    char const* end = s->curr + s->sz;
+    if (needle->sz == 0)
+        return *s;
+    if (needle->sz > s->sz)
+        return (tsStrView_t){ end, 0 };
+    // candidates are the positions of the first character in either case
+    char lower = tsToLowerAscii(needle->curr[0]);
+    char upper = lower >= 'a' && lower <= 'z' ? (char)(lower - 32) : lower;
+    char const* last = end - needle->sz;    // the last possible start
+    char const* p = s->curr;
+#ifdef LABTEXT_SIMD
+    for (; last - p >= 16; p += 16) {
+        uint32_t m = tsEitherMask16(p, lower, upper);
+        while (m) {
+            char const* at = p + tsCtz32(m);
+            if (tsMatchNoCase(at + 1, needle->curr + 1, needle->sz - 1) == needle->sz - 1)
+                return (tsStrView_t){ at, (size_t)(end - at) };
+            m &= m - 1;
+        }
+    }
+#endif
+    for (; p <= last; ++p)
+        if ((*p == lower || *p == upper) &&
+            tsMatchNoCase(p + 1, needle->curr + 1, needle->sz - 1) == needle->sz - 1)
+            return (tsStrView_t){ p, (size_t)(end - p) };
+    return (tsStrView_t){ end, 0 };
+}
+
+uint32_t tsFoldCodePoint(uint32_t cp) {
+    if (cp < 0x80)
+        return cp >= 'A' && cp <= 'Z' ? cp + 32 : cp;
+    if (cp < 0x100) {
+        if (cp == 0xb5)
+            return 0x3bc;       // micro sign to mu
+        return cp >= 0xc0 && cp <= 0xde && cp != 0xd7 ? cp + 32 : cp;
+    }
+    if (cp < 0x180) {
+        // Latin Extended-A pairs upper and lower case, on even or odd
+        // code points by range
+        if (cp == 0x178)
+            return 0xff;
+        if (cp == 0x17f)
+            return 's';
+        if ((cp >= 0x100 && cp <= 0x12f) || (cp >= 0x132 && cp <= 0x137) || (cp >= 0x14a && cp <= 0x177))
+            return cp | 1;
+        if ((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17e))
+            return cp & 1 ? cp + 1 : cp;
+        return cp;
+    }
+    if (cp >= 0x386 && cp <= 0x3ab) {
+        if (cp == 0x386)
+            return 0x3ac;
+        if (cp >= 0x388 && cp <= 0x38a)
+            return cp + 37;
+        if (cp == 0x38c)
+            return 0x3cc;
+        if (cp == 0x38e || cp == 0x38f)
+            return cp + 63;
+        if ((cp >= 0x391 && cp <= 0x3a1) || cp >= 0x3a3)
+            return cp + 32;
+        return cp;
+    }
+    if (cp == 0x3c2)
+        return 0x3c3;           // final sigma
+    if (cp >= 0x400 && cp <= 0x52f) {
+        if (cp <= 0x40f)
+            return cp + 80;
+        if (cp <= 0x42f)
+            return cp + 32;
+        if (cp == 0x4c0)
+            return 0x4cf;
+        if ((cp >= 0x460 && cp <= 0x481) || (cp >= 0x48a && cp <= 0x4bf) || (cp >= 0x4d0 && cp <= 0x52f))
+            return cp | 1;
+        if (cp >= 0x4c1 && cp <= 0x4ce)
+            return cp & 1 ? cp + 1 : cp;
+        return cp;
+    }
+    if (cp >= 0x531 && cp <= 0x556)
+        return cp + 48;         // Armenian
+    if (cp >= 0x1e00 && cp <= 0x1eff) {
+        if (cp == 0x1e9e)
+            return 0xdf;        // capital sharp s
+        if (cp <= 0x1e95 || cp >= 0x1ea0)
+            return cp | 1;
+        return cp;
+    }
+    if (cp >= 0xff21 && cp <= 0xff3a)
+        return cp + 32;         // fullwidth Latin
+    return cp;
+}
+
+// The code point at p, folded, and the end of its sequence in *next. A
+// malformed byte is returned by itself, with 0x110000 added so that it
+// matches no code point.
+static uint32_t tsNextFolded(char const* p, char const* end, char const** next) {
+    uint32_t cp = tsDecodeUtf8Strict(p, end, next);
+    return cp == UINT32_MAX ? 0x110000u + (uint32_t)(unsigned char) *p : tsFoldCodePoint(cp);
+}
+
+int tsStrViewCompareFold(const tsStrView_t* s, const tsStrView_t* rhs) {
+    char const* a = s->curr;
+    char const* b = rhs->curr;
+    char const* aEnd = a + s->sz;
+    char const* bEnd = b + rhs->sz;
+    while (a < aEnd && b < bEnd) {
+        // runs of ASCII compare by the fast path
+        size_t sz = (size_t)(aEnd - a) < (size_t)(bEnd - b) ? (size_t)(aEnd - a) : (size_t)(bEnd - b);
+        size_t i = tsMatchNoCase(a, b, sz);
+        if (i > 0 && (unsigned char) a[i - 1] >= 0x80) {
+            // bytes above 0x7f match only when equal, so only the last
+            // sequence, which may be cut short, needs to be decoded again
+            size_t j = i - 1;
+            while (j > 0 && i - j < 4 && ((unsigned char) a[j] & 0xc0) == 0x80)
+                --j;
+            i = j;
+        }
+        a += i;
+        b += i;
+        if (a == aEnd || b == bEnd)
+            break;
+        char const* an;
+        char const* bn;
+        uint32_t ca = tsNextFolded(a, aEnd, &an);
+        uint32_t cb = tsNextFolded(b, bEnd, &bn);
+        if (ca != cb)
+            return ca < cb ? -1 : 1;
+        a = an;
+        b = bn;
+    }
+    return a < aEnd ? 1 : b < bEnd ? -1 : 0;
+}
+
+_Bool tsStrViewEqualFold(const tsStrView_t* s, const tsStrView_t* rhs) {
+    return tsStrViewCompareFold(s, rhs) == 0;
+}
+
+uint64_t tsStrViewHashFold(const tsStrView_t* s, uint64_t seed) {
+    // Folded code points are hashed as a stream of bytes, eight to a word:
+    // one byte for ASCII, and three with the high bit set for any other,
+    // so that blocks of eight ASCII bytes are folded and mixed as they are
+    // loaded, and hash as the same code points taken one at a time do.
+    uint64_t h = seed ^ 0x243f6a8885a308d3ull;
+    unsigned char buf[8];
+    size_t fill = 0;
+    size_t count = 0;
+    uint64_t w;
+    char const* p = s->curr;
+    char const* end = s->curr + s->sz;
+    while (p < end) {
+        if (fill == 0) {
+            for (; end - p >= 8; p += 8, count += 8) {
+                memcpy(&w, p, 8);
+                if (w & 0x8080808080808080ull)
+                    break;
+                h = tsHashMix(h, tsToLowerAscii8(w));
+            }
+            if (p == end)
+                break;
+        }
+        uint32_t cp = tsNextFolded(p, end, &p);
+        unsigned char bytes[3];
+        int n = 1;
+        if (cp < 0x80)
+            bytes[0] = (unsigned char) cp;
+        else {
+            bytes[0] = (unsigned char)(0x80 | (cp >> 14));
+            bytes[1] = (unsigned char)(0x80 | ((cp >> 7) & 0x7f));
+            bytes[2] = (unsigned char)(0x80 | (cp & 0x7f));
+            n = 3;
+        }
+        for (int i = 0; i < n; ++i) {
+            buf[fill++] = bytes[i];
+            if (fill == 8) {
+                memcpy(&w, buf, 8);
+                h = tsHashMix(h, w);
+                fill = 0;
+            }
+        }
+        count += (size_t) n;
+    }
+    if (fill) {
+        memset(buf + fill, 0, 8 - fill);
+        memcpy(&w, buf, 8);
+        h = tsHashMix(h, w);
+    }
+    h ^= (uint64_t) count;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+}
+
+tsStrView_t tsStrViewGetToken(const tsStrView_t *s, char delim, tsStrView_t *result) {
+    if (!s || !result) {
+        return (tsStrView_t){ NULL, 0 };
+    }
+    uint32_t sz;
+    char const* next = tsGetToken(s->curr, s->curr + s->sz, delim, &result->curr, &sz);
+    result->sz = sz;
+    return (tsStrView_t){ next, (size_t) (s->curr + s->sz - next) };
+}
+
+tsStrView_t tsStrViewGetTokenWSDelimited(const tsStrView_t *s, tsStrView_t *result) {
+    if (!s || !result) {
+        return (tsStrView_t){ NULL, 0 };
+    }
+    uint32_t sz;
+    char const* next = tsGetTokenWSDelimited(s->curr, s->curr + s->sz, &result->curr, &sz);
+    result->sz = sz;
+    return (tsStrView_t){ next, (size_t) (s->curr + s->sz - next) };
+}
+
+tsStrView_t tsStrViewGetTokenAlphaNumeric(const tsStrView_t* s, tsStrView_t* result) {
+    if (!s || !result) {
+        return (tsStrView_t){ NULL, 0 };
+    }
+    uint32_t sz;
+    char const* next = tsGetTokenAlphaNumeric(s->curr, s->curr + s->sz, &result->curr, &sz);
+    result->sz = sz;
+    return (tsStrView_t){ next, (size_t) (s->curr + s->sz - next) };
+}
+
+tsStrView_t tsStrViewGetTokenAlphaNumericExt(const tsStrView_t* s, char const* ext,  tsStrView_t* result) {
+    if (!s || !result) {
+        return (tsStrView_t){ NULL, 0 };
+    }
+    uint32_t sz;
+    char const* next = tsGetTokenAlphaNumericExt(s->curr, s->curr + s->sz, ext, &result->curr, &sz);
+    result->sz = sz;
+    return (tsStrView_t){ next, (size_t) (s->curr + s->sz - next) };
+}
+
+tsStrView_t tsStrViewGetTokenExt(const tsStrView_t* s, char const* ext, tsStrView_t* result) {
+    if (!s || !result) {
+        return (tsStrView_t){ NULL, 0 };
+    }
     uint32_t sz;
     char const* next = tsGetTokenExt(s->curr, s->curr + s->sz, ext, &result->curr, &sz);
     result->sz = sz;
@@ -1363,6 +4561,39 @@ tsStrView_t tsStrViewGetNameSpacedTokenAlphaNumeric(const tsStrView_t* s, char n
     return (tsStrView_t){ next, (size_t) (s->curr + s->sz - next) };
 }
 
+tsStrView_t tsStrViewGetTokenUtf8(const tsStrView_t* s, char const* ext, tsStrView_t* result) {
+    if (!s || !result) {
+        return (tsStrView_t){ NULL, 0 };
+    }
+    uint32_t sz;
+    char const* next = tsGetTokenUtf8(s->curr, s->curr + s->sz, ext, &result->curr, &sz);
+    result->sz = sz;
+    return (tsStrView_t){ next, (size_t) (s->curr + s->sz - next) };
+}
+
+tsStrView_t tsStrViewGetNameSpacedTokenUtf8(const tsStrView_t* s, char namespaceChar, tsStrView_t* result) {
+    if (!s || !result) {
+        return (tsStrView_t){ NULL, 0 };
+    }
+    uint32_t sz;
+    char const* next = tsGetNameSpacedTokenUtf8(s->curr, s->curr + s->sz, namespaceChar, &result->curr, &sz);
+    result->sz = sz;
+    return (tsStrView_t){ next, (size_t) (s->curr + s->sz - next) };
+}
+
+tsStrView_t tsStrViewGetCodePoint(const tsStrView_t* s, uint32_t* result) {
+    if (!s || !result) {
+        return (tsStrView_t){ NULL, 0 };
+    }
+    if (s->sz == 0) {
+        *result = 0;
+        return *s;
+    }
+    char const* next;
+    *result = tsDecodeUtf8(s->curr, s->curr + s->sz, &next);
+    return (tsStrView_t){ next, (size_t) (s->curr + s->sz - next) };
+}
+
 tsStrView_t tsStrViewGetString(const tsStrView_t* s, bool recognizeEscapes, tsStrView_t* result) {
     if (!s || !result) {
         return (tsStrView_t){ NULL, 0 };
@@ -1539,21 +4770,24 @@ tsStrView_t tsStrViewScanPastCPPCommentsSkipped(const tsStrView_t* s, tsStrView_
     return (tsStrView_t){ next, (size_t) (s->curr + s->sz - next) };
 }
 
-tsStrView_t tsStrViewSkipCommentsAndWhiteSpace(const tsStrView_t* s) {
-    if (!s) {
+tsStrView_t tsStrViewSkipCommentsAndWhiteSpaceExt(const tsStrView_t* s, unsigned styles) {
+    if (!s || !s->curr) {
         return (tsStrView_t){ NULL, 0 };
     }
-    tsStrView_t result = tsStrViewScanPastCPPComments(s);
-    result = tsStrViewScanForNonWhiteSpace(&result);
-    return result;
+    char const* next = tsSkipCommentsAndWhitespaceExt(s->curr, s->curr + s->sz, styles);
+    return (tsStrView_t){ next, (size_t) (s->curr + s->sz - next) };
+}
+
+tsStrView_t tsStrViewSkipCommentsAndWhiteSpace(const tsStrView_t* s) {
+    return tsStrViewSkipCommentsAndWhiteSpaceExt(s, tsCommentCPP);
 }
 
 tsStrView_t tsStrViewSkipCommentsAndWhiteSpaceSkipped(const tsStrView_t* s, tsStrView_t* skipped) {
-    if (!s) {
-        return (tsStrView_t){ NULL, 0 };
+    tsStrView_t result = tsStrViewSkipCommentsAndWhiteSpaceExt(s, tsCommentCPP);
+    if (s && skipped) {
+        skipped->curr = s->curr;
+        skipped->sz = s->sz - result.sz;
     }
-    tsStrView_t result = tsStrViewScanPastCPPCommentsSkipped(s, skipped);
-    result = tsStrViewScanForNonWhiteSpace(&result);
     return result;
 }
 
@@ -1565,6 +4799,15 @@ tsStrView_t tsStrViewExpect(const tsStrView_t* s, const tsStrView_t* expect) {
     return (tsStrView_t){ next, (size_t) (s->curr + s->sz - next) };
 }
 
+tsStrView_t tsStrViewExpectNoCase(const tsStrView_t* s, const tsStrView_t* expect) {
+    if (!s || !expect || s->sz < expect->sz) {
+        return (tsStrView_t){ NULL, 0 };
+    }
+    if (tsMatchNoCase(s->curr, expect->curr, expect->sz) != expect->sz)
+        return *s;
+    return (tsStrView_t){ s->curr + expect->sz, s->sz - expect->sz };
+}
+
 tsStrView_t tsStrViewStrip(const tsStrView_t* s) {
     if (!s) {
         return (tsStrView_t){ NULL, 0 };
@@ -1583,165 +4826,2818 @@ tsStrView_t tsStrViewStrip(const tsStrView_t* s) {
 
 tsParsedSexpr_t* tsParsedSexpr_New() {
     tsParsedSexpr_t* result = (tsParsedSexpr_t*)malloc(sizeof(tsParsedSexpr_t));
+    TS_STAT_ADD(allocations, 1);
+    TS_STAT_ADD(bytesAllocated, sizeof(tsParsedSexpr_t));
     // the token will be Atom, since tsSeexprAtom is 0.
     memset(result, 0, sizeof(tsParsedSexpr_t));
     return result;
 }
 
-// recursive sexpr parser. returns the next tsStrView_t to parse, following the
-// final matched closed paren beginnning at the supplied input s.
-tsStrView_t tsStrViewParseSexpr(tsStrView_t* s, tsParsedSexpr_t* currCell, int balance) {
-    if (!s || !s->sz || !s->curr || !currCell)
-        return (tsStrView_t){ NULL, 0 };
+// false if the table could not grow, in which case nothing was recorded
+static bool tsSexprOffsets_Push(tsSexprOffsets_t* offsets, char const* base, char const* at) {
+    if (offsets->count == offsets->capacity) {
+        size_t capacity = offsets->capacity ? offsets->capacity * 2 : 256;
+        size_t* grown = (size_t*) realloc(offsets->offsets, capacity * sizeof(size_t));
+        if (!grown)
+            return false;
+        TS_STAT_ADD(allocations, 1);
+        TS_STAT_ADD(bytesAllocated, capacity * sizeof(size_t));
+        offsets->offsets = grown;
+        offsets->capacity = capacity;
+    }
+    offsets->offsets[offsets->count++] = (size_t)(at - base);
+    return true;
+}
 
-    tsStrView_t curr = *s;
-    while (true) {
-        curr = tsStrViewScanForNonWhiteSpace(&curr);
-        if (curr.sz == 0)
-            return curr; // parsing finished
-        if (*curr.curr == ';') {
-            curr = tsStrViewScanForBeginningOfNextLine(&curr); // Lisp comment
+void tsSexprOffsets_Free(tsSexprOffsets_t* offsets) {
+    if (!offsets)
+        return;
+    free(offsets->offsets);
+    offsets->offsets = NULL;
+    offsets->count = 0;
+    offsets->capacity = 0;
+}
+
+void tsStrViewLineColumn(const tsStrView_t* s, size_t offset, uint32_t* line, uint32_t* column) {
+    uint32_t l = 1;
+    char const* lineStart = s->curr;
+    char const* end = s->curr + (offset < s->sz ? offset : s->sz);
+    for (char const* p = s->curr; p < end; ++p) {
+        if (*p == '\n') {
+            ++l;
+            lineStart = p + 1;
+        }
+    }
+    if (line)
+        *line = l;
+    if (column)
+        *column = (uint32_t)(end - lineStart) + 1;
+}
+
+int tsSexprOpenLists(const tsStrView_t* s, size_t offset, size_t* path, int maxPath) {
+    // a stack of every open paren, so that the innermost lists can be
+    // reported. This only runs on the error path.
+    size_t stackCapacity = 64;
+    size_t* stack = (size_t*) malloc(stackCapacity * sizeof(size_t));
+    int depth = 0;
+    char const* p = s->curr;
+    char const* end = s->curr + (offset < s->sz ? offset : s->sz);
+    while (p < end) {
+        char c = *p;
+        if (c == '"') {
+            p = tsScanForQuote(p + 1, end, '"', true);
+            if (p < end)
+                ++p;
             continue;
         }
-        if (*curr.curr != '(') {
-            curr.sz = 0; // stop parsing
-            return curr; // error
+        if (c == ';') {
+            p = tsScanForEndOfLine(p, end);
+            continue;
         }
-        break;
+        if (c == '(') {
+            if ((size_t) depth == stackCapacity) {
+                size_t* grown = (size_t*) realloc(stack, stackCapacity * 2 * sizeof(size_t));
+                if (grown) {
+                    stack = grown;
+                    stackCapacity *= 2;
+                }
+            }
+            if ((size_t) depth < stackCapacity && stack)
+                stack[depth] = (size_t)(p - s->curr);
+            ++depth;
+        }
+        else if (c == ')' && depth > 0)
+            --depth;
+        ++p;
+    }
+    int count = depth < maxPath ? depth : maxPath;
+    for (int i = 0; i < count && stack; ++i) {
+        size_t level = (size_t)(depth - count + i);
+        path[i] = level < stackCapacity ? stack[level] : 0;
+    }
+    free(stack);
+    return depth;
+}
+
+char const* tsScanForTopLevelList(char const* pCurr, char const* pEnd) {
+    while (pCurr < pEnd) {
+        char const* nl = (char const*) memchr(pCurr, '\n', (size_t)(pEnd - pCurr));
+        if (!nl)
+            return pEnd;
+        pCurr = nl + 1;
+        if (pCurr < pEnd && *pCurr == '(')
+            return pCurr;
+    }
+    return pEnd;
+}
+
+void tsSexprEstimate(char const* pCurr, char const* pEnd, size_t* lists, size_t* atoms) {
+    size_t l = 0;
+    size_t a = 0;
+    bool delimited = true;
+    for (char const* p = pCurr; p < pEnd; ++p) {
+        char c = *p;
+        if (c == '(')
+            ++l;
+        bool d = tsIsSexprDelimiter(c);
+        a += delimited && !d;
+        delimited = d;
+    }
+    if (lists)
+        *lists = l;
+    if (atoms)
+        *atoms = a;
+}
+
+void tsParsedSexpr_Free(tsParsedSexpr_t* cell) {
+    while (cell) {
+        tsParsedSexpr_t* next = cell->next;
+        free(cell);
+        cell = next;
+    }
+}
+
+// Fill in error for an error at `at`; formStart is the top level list the
+// error is within, or NULL at the top level
+static void tsSexprDescribeError(tsSexprError_t* error, tsSexprErrorKind_t kind,
+                                 char const* base, char const* formStart, char const* at) {
+    error->kind = kind;
+    error->offset = (size_t)(at - base);
+    error->depth = 0;
+    error->pathCount = 0;
+    if (formStart) {
+        tsStrView_t form = { formStart, (size_t)(at - formStart) };
+        error->depth = tsSexprOpenLists(&form, form.sz, error->path, TS_SEXPR_ERROR_PATH_MAX);
+        error->pathCount = error->depth < TS_SEXPR_ERROR_PATH_MAX ? error->depth : TS_SEXPR_ERROR_PATH_MAX;
+        size_t formOffset = (size_t)(formStart - base);
+        for (int i = 0; i < error->pathCount; ++i)
+            error->path[i] += formOffset;
+    }
+}
+
+// bookkeeping for a single parse
+typedef struct {
+    char const* base;
+    tsSexprOffsets_t* offsets;
+    tsSexprError_t* error;
+    bool recover;
+    int maxDepth;
+    tsParsedSexpr_t* formMark;  // the cell preceding the current top level form
+    size_t offsetsMark;
+    char const* formStart;
+} tsSexprParseState_t;
+
+// Record an error. Returns false if parsing should stop. Otherwise the damaged
+// top level form has been discarded, *currCell rewound, and *curr positioned
+// at resume, or at the next top level list following resume when skip is set.
+static bool tsSexprParseFail(tsSexprParseState_t* st, tsSexprErrorKind_t kind, char const* at,
+                             int* balance, tsParsedSexpr_t** currCell, tsStrView_t* curr,
+                             char const* resume, bool skip) {
+    if (st->error && st->error->errorCount++ == 0)
+        tsSexprDescribeError(st->error, kind, st->base, *balance > 0 ? st->formStart : NULL, at);
+    char const* end = curr->curr + curr->sz;
+    if (!st->recover) {
+        curr->curr = end;
+        curr->sz = 0;
+        return false;
     }
+    if (*balance > 0) {
+        tsParsedSexpr_Free(st->formMark->next);
+        st->formMark->next = NULL;
+        *currCell = st->formMark;
+        if (st->offsets)
+            st->offsets->count = st->offsetsMark;
+        *balance = 0;
+    }
+    if (skip)
+        resume = tsScanForTopLevelList(resume, end);
+    curr->curr = resume;
+    curr->sz = (size_t)(end - resume);
+    return true;
+}
+
+static void tsSexprParseAppend(tsParsedSexpr_t** currCell, tsParsedSexpr_t* cell) {
+    TS_STAT_TOKEN(cell->token);
+    (*currCell)->next = cell;
+    *currCell = cell;
+}
 
-    // the loop above searched for an opening paren. now we parse the sexpr
-    currCell->next = tsParsedSexpr_New();
-    currCell->next->token = tsSexprPushList;
-    currCell = currCell->next;
-    ++balance;
+// Record the offset of the cell about to be appended. If the table cannot
+// grow, it is emptied and recording stops, rather than letting the offsets
+// that follow fall out of step with their cells.
+static void tsSexprParseOffset(tsSexprParseState_t* st, char const* at) {
+    if (st->offsets && !tsSexprOffsets_Push(st->offsets, st->base, at)) {
+        tsSexprOffsets_Free(st->offsets);
+        st->offsets = NULL;
+    }
+}
 
-    curr.curr += 1; // consume the discovered paren
-    curr.sz -= 1;
+// sexpr parser. The output is a flat list of cells, so the parse is a single
+// loop tracking the list balance, and nesting never consumes native stack.
+// Returns the remainder of the input, which is empty unless parsing stopped.
+static tsStrView_t tsStrViewParseSexprImpl(tsStrView_t* s, tsParsedSexpr_t* currCell, int balance,
+                                           tsSexprParseState_t* st) {
+    if (!s || !s->sz || !s->curr || !currCell)
+        return (tsStrView_t){ NULL, 0 };
 
+    tsStrView_t curr = *s;
     while (true) {
-        curr = tsStrViewScanForNonWhiteSpace(&curr);
-        if (curr.sz == 0)
+        curr = tsStrViewSkipCommentsAndWhiteSpaceExt(&curr, tsCommentSemicolon); // Lisp comments
+        if (curr.sz == 0) {
+            // in recovery mode, an unclosed form is dropped and parsing
+            // resumes at the first '(' beginning a line within it
+            if (balance > 0 &&
+                tsSexprParseFail(st, tsSexprErrorUnclosedList, curr.curr,
+                                 &balance, &currCell, &curr, st->formStart + 1, true))
+                continue;
             return curr; // parsing finished
-        
-        if (*curr.curr == ';') {
-            curr = tsStrViewScanForBeginningOfNextLine(&curr); // Lisp comment
-            continue;
         }
 
-        if (*curr.curr == '"') {
-            tsStrView_t str;
-            curr = tsStrViewGetString(&curr, true, &str); // parase a string, dealing with escaped characters
-            tsParsedSexpr_t* cell = tsParsedSexpr_New();
-            cell->token = tsSexprString;
-            cell->str = str;
-            currCell->next = cell;
-            currCell = cell;
-            continue;
-       }
+        char c = *curr.curr;
 
-        if (*curr.curr == ')') {
+        if (c == '(') {
+            if (balance == 0) {
+                st->formMark = currCell;
+                st->formStart = curr.curr;
+                st->offsetsMark = st->offsets ? st->offsets->count : 0;
+            }
+            if (st->maxDepth > 0 && balance >= st->maxDepth) {
+                if (!tsSexprParseFail(st, tsSexprErrorDepthExceeded, curr.curr,
+                                      &balance, &currCell, &curr, curr.curr + 1, true))
+                    return curr;
+                continue;
+            }
+            tsSexprParseOffset(st, curr.curr);
+            tsParsedSexpr_t* cell = tsParsedSexpr_New();
+            cell->token = tsSexprPushList;
+            tsSexprParseAppend(&currCell, cell);
+            ++balance;
+            TS_STAT_DEPTH(balance);
             curr.curr += 1; // consume the discovered paren
             curr.sz -= 1;
-            --balance;
-            tsParsedSexpr_t* cell = tsParsedSexpr_New();
-            cell->token = tsSexprPopList;
-            currCell->next = cell;
-            currCell = cell;
-            continue;
-        }
-
-        if (*curr.curr == '(') {
-            curr = tsStrViewParseSexpr(&curr, currCell, balance);
             continue;
         }
 
-        // consume a token, stopping at white space, parens, or semicolons
-        tsStrView_t token = curr;
-        token.sz = 0;
-        while (curr.sz > 0) {
-            if (*curr.curr == '(' || *curr.curr == ')' || *curr.curr == ';' || tsIsWhiteSpace(*curr.curr))
-                break;
-            curr.curr += 1;
+        if (c == ')') {
+            if (balance == 0) {
+                if (!tsSexprParseFail(st, tsSexprErrorUnbalancedClose, curr.curr,
+                                      &balance, &currCell, &curr, curr.curr, true))
+                    return curr;
+                continue;
+            }
+            tsSexprParseOffset(st, curr.curr);
+            tsParsedSexpr_t* cell = tsParsedSexpr_New();
+            cell->token = tsSexprPopList;
+            tsSexprParseAppend(&currCell, cell);
+            --balance;
+            curr.curr += 1; // consume the discovered paren
             curr.sz -= 1;
-            token.sz += 1;
-        }
-
-        // if there wasn't a token, it must've been a paren or semicolon, or white space
-        if (token.sz == 0)
             continue;
+        }
 
-        // try to parse the token as a float
-        float f;
-        tsStrView_t test = tsStrViewGetFloat(&token, &f);
-        if (test.curr != token.curr) {
-            tsParsedSexpr_t* cell = tsParsedSexpr_New();
-            cell->token = tsSexprFloat;
-            cell->f = f;
-            currCell->next = cell;
-            currCell = cell;
-            curr.curr = test.curr;
-            curr.sz -= test.sz;
-            curr = tsStrViewScanForNonWhiteSpace(&curr);
+        if (balance == 0) {
+            // only lists may appear at the top level
+            if (!tsSexprParseFail(st, tsSexprErrorUnexpectedCharacter, curr.curr,
+                                  &balance, &currCell, &curr, curr.curr, true))
+                return curr; // error
             continue;
         }
 
-        int32_t i;
-        test = tsStrViewGetInt32(&token, &i);
-        if (test.curr != token.curr) {
+        if (c == '"') {
+            // parse a string, dealing with escaped characters
+            char const* start = curr.curr;
+            char const* end = curr.curr + curr.sz;
+            char const* close = tsScanForQuote(start + 1, end, '"', true);
+            if (close == end) {
+                if (!tsSexprParseFail(st, tsSexprErrorUnterminatedString, start,
+                                      &balance, &currCell, &curr, start + 1, true))
+                    return curr;
+                continue;
+            }
+            tsSexprParseOffset(st, start);
             tsParsedSexpr_t* cell = tsParsedSexpr_New();
-            cell->token = tsSexprInteger;
-            cell->i = i;
-            currCell->next = cell;
-            currCell = cell;
-            curr.curr = test.curr;
-            curr.sz -= test.sz;
-            curr = tsStrViewScanForNonWhiteSpace(&curr);
+            cell->token = tsSexprString;
+            cell->str.curr = start + 1;
+            cell->str.sz = (size_t)(close - start - 1);
+            tsSexprParseAppend(&currCell, cell);
+            TS_STAT_SCAN(tsScanString, close + 1 - start);
+            curr.curr = close + 1;
+            curr.sz = (size_t)(end - curr.curr);
             continue;
         }
 
-        // assume it is an atom
+        // consume a token, stopping at white space, parens, quotes, or
+        // semicolons, and classify it in the same pass
+        char const* end = curr.curr + curr.sz;
+        tsLexeme_t lex;
+        char const* next = tsScanSexprAtom(curr.curr, end, &lex);
+        TS_STAT_SCAN(tsScanAtom, next - curr.curr);
+
+        tsSexprParseOffset(st, curr.curr);
+
         tsParsedSexpr_t* cell = tsParsedSexpr_New();
-        cell->token = tsSexprAtom;
-        cell->str = token;
-        currCell->next = cell;
-        currCell = cell;
-        // curr.curr is already pointing at the end of the atom, simply scan ahead
-        curr = tsStrViewScanForNonWhiteSpace(&curr);
+        switch (lex.kind) {
+        case tsLexInteger:
+        case tsLexHex:
+            cell->token = tsSexprInteger;
+            cell->i = lex.i;
+            break;
+        case tsLexFloat:
+            cell->token = tsSexprFloat;
+            cell->f = lex.f;
+            break;
+        default:
+            cell->token = tsSexprAtom;
+            cell->str.curr = curr.curr;
+            cell->str.sz = (size_t)(next - curr.curr);
+            break;
+        }
+        tsSexprParseAppend(&currCell, cell);
+        curr.curr = next;
+        curr.sz = (size_t)(end - next);
     }
 }
 
+tsStrView_t tsStrViewParseSexpr(tsStrView_t* s, tsParsedSexpr_t* currCell, int balance) {
+    tsSexprParseState_t st = { s ? s->curr : NULL, NULL, NULL, false, 0, currCell, 0, NULL };
+    TS_TRACE_BEGIN("tsStrViewParseSexpr");
+    tsStrView_t result = tsStrViewParseSexprImpl(s, currCell, balance, &st);
+    TS_TRACE_END();
+    return result;
+}
 
-#ifdef __cplusplus
-namespace lab { namespace Text {
-std::vector<StrView> Split(StrView s, char splitter)
-{
-    std::vector<StrView> result;
-    char const* src = s.curr;
-    char const* curr = src;
-    size_t remaining = s.sz;
-    size_t sz = 0;
-    while (remaining > 0)
-    {
-        if (*src != splitter)
-        {
-            ++sz;
-            ++src;
+tsStrView_t tsStrViewParseSexprWithOffsets(tsStrView_t* s, tsParsedSexpr_t* currCell, int balance,
+                                           tsSexprOffsets_t* offsets) {
+    tsSexprParseState_t st = { s ? s->curr : NULL, offsets, NULL, false, 0, currCell, 0, NULL };
+    TS_TRACE_BEGIN("tsStrViewParseSexpr");
+    tsStrView_t result = tsStrViewParseSexprImpl(s, currCell, balance, &st);
+    TS_TRACE_END();
+    return result;
+}
+
+tsStrView_t tsStrViewParseSexprChecked(tsStrView_t* s, tsParsedSexpr_t* currCell,
+                                       tsSexprOffsets_t* offsets, tsSexprError_t* error,
+                                       bool recover, int maxDepth) {
+    if (error)
+        memset(error, 0, sizeof(tsSexprError_t));
+    tsSexprParseState_t st = { s ? s->curr : NULL, offsets, error, recover, maxDepth, currCell,
+                               offsets ? offsets->count : 0, NULL };
+    TS_TRACE_BEGIN("tsStrViewParseSexprChecked");
+    tsStrView_t result = tsStrViewParseSexprImpl(s, currCell, 0, &st);
+    TS_TRACE_END();
+    return result;
+}
+
+tsStrView_t tsStrViewVisitSexpr(tsStrView_t* s, const tsSexprVisitor_t* visitor, void* user,
+                                tsSexprError_t* error, int maxDepth) {
+    if (error)
+        memset(error, 0, sizeof(tsSexprError_t));
+    if (!s || !s->curr || !visitor)
+        return (tsStrView_t){ NULL, 0 };
+
+    char const* base = s->curr;
+    char const* end = s->curr + s->sz;
+    char const* p = s->curr;
+    char const* formStart = p;
+    int balance = 0;
+    tsSexprErrorKind_t kind = tsSexprErrorNone;
+    while (true) {
+        p = tsSkipCommentsAndWhitespaceExt(p, end, tsCommentSemicolon);
+        if (p == end) {
+            if (balance > 0)
+                kind = tsSexprErrorUnclosedList;
+            break;
         }
-        else
-        {
-            result.push_back(StrView{curr, sz});
-            sz = 0;
-            ++src;
-            curr = src;
+        char c = *p;
+        if (c == '(') {
+            if (balance == 0)
+                formStart = p;
+            if (maxDepth > 0 && balance >= maxDepth) {
+                kind = tsSexprErrorDepthExceeded;
+                break;
+            }
+            ++balance;
+            if (visitor->onPush)
+                visitor->onPush(user);
+            ++p;
+            continue;
         }
-        --remaining;
+        if (c == ')') {
+            if (balance == 0) {
+                kind = tsSexprErrorUnbalancedClose;
+                break;
+            }
+            --balance;
+            if (visitor->onPop)
+                visitor->onPop(user);
+            ++p;
+            continue;
+        }
+        if (balance == 0) {
+            kind = tsSexprErrorUnexpectedCharacter;
+            break;
+        }
+        if (c == '"') {
+            char const* close = tsScanForQuote(p + 1, end, '"', true);
+            if (close == end) {
+                kind = tsSexprErrorUnterminatedString;
+                break;
+            }
+            if (visitor->onString)
+                visitor->onString(user, (tsStrView_t){ p + 1, (size_t)(close - p - 1) });
+            p = close + 1;
+            continue;
+        }
+        tsLexeme_t lex;
+        char const* next = tsScanSexprAtom(p, end, &lex);
+        switch (lex.kind) {
+        case tsLexInteger:
+        case tsLexHex:
+            if (visitor->onInt)
+                visitor->onInt(user, lex.i);
+            break;
+        case tsLexFloat:
+            if (visitor->onFloat)
+                visitor->onFloat(user, lex.f);
+            break;
+        default:
+            if (visitor->onAtom)
+                visitor->onAtom(user, (tsStrView_t){ p, (size_t)(next - p) });
+            break;
+        }
+        p = next;
     }
 
-    // capture last crumb
-    if (sz > 0)
-        result.push_back(StrView{curr, sz});
+    if (kind != tsSexprErrorNone && error) {
+        error->errorCount = 1;
+        tsSexprDescribeError(error, kind, base, balance > 0 ? formStart : NULL, p);
+    }
+    return (tsStrView_t){ p, (size_t)(end - p) };
+}
+
+#ifdef LABTEXT_INSTRUMENT
+
+#if defined(__cplusplus)
+#define TS_THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+#define TS_THREAD_LOCAL __declspec(thread)
+#else
+#define TS_THREAD_LOCAL __thread
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include <stdio.h>
+
+static TS_THREAD_LOCAL tsParseStats_t tsThreadStats;
+
+tsParseStats_t* tsParseStats(void) {
+    return &tsThreadStats;
+}
+
+void tsParseStatsReset(void) {
+    memset(&tsThreadStats, 0, sizeof(tsThreadStats));
+}
+
+typedef struct {
+    char const* name;
+    uint64_t begin;     // nanoseconds
+    uint64_t end;
+} tsTraceEvent_t;
+
+#define TS_TRACE_MAX_EVENTS (1 << 20)
+#define TS_TRACE_MAX_DEPTH 64
+
+typedef struct {
+    tsTraceEvent_t* events;
+    size_t count;
+    size_t capacity;
+    size_t open[TS_TRACE_MAX_DEPTH];    // the events begun and not yet ended
+    int depth;
+} tsTraceLog_t;
+
+static TS_THREAD_LOCAL tsTraceLog_t tsThreadTrace;
+static tsTraceHooks_t tsTraceHooks;
+
+static uint64_t tsTraceNow(void) {
+#ifdef _WIN32
+    LARGE_INTEGER t, f;
+    QueryPerformanceCounter(&t);
+    QueryPerformanceFrequency(&f);
+    return (uint64_t)((double) t.QuadPart * 1e9 / (double) f.QuadPart);
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000ull + (uint64_t) t.tv_nsec;
+#elif defined(TIME_UTC)
+    // strict C11 without POSIX
+    struct timespec t;
+    timespec_get(&t, TIME_UTC);
+    return (uint64_t) t.tv_sec * 1000000000ull + (uint64_t) t.tv_nsec;
+#else
+    return (uint64_t)((double) clock() * 1e9 / CLOCKS_PER_SEC);
+#endif
+}
+
+void tsTraceSetHooks(const tsTraceHooks_t* hooks) {
+    if (hooks)
+        tsTraceHooks = *hooks;
+    else
+        memset(&tsTraceHooks, 0, sizeof(tsTraceHooks));
+}
+
+void tsTraceBegin(char const* name) {
+    if (tsTraceHooks.begin)
+        tsTraceHooks.begin(tsTraceHooks.user, name);
+    tsTraceLog_t* log = &tsThreadTrace;
+    size_t index = (size_t) -1;
+    if (log->count == log->capacity && log->capacity < TS_TRACE_MAX_EVENTS) {
+        size_t capacity = log->capacity ? log->capacity * 2 : 1024;
+        tsTraceEvent_t* grown = (tsTraceEvent_t*) realloc(log->events, capacity * sizeof(tsTraceEvent_t));
+        if (grown) {
+            log->events = grown;
+            log->capacity = capacity;
+        }
+    }
+    if (log->count < log->capacity) {
+        // events past the limit are dropped, but still nest
+        index = log->count++;
+        log->events[index].name = name;
+        log->events[index].begin = tsTraceNow();
+        log->events[index].end = 0;
+    }
+    if (log->depth < TS_TRACE_MAX_DEPTH)
+        log->open[log->depth] = index;
+    ++log->depth;
+}
+
+void tsTraceEnd(void) {
+    tsTraceLog_t* log = &tsThreadTrace;
+    if (log->depth == 0)
+        return;
+    --log->depth;
+    char const* name = NULL;
+    if (log->depth < TS_TRACE_MAX_DEPTH && log->open[log->depth] != (size_t) -1) {
+        tsTraceEvent_t* e = &log->events[log->open[log->depth]];
+        e->end = tsTraceNow();
+        name = e->name;
+    }
+    if (tsTraceHooks.end)
+        tsTraceHooks.end(tsTraceHooks.user, name);
+}
+
+_Bool tsTraceWriteChrome(char const* path) {
+    FILE* f = fopen(path, "w");
+    if (!f)
+        return false;
+    tsTraceLog_t* log = &tsThreadTrace;
+    uint64_t origin = log->count ? log->events[0].begin : 0;
+    unsigned tid = (unsigned)(((uintptr_t) log >> 4) & 0xffff);
+    fprintf(f, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (size_t i = 0; i < log->count; ++i) {
+        tsTraceEvent_t const* e = &log->events[i];
+        if (!e->end)
+            continue;   // still open
+        fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"LabText\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                first ? "" : ",\n", e->name, (double)(e->begin - origin) / 1000.0,
+                (double)(e->end - e->begin) / 1000.0, tid);
+        first = false;
+    }
+    fprintf(f, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    return fclose(f) == 0;
+}
+
+void tsTraceClear(void) {
+    tsTraceLog_t* log = &tsThreadTrace;
+    free(log->events);
+    memset(log, 0, sizeof(*log));
+}
+
+#endif // LABTEXT_INSTRUMENT
+
+#if defined(__cplusplus) && defined(LABTEXT_SEXPR_CACHE)
+#include <filesystem>
+#include <random>
+#include <stdio.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LABTEXT_MMAP
+#endif
+#endif
+
+#ifdef __cplusplus
+#include <thread>
+#include <unordered_map>
+
+namespace lab { namespace Text {
+std::vector<StrView> Split(StrView s, char splitter)
+{
+    std::vector<StrView> result;
+    char const* curr = s.curr;
+    char const* end = s.curr + s.sz;
+    while (curr < end)
+    {
+        char const* next = tsScanForCharacter(curr, end, splitter);
+        if (next == end)
+            break;
+        result.push_back(StrView{curr, (size_t)(next - curr)});
+        curr = next + 1;
+    }
+
+    // capture last crumb
+    if (curr < end)
+        result.push_back(StrView{curr, (size_t)(end - curr)});
+
+    return result;
+}
+
+// the number of threads to give s; below a few megabytes each, starting a
+// thread costs more than it saves
+static unsigned LineThreads(size_t sz, unsigned threads)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    size_t most = sz / (4u << 20) + 1;
+    if (threads > most)
+        threads = (unsigned) most;
+    return threads ? threads : 1;
+}
+
+// runs fn(k) for each k in [0, count), on count - 1 new threads and this one
+template <class F>
+static void RunOnThreads(unsigned count, F const& fn)
+{
+    std::vector<std::thread> pool;
+    for (unsigned k = 1; k < count; ++k)
+        pool.emplace_back([&fn, k]() { fn(k); });
+    fn(0);
+    for (auto& t : pool)
+        t.join();
+}
+
+size_t CountLines(StrView s, unsigned threads)
+{
+    if (s.sz == 0)
+        return 0;
+    threads = LineThreads(s.sz, threads);
+    std::vector<size_t> counts(threads);
+    size_t step = s.sz / threads;
+    RunOnThreads(threads, [&](unsigned k) {
+        char const* begin = s.curr + k * step;
+        char const* end = k + 1 == threads ? s.curr + s.sz : begin + step;
+        counts[k] = tsCountCharacter(begin, end, '\n');
+    });
+    size_t total = s.curr[s.sz - 1] != '\n';
+    for (size_t c : counts)
+        total += c;
+    return total;
+}
+
+std::vector<size_t> LineOffsets(StrView s, unsigned threads)
+{
+    std::vector<size_t> result;
+    if (s.sz == 0)
+        return result;
+    threads = LineThreads(s.sz, threads);
+    size_t step = s.sz / threads;
+    auto range = [&](unsigned k, char const*& begin, char const*& end) {
+        begin = s.curr + k * step;
+        end = k + 1 == threads ? s.curr + s.sz : begin + step;
+    };
+
+    // the line starts of each range, which follow its newlines; a final
+    // newline starts no line
+    std::vector<size_t> firsts(threads + 1);
+    RunOnThreads(threads, [&](unsigned k) {
+        char const* begin;
+        char const* end;
+        range(k, begin, end);
+        firsts[k + 1] = tsCountCharacter(begin, end, '\n');
+    });
+    firsts[0] = 1;
+    firsts[threads] -= s.curr[s.sz - 1] == '\n';
+    for (unsigned k = 1; k <= threads; ++k)
+        firsts[k] += firsts[k - 1];
+
+    result.resize(firsts[threads]);
+    result[0] = 0;
+    RunOnThreads(threads, [&](unsigned k) {
+        char const* begin;
+        char const* end;
+        range(k, begin, end);
+        size_t* out = result.data() + firsts[k];
+        size_t* last = result.data() + firsts[k + 1];
+        char const* p = begin;
+#ifdef LABTEXT_SIMD
+        for (; end - p >= 16 && out < last; p += 16)
+            for (uint32_t m = tsEitherMask16(p, '\n', '\n'); m && out < last; m &= m - 1)
+                *out++ = (size_t)(p - s.curr) + tsCtz32(m) + 1;
+#endif
+        for (; p < end && out < last; ++p)
+            if (*p == '\n')
+                *out++ = (size_t)(p - s.curr) + 1;
+    });
+    return result;
+}
+
+std::vector<StrView> SplitLines(StrView s, unsigned threads)
+{
+    std::vector<size_t> starts = LineOffsets(s, threads);
+    std::vector<StrView> result(starts.size());
+    if (starts.empty())
+        return result;
+    // every line but the last ends one before the next begins
+    size_t last = starts.size() - 1;
+    size_t end = s.sz - (s.curr[s.sz - 1] == '\n');
+    threads = LineThreads(s.sz, threads);
+    size_t step = starts.size() / threads;
+    RunOnThreads(threads, [&](unsigned k) {
+        size_t i = k * step;
+        size_t stop = k + 1 == threads ? starts.size() : i + step;
+        for (; i < stop; ++i) {
+            size_t lineEnd = i < last ? starts[i + 1] - 1 : end;
+            result[i] = StrView(s.curr + starts[i], lineEnd - starts[i]);
+        }
+    });
+    return result;
+}
+
+template <class T, class Fn>
+static StrView ParseNumberArrayImpl(StrView s, tsNumberSeparator_t separator, std::vector<T>& result, Fn parse)
+{
+    char const* curr = s.curr;
+    char const* end = s.curr + s.sz;
+    while (true) {
+        // convert straight into the vector, growing it a chunk at a time
+        size_t base = result.size();
+        size_t chunk = base < 1024 ? 1024 : base;
+        result.resize(base + chunk);
+        size_t count = 0;
+        char const* next = parse(curr, end, result.data() + base, chunk, &count);
+        result.resize(base + count);
+        if (count < chunk)
+            return StrView(next, (size_t)(end - next));
+        // the chunk filled; continue after the separator that follows
+        curr = tsSkipNumberSeparator(next, end, separator);
+        if (curr == next)
+            return StrView(next, (size_t)(end - next));
+    }
+}
+
+StrView ParseNumberArray(StrView s, tsNumberSeparator_t separator, std::vector<double>& result)
+{
+    return ParseNumberArrayImpl(s, separator, result, [separator](char const* p, char const* e, double* out, size_t cap, size_t* n) {
+        return tsGetDoubleArray(p, e, separator, out, cap, n);
+    });
+}
+
+StrView ParseNumberArray(StrView s, tsNumberSeparator_t separator, std::vector<int64_t>& result)
+{
+    return ParseNumberArrayImpl(s, separator, result, [separator](char const* p, char const* e, int64_t* out, size_t cap, size_t* n) {
+        return tsGetInt64Array(p, e, separator, out, cap, n);
+    });
+}
+
+template <class Fn>
+static StrView DecodeBlob(StrView s, std::vector<uint8_t>& result, size_t capacity, Fn decode)
+{
+    size_t before = result.size();
+    result.resize(before + capacity);
+    size_t count = 0;
+    char const* next = decode(s.curr, s.curr + s.sz, result.data() + before, capacity, &count);
+    result.resize(before + count);
+    return StrView(next, (size_t)(s.curr + s.sz - next));
+}
+
+StrView DecodeHex(StrView s, std::vector<uint8_t>& result)
+{
+    return DecodeBlob(s, result, s.sz / 2, tsDecodeHex);
+}
+
+StrView DecodeBase64(StrView s, std::vector<uint8_t>& result)
+{
+    return DecodeBlob(s, result, s.sz / 4 * 3 + 2, tsDecodeBase64);
+}
+
+std::string EncodeHex(uint8_t const* data, size_t sz)
+{
+    std::string result(sz * 2, '\0');
+    tsEncodeHex(data, sz, &result[0]);
+    return result;
+}
+
+std::string EncodeBase64(uint8_t const* data, size_t sz)
+{
+    std::string result((sz + 2) / 3 * 4, '\0');
+    tsEncodeBase64(data, sz, &result[0]);
+    return result;
+}
+
+// the first a, b or c at or after p, or end
+static char const* ScanForAnyOf3(char const* p, char const* end, char a, char b, char c)
+{
+#ifdef LABTEXT_SIMD
+    for (; end - p >= 16; p += 16) {
+        uint32_t m = tsAnyOf3Mask16(p, a, b, c);
+        if (m)
+            return p + tsCtz32(m);
+    }
+#endif
+    while (p < end && *p != a && *p != b && *p != c)
+        ++p;
+    return p;
+}
+
+bool DelimitedReader::Next(std::vector<StrView>& fields)
+{
+    fields.clear();
+    while (curr < end && (*curr == '\n' || *curr == '\r'))
+        ++curr;
+    if (curr == end)
+        return false;
+
+    while (true) {
+        char const* p = curr;
+        if (p < end && *p == quote) {
+            char const* close = ++p;
+            while (true) {
+                close = ScanForAnyOf3(close, end, quote, quote, quote);
+                if (end - close >= 2 && close[1] == quote)
+                    close += 2;     // a doubled quote
+                else
+                    break;
+            }
+            fields.push_back(StrView(p, (size_t)(close - p)));
+            if (close == end)
+                unterminated = true;
+            else
+                ++close;
+            // anything between the closing quote and the delimiter is dropped
+            p = ScanForAnyOf3(close, end, delimiter, '\n', '\r');
+        }
+        else {
+            p = ScanForAnyOf3(p, end, delimiter, '\n', '\r');
+            fields.push_back(StrView(curr, (size_t)(p - curr)));
+        }
+
+        if (p < end && *p == delimiter) {
+            curr = p + 1;
+            continue;
+        }
+        if (p < end)
+            p += (*p == '\r' && end - p >= 2 && p[1] == '\n') ? 2 : 1;
+        curr = p;
+        return true;
+    }
+}
+
+std::vector<StrView> DelimitedReader::Chunks(StrView s, size_t count, char quote)
+{
+    std::vector<StrView> result;
+    char const* end = s.curr + s.sz;
+    char const* start = s.curr;
+    char const* p = s.curr;
+    bool quoted = false;
+    size_t step = count ? s.sz / count : s.sz;
+    for (size_t k = 1; k < count && step; ++k) {
+        char const* target = s.curr + k * step;
+        if (target <= p)
+            continue;
+        quoted ^= tsCountCharacter(p, target, quote) & 1;
+        p = target;
+        // move on to the first line break outside quotes
+        while (p < end) {
+            p = ScanForAnyOf3(p, end, quote, '\n', '\n');
+            if (p == end)
+                break;
+            if (*p++ == quote)
+                quoted = !quoted;
+            else if (!quoted)
+                break;
+        }
+        if (p == end)
+            break;
+        result.push_back(StrView(start, (size_t)(p - start)));
+        start = p;
+    }
+    result.push_back(StrView(start, (size_t)(end - start)));
+    return result;
+}
+
+// the field without surrounding white space
+static StrView StripField(StrView field)
+{
+    char const* p = field.curr;
+    char const* e = field.curr + field.sz;
+    p = tsScanForNonWhiteSpace(p, e);
+    while (e > p && tsIsWhiteSpace(e[-1]))
+        --e;
+    return StrView(p, (size_t)(e - p));
+}
+
+bool DelimitedReader::GetInt(StrView field, int64_t& result)
+{
+    field = StripField(field);
+    tsLexeme_t lex;
+    if (!field.sz || tsScanSexprAtom(field.curr, field.curr + field.sz, &lex) != field.curr + field.sz)
+        return false;
+    if (lex.kind != tsLexInteger && lex.kind != tsLexHex)
+        return false;
+    result = lex.i;
+    return true;
+}
+
+bool DelimitedReader::GetDouble(StrView field, double& result)
+{
+    field = StripField(field);
+    tsLexeme_t lex;
+    if (!field.sz || tsScanSexprAtom(field.curr, field.curr + field.sz, &lex) != field.curr + field.sz)
+        return false;
+    if (lex.kind == tsLexAtom)
+        return false;
+    result = lex.kind == tsLexFloat ? lex.f : (double) lex.i;
+    return true;
+}
+
+void DelimitedReader::Unescape(StrView field, std::string& result, char quote)
+{
+    result.clear();
+    char const* p = field.curr;
+    char const* end = field.curr + field.sz;
+    while (p < end) {
+        char const* q = ScanForAnyOf3(p, end, quote, quote, quote);
+        if (q == end) {
+            result.append(p, (size_t)(end - p));
+            return;
+        }
+        result.append(p, (size_t)(q + 1 - p));
+        p = q + 1;
+        if (p < end && *p == quote)
+            ++p;    // the second of a doubled quote
+    }
+}
+
+// [p, e) without white space at either end
+static StrView StripRange(char const* p, char const* e)
+{
+    while (p < e && tsIsWhiteSpace(*p))
+        ++p;
+    while (e > p && tsIsWhiteSpace(e[-1]))
+        --e;
+    return StrView(p, (size_t)(e - p));
+}
+
+// the end of an unquoted config value in [p, eol): a ; or # following white
+// space, or eol. blank says whether p itself follows white space or begins
+// a line, as the blanks before p have already been skipped.
+static char const* ConfigValueEnd(char const* p, char const* eol, bool blank)
+{
+    for (char const* c = p; ; ++c) {
+        c = ScanForAnyOf3(c, eol, ';', '#', '#');
+        if (c == eol || (c > p ? c[-1] == ' ' || c[-1] == '\t' : blank))
+            return c;
+    }
+}
+
+static uint64_t ConfigHash(StrView section, StrView key)
+{
+    return tsHashBytes(key.curr, key.sz, tsHashBytes(section.curr, section.sz, 0));
+}
+
+Config::Config(StrView s)
+{
+    TS_TRACE_SCOPE("Config");
+    char const* p = s.curr;
+    char const* end = s.curr + s.sz;
+    std::vector<int> sectionOf;                          // per entry
+    std::vector<std::pair<size_t, size_t>> continued;    // entry, offset into joined
+    sectionTable.assign(16, 0);
+    int section = AddSection(StrView(p, 0));
+    while (true) {
+        p = tsSkipCommentsAndWhitespaceExt(p, end, tsCommentSemicolon | tsCommentHash);
+        if (p == end)
+            break;
+        char const* eol = tsScanForEither(p, end, '\n', '\r');
+        if (*p == '[') {
+            char const* close = (char const*) memchr(p, ']', (size_t)(eol - p));
+            if (!close) {
+                errors.push_back((size_t)(p - s.curr));
+                p = eol;
+                continue;
+            }
+            section = AddSection(StripRange(p + 1, close));
+            p = eol;
+            continue;
+        }
+
+        char const* separator = ScanForAnyOf3(p, eol, '=', ':', '=');
+        if (separator == eol) {
+            errors.push_back((size_t)(p - s.curr));
+            p = eol;
+            continue;
+        }
+        Entry entry;
+        entry.section = sections[(size_t) section];
+        entry.key = StripRange(p, separator);
+        char const* v = separator + 1;
+        while (v < eol && (*v == ' ' || *v == '\t'))
+            ++v;
+
+        if (v < eol && *v == '"') {
+            char const* close = tsScanForQuote(v + 1, eol, '"', true);
+            if (close == eol) {
+                errors.push_back((size_t)(p - s.curr));
+                p = eol;
+                continue;
+            }
+            entry.value = StrView(v + 1, (size_t)(close - v - 1));
+        }
+        else {
+            entry.value = StripRange(v, ConfigValueEnd(v, eol, v > separator + 1));
+            char const* last = entry.value.curr + entry.value.sz;
+            if (entry.value.sz && last[-1] == '\\') {
+                // join the continuation lines into the owned buffer
+                size_t offset = joined.size();
+                joined.insert(joined.end(), entry.value.curr, last - 1);
+                while (true) {
+                    char const* next = eol;
+                    if (next < end)
+                        next += (*next == '\r' && end - next >= 2 && next[1] == '\n') ? 2 : 1;
+                    eol = tsScanForEither(next, end, '\n', '\r');
+                    StrView more = StripRange(next, ConfigValueEnd(next, eol, true));
+                    char const* moreEnd = more.curr + more.sz;
+                    bool again = more.sz && moreEnd[-1] == '\\' && eol < end;
+                    joined.insert(joined.end(), more.curr, again ? moreEnd - 1 : moreEnd);
+                    if (!again)
+                        break;
+                }
+                continued.push_back({ entries.size(), offset });
+                entry.value = StrView(nullptr, joined.size() - offset);
+            }
+        }
+        entries.push_back(entry);
+        sectionOf.push_back(section);
+        p = eol;
+    }
+    for (auto const& c : continued)
+        entries[c.first].value.curr = joined.data() + c.second;
+
+    // group the entries by section, keeping their order within each
+    size_t count = sections.size();
+    sectionStart.assign(count + 1, 0);
+    for (int sec : sectionOf)
+        ++sectionStart[(size_t) sec + 1];
+    for (size_t i = 0; i < count; ++i)
+        sectionStart[i + 1] += sectionStart[i];
+    std::vector<Entry> grouped(entries.size());
+    std::vector<size_t> fill(sectionStart.begin(), sectionStart.end() - 1);
+    for (size_t i = 0; i < entries.size(); ++i)
+        grouped[fill[(size_t) sectionOf[i]]++] = entries[i];
+    entries.swap(grouped);
+
+    // index by section and key; a later entry replaces an earlier one
+    size_t capacity = 16;
+    while (capacity < entries.size() * 2)
+        capacity *= 2;
+    size_t mask = capacity - 1;
+    table.assign(capacity, 0);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        Entry const& e = entries[i];
+        size_t slot = (size_t) ConfigHash(e.section, e.key) & mask;
+        while (int existing = table[slot]) {
+            Entry const& other = entries[(size_t) existing - 1];
+            if (other.key == e.key && other.section == e.section)
+                break;
+            slot = (slot + 1) & mask;
+        }
+        table[slot] = (int) i + 1;
+    }
+}
+
+int Config::FindSection(StrView name) const
+{
+    size_t mask = sectionTable.size() - 1;
+    size_t slot = (size_t) tsHashBytes(name.curr, name.sz, 0) & mask;
+    while (int entry = sectionTable[slot]) {
+        if (sections[(size_t) entry - 1] == name)
+            return entry - 1;
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+int Config::AddSection(StrView name)
+{
+    int found = FindSection(name);
+    if (found >= 0)
+        return found;
+    sections.push_back(name);
+    if (sections.size() * 2 > sectionTable.size()) {
+        // keep the table at most half full
+        sectionTable.assign(sectionTable.size() * 2, 0);
+        size_t mask = sectionTable.size() - 1;
+        for (size_t i = 0; i < sections.size(); ++i) {
+            size_t slot = (size_t) tsHashBytes(sections[i].curr, sections[i].sz, 0) & mask;
+            while (sectionTable[slot])
+                slot = (slot + 1) & mask;
+            sectionTable[slot] = (int) i + 1;
+        }
+        return (int) sections.size() - 1;
+    }
+    size_t mask = sectionTable.size() - 1;
+    size_t slot = (size_t) tsHashBytes(name.curr, name.sz, 0) & mask;
+    while (sectionTable[slot])
+        slot = (slot + 1) & mask;
+    sectionTable[slot] = (int) sections.size();
+    return (int) sections.size() - 1;
+}
+
+Config::Range Config::Section(StrView section) const
+{
+    Range result;
+    int i = FindSection(section);
+    if (i >= 0) {
+        result.first = entries.data() + sectionStart[(size_t) i];
+        result.last = entries.data() + sectionStart[(size_t) i + 1];
+    }
+    return result;
+}
+
+Config::Entry const* Config::Find(StrView section, StrView key) const
+{
+    size_t mask = table.size() - 1;
+    size_t slot = (size_t) ConfigHash(section, key) & mask;
+    while (int entry = table[slot]) {
+        Entry const& e = entries[(size_t) entry - 1];
+        if (e.key == key && e.section == section)
+            return &e;
+        slot = (slot + 1) & mask;
+    }
+    return nullptr;
+}
+
+bool Config::GetString(StrView section, StrView key, StrView& result) const
+{
+    Entry const* e = Find(section, key);
+    if (!e)
+        return false;
+    result = e->value;
+    return true;
+}
+
+bool Config::GetInt32(StrView section, StrView key, int32_t& result) const
+{
+    Entry const* e = Find(section, key);
+    if (!e || !e->value.sz)
+        return false;
+    int32_t value = 0;
+    char const* end = e->value.curr + e->value.sz;
+    if (tsGetInt32(e->value.curr, end, &value) != end)
+        return false;
+    result = value;
+    return true;
+}
+
+bool Config::GetFloat(StrView section, StrView key, float& result) const
+{
+    Entry const* e = Find(section, key);
+    if (!e || !e->value.sz)
+        return false;
+    float value = 0;
+    char const* end = e->value.curr + e->value.sz;
+    if (tsGetFloat(e->value.curr, end, &value) != end)
+        return false;
+    result = value;
+    return true;
+}
+
+bool Config::GetBool(StrView section, StrView key, bool& result) const
+{
+    Entry const* e = Find(section, key);
+    if (!e)
+        return false;
+    static char const* const names[] = { "true", "yes", "on", "1", "false", "no", "off", "0" };
+    for (int i = 0; i < 8; ++i)
+        if (e->value == StrView(names[i], strlen(names[i]))) {
+            result = i < 4;
+            return true;
+        }
+    return false;
+}
+
+SexprError MakeSexprError(tsSexprErrorKind_t kind, char const* base, char const* formStart, char const* at)
+{
+    SexprError err;
+    err.kind = kind;
+    err.offset = (size_t)(at - base);
+    if (formStart) {
+        tsStrView_t form = { formStart, (size_t)(at - formStart) };
+        int depth = tsSexprOpenLists(&form, form.sz, nullptr, 0);
+        err.path.resize(depth);
+        tsSexprOpenLists(&form, form.sz, err.path.data(), depth);
+        for (auto& o : err.path)
+            o += (size_t)(formStart - base);
+    }
+    return err;
+}
+
+void SexprParser::Reset()
+{
+    // moving a string out keeps its buffer alive in the spare pool
+    for (auto& str : result.strings)
+        spare.push_back(std::move(str));
+    result.strings.clear();
+    result.expr.clear();
+    result.ints.clear();
+    result.floats.clear();
+    result.offsets.clear();
+    result.errors.clear();
+    result.balance = 0;
+    result.unreferenced = 0;
+}
+
+void SexprParser::Reserve(StrView s, bool trackOffsets)
+{
+    size_t lists, atoms;
+    tsSexprEstimate(s.curr, s.curr + s.sz, &lists, &atoms);
+    // every list contributes a push and a pop, every atom at most one value
+    size_t elems = lists * 2 + atoms;
+    result.expr.reserve(elems);
+    if (trackOffsets)
+        result.offsets.reserve(elems);
+    result.ints.reserve(atoms);
+    result.floats.reserve(atoms);
+    result.strings.reserve(atoms);
+    spare.reserve(atoms);
+    if (s.sz > reserved)
+        reserved = s.sz;
+}
+
+Sexpr const& SexprParser::Parse(StrView s)
+{
+    return Parse(s, SexprOptions());
+}
+
+Sexpr const& SexprParser::Parse(StrView s, SexprOptions const& options)
+{
+    Reset();
+    if (s.sz > reserved || (options.trackOffsets && result.offsets.capacity() < result.expr.capacity()))
+        Reserve(s, options.trackOffsets);
+    result.Parse(s, options, &spare);
+    return result;
+}
+
+void SexprTokenizer::Feed(StrView s)
+{
+    chunkOffset += (size_t)(chunkEnd - chunk);
+    chunk = p = s.curr;
+    chunkEnd = s.curr + s.sz;
+    if (carrying == CarryNone || p == chunkEnd)
+        return;
+
+    // complete the element that the previous chunk ended within
+    char const* stop = chunkEnd;
+    if (carrying == CarryComment) {
+        char const* nl = (char const*) memchr(p, '\n', (size_t)(chunkEnd - p));
+        if (nl) {
+            stop = nl + 1;
+            carrying = CarryNone;
+        }
+        p = stop;
+        return;
+    }
+    if (carrying == CarryAtom) {
+        tsLexeme_t lex;
+        stop = tsScanSexprAtom(p, chunkEnd, &lex);
+        carryReady = stop < chunkEnd;
+    }
+    else {
+        // an odd run of backslashes at the end of the carry escapes the
+        // first character of this chunk
+        size_t slashes = 0;
+        for (size_t i = carry.size(); i > 1 && carry[i - 1] == '\\'; --i)
+            ++slashes;
+        char const* q = p + (slashes & 1);
+        if (q < chunkEnd) {
+            q = tsScanForQuote(q, chunkEnd, '"', true);
+            if (q < chunkEnd) {
+                stop = q + 1;
+                carryReady = true;
+            }
+        }
+    }
+    carry.append(p, stop);
+    p = stop;
+}
+
+void SexprTokenizer::Finish()
+{
+    finished = true;
+    if (carrying == CarryAtom || carrying == CarryString)
+        carryReady = true;
+    carrying = CarryNone;
+}
+
+SexprTokenizer::Status SexprTokenizer::Fail(tsSexprErrorKind_t kind, size_t offset)
+{
+    error.kind = kind;
+    error.offset = offset;
+    return status = Error;
+}
+
+SexprTokenizer::Status SexprTokenizer::Element(SexprToken& tok, char const* at, char const* next)
+{
+    size_t offset = at == carry.data() ? carryOffset : chunkOffset + (size_t)(at - chunk);
+    if (!next)
+        return Fail(balance == 0 ? tsSexprErrorUnexpectedCharacter : tsSexprErrorUnterminatedString, offset);
+    tok.offset = offset;
+    switch (tok.token) {
+    case tsSexprPushList:
+        if (maxDepth && balance >= maxDepth)
+            return Fail(tsSexprErrorDepthExceeded, offset);
+        ++balance;
+        break;
+    case tsSexprPopList:
+        if (balance == 0)
+            return Fail(tsSexprErrorUnbalancedClose, offset);
+        --balance;
+        break;
+    default:
+        if (balance == 0)
+            return Fail(tsSexprErrorUnexpectedCharacter, offset);
+        break;
+    }
+    return status = Token;
+}
+
+SexprTokenizer::Status SexprTokenizer::Next(SexprToken& tok)
+{
+    if (status == Error || status == End)
+        return status;
+
+    if (carryReady) {
+        carryReady = false;
+        carrying = CarryNone;
+        char const* next = ScanSexprToken(carry.data(), carry.data() + carry.size(), tok);
+        return Element(tok, carry.data(), next);
+    }
+
+    while (true) {
+        if (p < chunkEnd)
+            p = tsScanForNonWhiteSpace(p, chunkEnd);
+        if (p == chunkEnd) {
+            if (!finished)
+                return status = NeedInput;
+            if (balance > 0)
+                return Fail(tsSexprErrorUnclosedList, chunkOffset + (size_t)(p - chunk));
+            return status = End;
+        }
+        if (*p == ';') {
+            char const* nl = (char const*) memchr(p, '\n', (size_t)(chunkEnd - p));
+            if (!nl && !finished)
+                carrying = CarryComment;
+            p = nl ? nl + 1 : chunkEnd;
+            continue;
+        }
+
+        char const* at = p;
+        char const* next = ScanSexprToken(at, chunkEnd, tok);
+        bool open = !next || (next == chunkEnd && tok.token != tsSexprPushList &&
+                              tok.token != tsSexprPopList && tok.token != tsSexprString);
+        if (open && !finished) {
+            // the element may continue in the next chunk
+            carrying = next ? CarryAtom : CarryString;
+            carryOffset = chunkOffset + (size_t)(at - chunk);
+            carry.assign(at, chunkEnd);
+            p = chunkEnd;
+            return status = NeedInput;
+        }
+        p = next ? next : chunkEnd;
+        return Element(tok, at, next);
+    }
+}
+
+LineIndex::LineIndex(StrView s)
+    : lineStarts(LineOffsets(s, 1))
+{
+    // a final newline, or empty input, still begins a line for Locate
+    if (s.sz == 0 || s.curr[s.sz - 1] == '\n')
+        lineStarts.push_back(s.sz);
+}
+
+SourceLocation LineIndex::Locate(size_t offset) const
+{
+    // the last line start at or before offset
+    size_t lo = 0;
+    size_t hi = lineStarts.size();
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (lineStarts[mid] <= offset)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    SourceLocation result;
+    result.offset = offset;
+    result.line = (uint32_t)(lo + 1);
+    result.column = (uint32_t)(offset - lineStarts[lo] + 1);
+    return result;
+}
+
+// The list enclosing element i, or i itself if it opens a list, found by
+// walking back over its elder siblings. -1 at the top level.
+static int EnclosingList(std::vector<Sexpr::Elem> const& expr, int i)
+{
+    int balance = 0;
+    for (; i >= 0; --i) {
+        if (expr[i].token == tsSexprPopList)
+            ++balance;
+        else if (expr[i].token == tsSexprPushList) {
+            if (balance == 0)
+                return i;
+            --balance;
+        }
+    }
+    return -1;
+}
+
+static int MatchingPop(std::vector<Sexpr::Elem> const& expr, int list)
+{
+    int balance = 0;
+    for (int i = list; i < (int) expr.size(); ++i) {
+        if (expr[i].token == tsSexprPushList)
+            ++balance;
+        else if (expr[i].token == tsSexprPopList && --balance == 0)
+            return i;
+    }
+    return (int) expr.size() - 1;
+}
+
+// the top level list that element i is within
+static int TopLevelList(std::vector<Sexpr::Elem> const& expr, int i)
+{
+    int form = -1;
+    for (int list = EnclosingList(expr, i); list >= 0; list = EnclosingList(expr, list - 1))
+        form = list;
+    if (form >= 0)
+        return form;
+    // i closes a top level list
+    int balance = 0;
+    for (; i >= 0; --i) {
+        if (expr[i].token == tsSexprPopList)
+            ++balance;
+        else if (expr[i].token == tsSexprPushList && --balance == 0)
+            break;
+    }
+    return i;
+}
+
+bool Sexpr::Reparse(StrView source, SexprEdit const& edit, SexprOptions const& options)
+{
+    TS_TRACE_SCOPE("Sexpr::Reparse");
+    SexprOptions opts = options;
+    opts.trackOffsets = true;
+    int n = (int) expr.size();
+    // JSON is always parsed again whole
+    if (!opts.json && errors.empty() && n > 0 && offsets.size() == expr.size() && unreferenced <= expr.size()) {
+        ptrdiff_t delta = (ptrdiff_t) edit.inserted - (ptrdiff_t) edit.removed;
+        size_t editEnd = edit.offset + edit.removed;
+
+        // k elements start before the edit; try the lists enclosing the
+        // last of them, innermost first, whose close survived the edit
+        int k = (int)(std::lower_bound(offsets.begin(), offsets.end(), edit.offset) - offsets.begin());
+        int depth = -1;
+        for (int list = EnclosingList(expr, k - 1); list >= 0; list = EnclosingList(expr, list - 1)) {
+            int close = MatchingPop(expr, list);
+            if (offsets[close] < editEnd)
+                continue;
+            if (opts.maxDepth && depth < 0) {
+                depth = 0;
+                for (int l = EnclosingList(expr, list - 1); l >= 0; l = EnclosingList(expr, l - 1))
+                    ++depth;
+            }
+            if (ReparseRange(source, list, close + 1, offsets[list], offsets[close] + 1 + delta,
+                             delta, opts, depth < 0 ? 0 : depth))
+                return true;
+            if (depth > 0)
+                --depth;
+        }
+
+        // otherwise the top level lists from the one before the edit to
+        // the one after it
+        int lo = k > 0 ? TopLevelList(expr, k - 1) : 0;
+        int m = (int)(std::lower_bound(offsets.begin(), offsets.end(), editEnd) - offsets.begin());
+        int hi = m < n ? MatchingPop(expr, TopLevelList(expr, m)) + 1 : n;
+        size_t start = k > 0 ? offsets[lo] : 0;
+        size_t end = hi < n ? offsets[hi - 1] + 1 + delta : source.sz;
+        if ((lo > 0 || hi < n) && ReparseRange(source, lo, hi, start, end, delta, opts, 0))
+            return true;
+    }
+    *this = Sexpr(source, opts);
+    return false;
+}
+
+// Replace elements [lo, hi) by a parse of source[start, end), provided that
+// it parses without error and, unless it runs to the end of the source,
+// finishes with the close at end - 1 that finished the old elements.
+bool Sexpr::ReparseRange(StrView source, int lo, int hi, size_t start, size_t end,
+                         ptrdiff_t delta, SexprOptions const& options, int depth)
+{
+    if (end > source.sz || end <= start)
+        return false;
+    SexprOptions partOptions = options;
+    partOptions.recover = false;
+    if (options.maxDepth)
+        partOptions.maxDepth = options.maxDepth > depth ? options.maxDepth - depth : 1;
+    Sexpr part;
+    part.Parse(StrView(source.curr + start, end - start), partOptions, nullptr);
+    if (!part.errors.empty() || part.expr.empty())
+        return false;
+    if (hi < (int) expr.size() && part.offsets.back() != end - 1 - start)
+        return false;
+
+    // the new values go to the end of the side arrays
+    for (int i = lo; i < hi; ++i)
+        if (expr[i].token != tsSexprPushList && expr[i].token != tsSexprPopList)
+            ++unreferenced;
+    int intBase = (int) ints.size(), floatBase = (int) floats.size(), stringBase = (int) strings.size();
+    for (Elem& e : part.expr) {
+        switch (e.token) {
+        case tsSexprInteger: e.ref += intBase; break;
+        case tsSexprFloat: e.ref += floatBase; break;
+        case tsSexprPushList: case tsSexprPopList: break;
+        default: e.ref += stringBase; break;
+        }
+    }
+    ints.insert(ints.end(), part.ints.begin(), part.ints.end());
+    floats.insert(floats.end(), part.floats.begin(), part.floats.end());
+    for (auto& str : part.strings)
+        strings.push_back(std::move(str));
+
+    // the tail of expr moves by the change in count, and the tail of
+    // offsets moves and is patched in the same pass
+    size_t oldCount = (size_t)(hi - lo), newCount = part.expr.size();
+    size_t tailCount = expr.size() - (size_t) hi;
+    if (newCount > oldCount) {
+        size_t grow = newCount - oldCount;
+        expr.insert(expr.begin() + hi, grow, Elem());
+        offsets.resize(offsets.size() + grow);
+        size_t* from = offsets.data() + hi;
+        for (size_t i = tailCount; i-- > 0;)
+            from[i + grow] = from[i] + (size_t) delta;
+    }
+    else {
+        size_t shrink = oldCount - newCount;
+        if (shrink)
+            expr.erase(expr.begin() + lo + newCount, expr.begin() + hi);
+        size_t* to = offsets.data() + lo + newCount;
+        for (size_t i = 0; i < tailCount; ++i)
+            to[i] = to[i + shrink] + (size_t) delta;
+        offsets.resize(offsets.size() - shrink);
+    }
+    for (size_t i = 0; i < newCount; ++i) {
+        expr[lo + i] = part.expr[i];
+        offsets[lo + i] = part.offsets[i] + start;
+    }
+    return true;
+}
+
+#ifdef LABTEXT_SEXPR_CACHE
+
+// The image of a Sexpr. The header is followed by the elements, offsets,
+// and the ends of the strings within the string bytes, which are all 8 byte
+// values, then ints and floats, then the string bytes.
+struct SexprImageHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byteOrder;     // 0x01020304, as written by this machine
+    uint64_t key;
+    uint64_t inputSize;
+    uint64_t exprCount, offsetCount, intCount, floatCount, stringCount, stringBytes;
+};
+
+static const char SexprImageMagic[8] = { 'L', 'T', 'S', 'E', 'X', 'P', 'R', 0 };
+static const uint32_t SexprImageVersion = 1;
+
+static uint64_t SexprImageSize(SexprImageHeader const& h)
+{
+    return sizeof(SexprImageHeader) + 8 * (h.exprCount + h.offsetCount + h.stringCount) +
+           4 * (h.intCount + h.floatCount) + h.stringBytes;
+}
+
+// A read only view of a file, mapped where the platform allows
+class MappedFile {
+public:
+    explicit MappedFile(std::string const& path) {
+#ifdef LABTEXT_MMAP
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* m = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m != MAP_FAILED) {
+                data = (char const*) m;
+                size = (size_t) st.st_size;
+            }
+        }
+        close(fd);
+#else
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f)
+            return;
+        char buf[1 << 16];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+            contents.insert(contents.end(), buf, buf + n);
+        fclose(f);
+        data = contents.data();
+        size = contents.size();
+#endif
+    }
+    ~MappedFile() {
+#ifdef LABTEXT_MMAP
+        if (data)
+            munmap((void*) data, size);
+#endif
+    }
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    char const* data = nullptr;
+    size_t size = 0;
+#ifndef LABTEXT_MMAP
+private:
+    std::vector<char> contents;
+#endif
+};
+
+SexprCache::SexprCache(std::string dir, uint64_t maxBytes)
+: directory(std::move(dir)), maxBytes(maxBytes)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    Evict();    // measures the directory
+}
+
+std::string SexprCache::ImagePath(uint64_t key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.sexpr", (unsigned long long) key);
+    return (std::filesystem::path(directory) / name).string();
+}
+
+Sexpr SexprCache::Parse(StrView s, SexprOptions const& options)
+{
+    TS_TRACE_SCOPE("SexprCache::Parse");
+    uint64_t seed = SexprImageVersion | (uint64_t) options.trackOffsets << 8 |
+                    (uint64_t) options.recover << 9 | (uint64_t) options.json << 10 |
+                    (uint64_t)(uint32_t) options.maxDepth << 16;
+    uint64_t key = tsHashBytes(s.curr, s.sz, seed);
+    std::string path = ImagePath(key);
+
+    Sexpr result;
+    if (Load(path, key, s.sz, result)) {
+        ++hits;
+        // the modification time records use, for eviction
+        std::error_code ec;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+        return result;
+    }
+    ++misses;
+    result.Parse(s, options, nullptr);
+    if (result.errors.empty())
+        Store(path, key, s.sz, result);
+    return result;
+}
+
+bool SexprCache::Load(std::string const& path, uint64_t key, size_t inputSize, Sexpr& result)
+{
+    MappedFile file(path);
+    SexprImageHeader h;
+    if (file.size < sizeof(h))
+        return false;
+    memcpy(&h, file.data, sizeof(h));
+    if (memcmp(h.magic, SexprImageMagic, sizeof(h.magic)) || h.version != SexprImageVersion ||
+        h.byteOrder != 0x01020304 || h.key != key || h.inputSize != inputSize ||
+        (h.offsetCount && h.offsetCount != h.exprCount) ||
+        h.exprCount > file.size || h.stringCount > file.size || SexprImageSize(h) != file.size)
+        return false;
+
+    static_assert(sizeof(Sexpr::Elem) == 8, "the image stores elements as two 32 bit values");
+    char const* p = file.data + sizeof(h);
+    result.expr.resize(h.exprCount);
+    if (h.exprCount)
+        memcpy(result.expr.data(), p, 8 * h.exprCount);
+    p += 8 * h.exprCount;
+    result.offsets.resize(h.offsetCount);
+    for (size_t i = 0; i < h.offsetCount; ++i, p += 8) {
+        uint64_t offset;
+        memcpy(&offset, p, 8);
+        result.offsets[i] = (size_t) offset;
+    }
+    char const* ends = p;
+    p += 8 * h.stringCount;
+    result.ints.resize(h.intCount);
+    if (h.intCount)
+        memcpy(result.ints.data(), p, 4 * h.intCount);
+    p += 4 * h.intCount;
+    result.floats.resize(h.floatCount);
+    if (h.floatCount)
+        memcpy(result.floats.data(), p, 4 * h.floatCount);
+    p += 4 * h.floatCount;
+    result.strings.reserve(h.stringCount);
+    uint64_t begin = 0;
+    for (size_t i = 0; i < h.stringCount; ++i) {
+        uint64_t end;
+        memcpy(&end, ends + 8 * i, 8);
+        if (end < begin || end > h.stringBytes)
+            return false;
+        result.strings.emplace_back(p + begin, (size_t)(end - begin));
+        begin = end;
+    }
+
+    // refuse an image that does not describe a whole parse
+    for (Sexpr::Elem const& e : result.expr) {
+        size_t limit;
+        switch (e.token) {
+        case tsSexprPushList: case tsSexprPopList: continue;
+        case tsSexprInteger: limit = result.ints.size(); break;
+        case tsSexprFloat: limit = result.floats.size(); break;
+        case tsSexprAtom: case tsSexprString: limit = result.strings.size(); break;
+        default: return false;
+        }
+        if (e.ref < 0 || (size_t) e.ref >= limit)
+            return false;
+    }
+    return true;
+}
+
+void SexprCache::Store(std::string const& path, uint64_t key, size_t inputSize, Sexpr const& tree)
+{
+    SexprImageHeader h;
+    memcpy(h.magic, SexprImageMagic, sizeof(h.magic));
+    h.version = SexprImageVersion;
+    h.byteOrder = 0x01020304;
+    h.key = key;
+    h.inputSize = inputSize;
+    h.exprCount = tree.expr.size();
+    h.offsetCount = tree.offsets.size();
+    h.intCount = tree.ints.size();
+    h.floatCount = tree.floats.size();
+    h.stringCount = tree.strings.size();
+    h.stringBytes = 0;
+    std::vector<uint64_t> ends(tree.strings.size());
+    for (size_t i = 0; i < tree.strings.size(); ++i)
+        ends[i] = h.stringBytes += tree.strings[i].size();
+    std::vector<uint64_t> offsets(tree.offsets.begin(), tree.offsets.end());
+
+    // a name unique to this writer, so that concurrent writers of the same
+    // image do not collide; the rename is atomic, and any of them may win
+    static std::random_device entropy;
+    char suffix[40];
+    snprintf(suffix, sizeof(suffix), ".%08x%08x.tmp", entropy(), entropy());
+    std::string temp = path + suffix;
+    FILE* f = fopen(temp.c_str(), "wb");
+    if (!f)
+        return;
+    auto write = [f](void const* data, size_t size, uint64_t count) {
+        return !count || fwrite(data, size, (size_t) count, f) == count;
+    };
+    bool ok = write(&h, sizeof(h), 1);
+    ok = ok && write(tree.expr.data(), 8, h.exprCount);
+    ok = ok && write(offsets.data(), 8, h.offsetCount);
+    ok = ok && write(ends.data(), 8, h.stringCount);
+    ok = ok && write(tree.ints.data(), 4, h.intCount);
+    ok = ok && write(tree.floats.data(), 4, h.floatCount);
+    for (size_t i = 0; ok && i < tree.strings.size(); ++i)
+        ok = write(tree.strings[i].data(), 1, tree.strings[i].size());
+    ok = (fclose(f) == 0) && ok;
+
+    std::error_code ec;
+    if (ok)
+        std::filesystem::rename(temp, path, ec);
+    if (!ok || ec) {
+        // where rename cannot replace, the image is already in place
+        std::filesystem::remove(temp, ec);
+        return;
+    }
+    bytes += SexprImageSize(h);
+    if (bytes > maxBytes)
+        Evict();
+}
+
+void SexprCache::Evict()
+{
+    struct Image {
+        std::filesystem::file_time_type used;
+        uint64_t size;
+        std::filesystem::path path;
+    };
+    std::vector<Image> images;
+    uint64_t total = 0;
+    std::error_code ec;
+    for (auto it = std::filesystem::directory_iterator(directory, ec);
+         !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+        if (it->path().extension() != ".sexpr")
+            continue;
+        std::error_code fe;
+        uint64_t size = it->file_size(fe);
+        auto used = it->last_write_time(fe);
+        if (fe)
+            continue;
+        images.push_back({ used, size, it->path() });
+        total += size;
+    }
+    if (total > maxBytes) {
+        // oldest first, down to three quarters of the limit so that every
+        // store does not evict
+        std::sort(images.begin(), images.end(),
+                  [](Image const& a, Image const& b) { return a.used < b.used; });
+        for (Image const& image : images) {
+            if (total <= maxBytes - maxBytes / 4)
+                break;
+            if (std::filesystem::remove(image.path, ec))
+                total -= image.size;
+        }
+    }
+    bytes = total;
+}
+
+void SexprCache::Clear()
+{
+    std::error_code ec;
+    for (auto it = std::filesystem::directory_iterator(directory, ec);
+         !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+        std::error_code re;
+        if (it->path().extension() == ".sexpr")
+            std::filesystem::remove(it->path(), re);
+    }
+    bytes = 0;
+}
+
+#endif // LABTEXT_SEXPR_CACHE
+
+static uint32_t HashSymbol(char const* p, size_t sz)
+{
+    uint32_t h = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < sz; ++i)
+        h = (h ^ (uint8_t) p[i]) * 16777619u;
+    return h;
+}
+
+void FrozenSexpr::BuildIndexes() const
+{
+    Structure();
+    Keywords();
+}
+
+void FrozenSexpr::BuildStructure() const
+{
+    size_t n = tree.expr.size();
+    structure.end.resize(n);
+    structure.parent.resize(n);
+    std::vector<int> open;
+    for (size_t i = 0; i < n; ++i) {
+        structure.parent[i] = open.empty() ? -1 : open.back();
+        structure.end[i] = (int) i + 1;
+        if (tree.expr[i].token == tsSexprPushList)
+            open.push_back((int) i);
+        else if (tree.expr[i].token == tsSexprPopList && !open.empty()) {
+            structure.end[open.back()] = (int) i + 1;
+            open.pop_back();
+        }
+    }
+    // lists left open by an error extend to the end
+    for (int list : open)
+        structure.end[list] = (int) n;
+}
+
+void FrozenSexpr::BuildSymbols() const
+{
+    size_t n = tree.strings.size();
+    size_t capacity = 16;
+    while (capacity < n * 2)
+        capacity *= 2;
+    size_t mask = capacity - 1;
+    symbols.table.assign(capacity, 0);
+    symbols.ofString.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        std::string const& str = tree.strings[i];
+        size_t slot = HashSymbol(str.data(), str.size()) & mask;
+        while (true) {
+            int entry = symbols.table[slot];
+            if (!entry) {
+                symbols.text.push_back(StrView(str.data(), str.size()));
+                symbols.table[slot] = (int) symbols.text.size();
+                symbols.ofString[i] = (int) symbols.text.size() - 1;
+                break;
+            }
+            StrView t = symbols.text[entry - 1];
+            if (t.sz == str.size() && !memcmp(t.curr, str.data(), t.sz)) {
+                symbols.ofString[i] = entry - 1;
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+}
+
+void FrozenSexpr::BuildKeywords() const
+{
+    SymbolIndex const& sym = Symbols();
+    size_t count = sym.text.size();
+    keywords.start.assign(count + 1, 0);
+
+    // a counting sort of the keyword elements by symbol
+    for (size_t i = 0; i < tree.expr.size(); ++i) {
+        int s = SymbolOf((int) i);
+        if (s >= 0 && tree.expr[i].token == tsSexprAtom && sym.text[s].sz && sym.text[s].curr[0] == ':')
+            ++keywords.start[s + 1];
+    }
+    for (size_t s = 0; s < count; ++s)
+        keywords.start[s + 1] += keywords.start[s];
+    keywords.elems.resize(keywords.start[count]);
+    std::vector<int> fill(keywords.start.begin(), keywords.start.end() - 1);
+    for (size_t i = 0; i < tree.expr.size(); ++i) {
+        int s = SymbolOf((int) i);
+        if (s >= 0 && tree.expr[i].token == tsSexprAtom && sym.text[s].sz && sym.text[s].curr[0] == ':')
+            keywords.elems[fill[s]++] = (int) i;
+    }
+}
+
+int FrozenSexpr::Symbol(StrView text) const
+{
+    SymbolIndex const& sym = Symbols();
+    size_t mask = sym.table.size() - 1;
+    size_t slot = HashSymbol(text.curr, text.sz) & mask;
+    while (int entry = sym.table[slot]) {
+        StrView t = sym.text[entry - 1];
+        if (t.sz == text.sz && !memcmp(t.curr, text.curr, t.sz))
+            return entry - 1;
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+int FrozenSexpr::SymbolOf(int elem) const
+{
+    Sexpr::Elem const& e = tree.expr[elem];
+    if (e.token != tsSexprAtom && e.token != tsSexprString)
+        return -1;
+    return Symbols().ofString[e.ref];
+}
+
+StrView FrozenSexpr::SymbolText(int symbol) const
+{
+    return Symbols().text[symbol];
+}
+
+FrozenSexpr::Range FrozenSexpr::Keyword(StrView keyword) const
+{
+    Range result;
+    int s = Symbol(keyword);
+    if (s < 0)
+        return result;
+    KeywordIndex const& kw = Keywords();
+    result.first = kw.elems.data() + kw.start[s];
+    result.last = kw.elems.data() + kw.start[s + 1];
+    return result;
+}
+
+int FrozenSexpr::Find(int list, StrView keyword) const
+{
+    int s = Symbol(keyword);
+    if (s < 0 || tree.expr[list].token != tsSexprPushList)
+        return -1;
+    StructureIndex const& st = Structure();
+    SymbolIndex const& sym = Symbols();
+    int close = st.end[list] - 1;
+    for (int e = list + 1; e < close; e = st.end[e]) {
+        Sexpr::Elem const& elem = tree.expr[e];
+        if (elem.token == tsSexprAtom && sym.ofString[elem.ref] == s)
+            return e + 1 < close ? e + 1 : -1;
+    }
+    return -1;
+}
+
+PackedSexpr::PackedSexpr(StrView s, SexprOptions const& options)
+{
+    Sexpr tree(s, options);
+    errors = std::move(tree.errors);
+    Pack(tree);
+}
+
+PackedSexpr::PackedSexpr(Sexpr const& tree)
+: errors(tree.errors)
+{
+    Pack(tree);
+}
+
+uint32_t PackedSexpr::Encode(tsSexprToken_t token, uint32_t value)
+{
+    if (value < (1u << (32 - ValueShift)))
+        return value << ValueShift | token;
+    return Spill(token, value);
+}
+
+uint32_t PackedSexpr::Spill(tsSexprToken_t token, uint32_t value)
+{
+    Assert(overflow.size() < (1u << (32 - ValueShift)));
+    overflow.push_back(value);
+    return (uint32_t)(overflow.size() - 1) << ValueShift | Overflow | token;
+}
+
+int PackedSexpr::Intern(std::string const& str)
+{
+    if (textStart.size() * 2 > table.size()) {
+        // keep the table at most half full
+        table.assign(table.size() * 2, 0);
+        size_t mask = table.size() - 1;
+        for (size_t sym = 0; sym + 1 < textStart.size(); ++sym) {
+            size_t slot = HashSymbol(text.data() + textStart[sym], textStart[sym + 1] - textStart[sym]) & mask;
+            while (table[slot])
+                slot = (slot + 1) & mask;
+            table[slot] = (int) sym + 1;
+        }
+    }
+    size_t mask = table.size() - 1;
+    size_t slot = HashSymbol(str.data(), str.size()) & mask;
+    while (int entry = table[slot]) {
+        uint32_t start = textStart[entry - 1];
+        if (textStart[entry] - start == str.size() && !memcmp(text.data() + start, str.data(), str.size()))
+            return entry - 1;
+        slot = (slot + 1) & mask;
+    }
+    text.append(str);
+    textStart.push_back((uint32_t) text.size());
+    table[slot] = (int) textStart.size() - 1;
+    return table[slot] - 1;
+}
+
+void PackedSexpr::Pack(Sexpr const& tree)
+{
+    table.assign(16, 0);
+    textStart.assign(1, 0);
+
+    int n = tree.Count();
+    words.resize((size_t) n);
+    std::vector<int> open;
+    for (int i = 0; i < n; ++i) {
+        Sexpr::Elem e = tree.expr[(size_t) i];
+        switch (e.token) {
+        case tsSexprPushList:
+            open.push_back(i);  // the distance to End is set at the close
+            break;
+        case tsSexprPopList:
+            words[(size_t) i] = tsSexprPopList;
+            if (!open.empty()) {
+                words[(size_t) open.back()] = Encode(tsSexprPushList, (uint32_t)(i + 1 - open.back()));
+                open.pop_back();
+            }
+            break;
+        case tsSexprInteger: {
+            int v = tree.ints[(size_t) e.ref];
+            if (v >= -(1 << 27) && v < (1 << 27))
+                words[(size_t) i] = (uint32_t) v * (1u << ValueShift) | tsSexprInteger;
+            else
+                words[(size_t) i] = Spill(tsSexprInteger, (uint32_t) v);
+            break;
+        }
+        case tsSexprFloat: {
+            uint32_t bits;
+            memcpy(&bits, &tree.floats[(size_t) e.ref], sizeof(bits));
+            if (bits & ~ValueMask)
+                words[(size_t) i] = Spill(tsSexprFloat, bits);
+            else
+                words[(size_t) i] = bits | tsSexprFloat;
+            break;
+        }
+        default:
+            words[(size_t) i] = Encode(e.token, (uint32_t) Intern(tree.strings[(size_t) e.ref]));
+            break;
+        }
+    }
+    // lists left open by an error extend to the end
+    for (int list : open)
+        words[(size_t) list] = Encode(tsSexprPushList, (uint32_t)(n - list));
+}
+
+int PackedSexpr::Symbol(StrView str) const
+{
+    size_t mask = table.size() - 1;
+    size_t slot = HashSymbol(str.curr, str.sz) & mask;
+    while (int entry = table[slot]) {
+        uint32_t start = textStart[entry - 1];
+        if (textStart[entry] - start == str.sz && !memcmp(text.data() + start, str.curr, str.sz))
+            return entry - 1;
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+size_t PackedSexpr::Bytes() const
+{
+    return (words.size() + overflow.size() + textStart.size()) * sizeof(uint32_t) +
+           text.size() + table.size() * sizeof(int);
+}
+
+SexprHashes::SexprHashes(Sexpr const& tree)
+{
+    Build(tree);
+}
+
+SexprHashes::SexprHashes(PackedSexpr const& tree)
+{
+    Build(tree);
+}
+
+static inline uint64_t FinishSexprHash(uint64_t h, uint64_t length)
+{
+    h ^= length;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+template <class Tree>
+void SexprHashes::Build(Tree const& tree)
+{
+    size_t count = (size_t) tree.Count();
+    hashes.resize(count);
+    ends.resize(count);
+    canonical.resize(count);
+    tokens.resize(count);
+
+    // the open lists, with the hash of their contents so far
+    struct Open {
+        int      elem;
+        uint64_t h;
+    };
+    std::vector<Open> open;
+    size_t lists = 0;
+    uint64_t top = tsHashMix(0, tsSexprPopList);
+    for (int i = 0; i < (int) count; ++i) {
+        tsSexprToken_t token = tree.Token(i);
+        tokens[i] = (uint8_t) token;
+        ends[i] = i + 1;
+        uint64_t h;
+        switch (token) {
+        case tsSexprPushList:
+            open.push_back(Open{ i, tsHashMix(0, tsSexprPushList) });
+            ++lists;
+            continue;
+        case tsSexprPopList:
+            if (open.empty()) {
+                hashes[i] = 0;  // unbalanced, as after an error
+                continue;
+            }
+            h = FinishSexprHash(open.back().h, (uint64_t)(i - open.back().elem));
+            hashes[open.back().elem] = h;
+            ends[open.back().elem] = i + 1;
+            open.pop_back();
+            break;
+        case tsSexprInteger:
+            h = FinishSexprHash(tsHashMix(tsSexprInteger, (uint64_t)(int64_t) tree.Int(i)), 0);
+            break;
+        case tsSexprFloat: {
+            float f = tree.Float(i);
+            uint32_t bits;
+            memcpy(&bits, &f, sizeof(bits));
+            h = FinishSexprHash(tsHashMix(tsSexprFloat, bits), 0);
+            break;
+        }
+        default: {
+            StrView text = tree.Text(i);
+            h = tsHashBytes(text.curr, text.sz, token);
+            break;
+        }
+        }
+        hashes[i] = h;
+        if (open.empty())
+            top = tsHashMix(top, h);
+        else
+            open.back().h = tsHashMix(open.back().h, h);
+    }
+    // lists left open by an error end with the parse
+    while (!open.empty()) {
+        hashes[open.back().elem] = FinishSexprHash(open.back().h, count - (size_t) open.back().elem);
+        ends[open.back().elem] = (int) count;
+        open.pop_back();
+    }
+    document = FinishSexprHash(top, count);
+
+    // the first list of each hash, open addressed; elem + 1, or 0
+    size_t size = 16;
+    while (size < lists * 2)
+        size *= 2;
+    std::vector<int> first(size);
+    for (int i = 0; i < (int) count; ++i) {
+        canonical[i] = i;
+        if (tokens[i] != tsSexprPushList)
+            continue;
+        for (size_t slot = hashes[i] & (size - 1); ; slot = (slot + 1) & (size - 1)) {
+            if (!first[slot]) {
+                first[slot] = i + 1;
+                break;
+            }
+            if (hashes[first[slot] - 1] == hashes[i]) {
+                canonical[i] = first[slot] - 1;
+                break;
+            }
+        }
+    }
+}
+
+// the elements of the sequence [begin, end) of from, which are either lists
+// or values, by their hashes
+static void SexprChildren(SexprHashes const& tree, int begin, int end, std::vector<int>& result)
+{
+    result.clear();
+    for (int e = begin; e < end; e = tree.End(e))
+        if (tree.Token(e) != tsSexprPopList)
+            result.push_back(e);
+}
+
+// what pairs elem with its counterpart in the other parse: for a list, its
+// head and its first string; for a value, its token
+static uint64_t SexprPairKey(SexprHashes const& tree, int elem)
+{
+    if (tree.Token(elem) != tsSexprPushList)
+        return tree.Token(elem);
+    int head = elem + 1;
+    int close = tree.End(elem) - 1;
+    if (head >= close)
+        return tsSexprPushList;
+    uint64_t key = tsHashMix(tsSexprPushList, tree.Hash(head));
+    for (int e = tree.End(head); e < close; e = tree.End(e))
+        if (tree.Token(e) == tsSexprString)
+            return tsHashMix(key, tree.Hash(e));
+    return key;
+}
+
+// A multiset of hashes, open addressed, for matching the forms of two lists.
+class SexprHashCounts {
+    std::vector<uint64_t> keys;
+    std::vector<int>      counts;
+    std::vector<uint8_t>  used;
+    size_t                mask;
+public:
+    explicit SexprHashCounts(size_t count) {
+        size_t size = 16;
+        while (size < count * 2)
+            size *= 2;
+        keys.resize(size);
+        counts.resize(size);
+        used.resize(size);
+        mask = size - 1;
+    }
+    // the count of key, which is added if absent; at most count keys
+    int& operator[](uint64_t key) {
+        size_t slot = (size_t) key & mask;
+        while (used[slot] && keys[slot] != key)
+            slot = (slot + 1) & mask;
+        used[slot] = 1;
+        keys[slot] = key;
+        return counts[slot];
+    }
+};
 
+static void DiffSexprRange(SexprHashes const& from, int fromBegin, int fromEnd,
+                           SexprHashes const& to, int toBegin, int toEnd,
+                           std::vector<SexprChange>& result)
+{
+    std::vector<int> a, b;
+    SexprChildren(from, fromBegin, fromEnd, a);
+    SexprChildren(to, toBegin, toEnd, b);
+
+    // equal runs at either end
+    size_t lo = 0;
+    while (lo < a.size() && lo < b.size() && from.Hash(a[lo]) == to.Hash(b[lo]))
+        ++lo;
+    size_t aHi = a.size(), bHi = b.size();
+    while (aHi > lo && bHi > lo && from.Hash(a[aHi - 1]) == to.Hash(b[bHi - 1])) {
+        --aHi;
+        --bHi;
+    }
+    if (lo == aHi && lo == bHi)
+        return;
+
+    // forms in the middle present in both, as many times as in both
+    std::vector<int> removed;
+    std::vector<int> added;
+    {
+        SexprHashCounts counts(aHi + bHi - 2 * lo);
+        for (size_t i = lo; i < bHi; ++i)
+            ++counts[to.Hash(b[i])];
+        for (size_t i = lo; i < aHi; ++i) {
+            int& count = counts[from.Hash(a[i])];
+            if (count > 0)
+                --count;
+            else
+                removed.push_back(a[i]);
+        }
+    }
+    {
+        SexprHashCounts counts(aHi + bHi - 2 * lo);
+        for (size_t i = lo; i < aHi; ++i)
+            ++counts[from.Hash(a[i])];
+        for (size_t i = lo; i < bHi; ++i) {
+            int& count = counts[to.Hash(b[i])];
+            if (count > 0)
+                --count;
+            else
+                added.push_back(b[i]);
+        }
+    }
+
+    // pair what remains by key, in order; the positions of each key in
+    // added, and how many of them have been passed
+    std::unordered_map<uint64_t, std::pair<std::vector<size_t>, size_t>> keyed;
+    for (size_t i = 0; i < added.size(); ++i)
+        keyed[SexprPairKey(to, added[i])].first.push_back(i);
+    size_t next = 0;    // the first of added not yet reported
+    for (int elem : removed) {
+        auto it = keyed.find(SexprPairKey(from, elem));
+        size_t match = added.size();
+        if (it != keyed.end()) {
+            auto& positions = it->second;
+            while (positions.second < positions.first.size() && positions.first[positions.second] < next)
+                ++positions.second;
+            if (positions.second < positions.first.size())
+                match = positions.first[positions.second++];
+        }
+        if (match == added.size()) {
+            result.push_back(SexprChange{ SexprChange::Removed, elem, -1 });
+            continue;
+        }
+        for (; next < match; ++next)
+            result.push_back(SexprChange{ SexprChange::Added, -1, added[next] });
+        int counterpart = added[next++];
+        result.push_back(SexprChange{ SexprChange::Changed, elem, counterpart });
+        if (from.Token(elem) == tsSexprPushList)
+            DiffSexprRange(from, elem + 1, from.End(elem) - 1, to, counterpart + 1, to.End(counterpart) - 1, result);
+    }
+    for (; next < added.size(); ++next)
+        result.push_back(SexprChange{ SexprChange::Added, -1, added[next] });
+}
+
+std::vector<SexprChange> DiffSexpr(SexprHashes const& from, SexprHashes const& to)
+{
+    std::vector<SexprChange> result;
+    if (from.Document() != to.Document())
+        DiffSexprRange(from, 0, from.Count(), to, 0, to.Count(), result);
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+// SexprSchema
+//-----------------------------------------------------------------------------
+
+static SexprOptions SchemaOptions()
+{
+    SexprOptions options;
+    options.trackOffsets = true;
+    return options;
+}
+
+SexprSchema::SexprSchema(StrView schema)
+: source(schema, SchemaOptions())
+{
+    TS_TRACE_SCOPE("SexprSchema");
+    for (SexprError const& e : source.errors)
+        errors.push_back(SchemaError{ SchemaError::Syntax, e.offset, -1, StrView() });
+    if (!errors.empty())
+        return;
+
+    // the schema's element count bounds the heads and keywords
+    size_t capacity = 16;
+    while (capacity < source.expr.size() * 2)
+        capacity *= 2;
+    table.resize(capacity);
+
+    // declare the forms first, so that fields may name forms declared later
+    std::vector<int> declarations;
+    std::vector<int> tops;
+    for (int e = 0; e < source.Count(); e = source.End(e)) {
+        if (source.Token(e) != tsSexprPushList || source.Token(e + 1) != tsSexprAtom) {
+            Fail(e, StrView());
+            continue;
+        }
+        StrView kind = source.Text(e + 1);
+        if (kind == "top") {
+            tops.push_back(e);
+            continue;
+        }
+        if (kind != "form") {
+            Fail(e + 1, kind);
+            continue;
+        }
+        if (source.Token(e + 2) != tsSexprAtom || source.Text(e + 2).curr[0] == ':') {
+            Fail(e, kind);
+            continue;
+        }
+        StrView head = source.Text(e + 2);
+        if (Lookup(-1, head) >= 0) {
+            Fail(e + 2, head);
+            continue;
+        }
+        Form form;
+        form.head = head;
+        forms.push_back(form);
+        Insert(-1, (int) forms.size() - 1);
+        declarations.push_back(e);
+    }
+
+    static char const* const builtins[] = { "int", "number", "string", "atom", "bool", "list", "any" };
+    for (size_t f = 0; f < forms.size(); ++f) {
+        int e = declarations[f];
+        int end = source.End(e) - 1;
+        int elem = e + 3;
+        Form& form = forms[f];
+        form.firstField = (int) fields.size();
+        if (elem < end && source.Token(elem) == tsSexprAtom && source.Text(elem) == "open") {
+            form.open = true;
+            ++elem;
+        }
+        for (; elem < end; elem = source.End(elem)) {
+            if (source.Token(elem) != tsSexprPushList || source.Token(elem + 1) != tsSexprAtom ||
+                source.Text(elem + 1).curr[0] != ':') {
+                Fail(elem, form.head);
+                continue;
+            }
+            Field field;
+            field.keyword = source.Text(elem + 1);
+            bool optional = field.keyword.sz > 1 && field.keyword.curr[field.keyword.sz - 1] == '?';
+            if (optional)
+                --field.keyword.sz;
+            if (Lookup((int) f, field.keyword) >= 0 || form.fieldCount == 64) {
+                Fail(elem + 1, field.keyword);
+                continue;
+            }
+            field.typeStart = (int) types.size();
+            int last = source.End(elem) - 1;
+            for (int t = elem + 2; t < last; ++t) {
+                StrView name = source.Token(t) == tsSexprAtom ? source.Text(t) : StrView();
+                if ((name == "*" || name == "+") && t == last - 1 && field.typeCount) {
+                    field.repeat = name.curr[0];
+                    break;
+                }
+                int type = -1;
+                for (int b = 0; b < TypeForm && type < 0; ++b)
+                    if (name == builtins[b])
+                        type = b;
+                if (type < 0 && name.sz) {
+                    int nested = Lookup(-1, name);
+                    if (nested >= 0)
+                        type = TypeForm + nested;
+                }
+                if (type < 0) {
+                    Fail(t, name);
+                    // a list, such as a nested list of types, is skipped whole
+                    t = source.End(t) - 1;
+                    continue;
+                }
+                types.push_back((uint16_t) type);
+                ++field.typeCount;
+            }
+            if (!optional)
+                form.required |= 1ull << form.fieldCount;
+            fields.push_back(field);
+            ++form.fieldCount;
+            Insert((int) f, (int) fields.size() - 1);
+        }
+    }
+
+    if (!tops.empty()) {
+        for (Form& form : forms)
+            form.top = false;
+        for (int e : tops)
+            for (int elem = e + 2; elem < source.End(e) - 1; elem = source.End(elem)) {
+                int form = source.Token(elem) == tsSexprAtom ? Lookup(-1, source.Text(elem)) : -1;
+                if (form < 0)
+                    Fail(elem, StrView());
+                else
+                    forms[(size_t) form].top = true;
+            }
+    }
+}
+
+void SexprSchema::Fail(int elem, StrView name)
+{
+    errors.push_back(SchemaError{ SchemaError::Schema, source.offsets[(size_t) elem], elem, name });
+}
+
+// Keywords and heads are short, so rather than tsHashBytes, hash the first
+// and last bytes of the text with its length, in at most two loads, as
+// small inputs are hashed by wyhash. Texts that agree on those collide and
+// are told apart by the compare after the probe.
+static inline size_t SchemaHash(StrView text, int form)
+{
+    unsigned char const* p = (unsigned char const*) text.curr;
+    size_t sz = text.sz;
+    uint64_t a, b;
+    if (sz >= 8) {
+        memcpy(&a, p, 8);
+        memcpy(&b, p + sz - 8, 8);
+    }
+    else if (sz >= 4) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + sz - 4, 4);
+        a = lo;
+        b = hi;
+    }
+    else {
+        a = sz ? ((uint64_t) p[0] << 16 | (uint64_t) p[sz >> 1] << 8 | p[sz - 1]) : 0;
+        b = 0;
+    }
+    uint64_t h = (a ^ (uint64_t)(form + 1) * 0x9e3779b97f4a7c15ull) * 0xff51afd7ed558ccdull;
+    h ^= (b + (uint64_t) sz) * 0xc4ceb9fe1a85ec53ull;
+    return (size_t)(h ^ (h >> 32));
+}
+
+int SexprSchema::Lookup(int form, StrView text) const
+{
+    if (table.empty())
+        return -1;
+    size_t mask = table.size() - 1;
+    size_t slot = SchemaHash(text, form) & mask;
+    while (int index = table[slot].index) {
+        if (table[slot].form == form) {
+            StrView name = form < 0 ? forms[(size_t) index - 1].head : fields[(size_t) index - 1].keyword;
+            if (name == text)
+                return index - 1;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+void SexprSchema::Insert(int form, int index)
+{
+    StrView text = form < 0 ? forms[(size_t) index].head : fields[(size_t) index].keyword;
+    size_t mask = table.size() - 1;
+    size_t slot = SchemaHash(text, form) & mask;
+    while (table[slot].index)
+        slot = (slot + 1) & mask;
+    table[slot].form = form;
+    table[slot].index = index + 1;
+}
+
+// The validation state, fed the elements of a document in order.
+class SchemaCheck {
+public:
+    SchemaCheck(SexprSchema const& schema, std::vector<SchemaError>& errors)
+    : schema(schema), errors(errors), reported(errors.size()) {
+        stack.reserve(16);
+    }
+
+    bool Ok() const { return errors.size() == reported; }
+
+    void Push(size_t offset, int elem) {
+        Frame frame;
+        frame.offset = offset;
+        frame.elem = elem;
+        if (stack.empty())
+            frame.head = true;
+        else {
+            Frame& parent = stack.back();
+            if (parent.head)
+                Head(parent, tsSexprPushList, StrView());
+            else if (parent.form >= 0) {
+                int type = Expect(parent, offset, elem);
+                if (type >= SexprSchema::TypeForm) {
+                    frame.head = true;
+                    frame.expect = type - SexprSchema::TypeForm;
+                }
+                else if (type >= 0 && type != SexprSchema::TypeList && type != SexprSchema::TypeAny)
+                    Report(SchemaError::WrongType, offset, elem, schema.fields[(size_t) parent.field].keyword);
+            }
+        }
+        stack.push_back(frame);
+    }
+
+    void Pop() {
+        if (stack.empty())
+            return;
+        Frame& frame = stack.back();
+        if (frame.head)
+            Head(frame, tsSexprPopList, StrView());
+        else if (frame.form >= 0) {
+            Finish(frame);
+            SexprSchema::Form const& form = schema.forms[(size_t) frame.form];
+            uint64_t missing = form.required & ~frame.seen;
+            for (int i = 0; missing; ++i, missing >>= 1)
+                if (missing & 1)
+                    Report(SchemaError::MissingKeyword, frame.offset, frame.elem,
+                           schema.fields[(size_t)(form.firstField + i)].keyword);
+        }
+        stack.pop_back();
+    }
+
+    // text is that of an atom, and may be empty otherwise
+    void Value(tsSexprToken_t token, StrView text, size_t offset, int elem) {
+        if (stack.empty())
+            return;
+        Frame& frame = stack.back();
+        if (frame.head && Head(frame, token, text))
+            return;
+        if (frame.form < 0)
+            return;
+        if (token == tsSexprAtom && text.sz && text.curr[0] == ':') {
+            Keyword(frame, text, offset, elem);
+            return;
+        }
+        int type = Expect(frame, offset, elem);
+        if (type >= 0 && !Matches(type, token, text))
+            Report(SchemaError::WrongType, offset, elem, schema.fields[(size_t) frame.field].keyword);
+    }
+
+private:
+    struct Frame {
+        uint64_t seen = 0;          // a bit per field of the form
+        int      form = -1;         // -1 for a list that is not checked
+        int      expect = -1;       // the form a nested list must be, or -1 at the top level
+        int      field = -1;        // the field taking values, or -1
+        int      matched = 0;       // values taken by the field
+        bool     head = false;      // the head has yet to be seen
+        bool     skipping = false;  // values are ignored until the next keyword
+        size_t   offset = 0;
+        int      elem = -1;
+        size_t   keywordOffset = 0;
+        int      keywordElem = -1;
+    };
+
+    // Settle the form of a list from its first element. Returns false if a
+    // keyword began a nested list, which is then checked as usual.
+    bool Head(Frame& frame, tsSexprToken_t token, StrView text) {
+        frame.head = false;
+        if (token == tsSexprAtom) {
+            if (frame.expect < 0) {
+                int form = schema.Lookup(-1, text);
+                if (form >= 0 && schema.forms[(size_t) form].top) {
+                    frame.form = form;
+                    return true;
+                }
+            }
+            else if (text == schema.forms[(size_t) frame.expect].head) {
+                frame.form = frame.expect;
+                return true;
+            }
+            else if (text.sz && text.curr[0] == ':') {
+                frame.form = frame.expect;
+                return false;
+            }
+        }
+        Report(SchemaError::UnknownForm, frame.offset, frame.elem,
+               frame.expect < 0 ? StrView() : schema.forms[(size_t) frame.expect].head);
+        return true;
+    }
+
+    void Keyword(Frame& frame, StrView text, size_t offset, int elem) {
+        Finish(frame);
+        frame.keywordOffset = offset;
+        frame.keywordElem = elem;
+        frame.matched = 0;
+        frame.skipping = false;
+        int field = schema.Lookup(frame.form, text);
+        if (field < 0) {
+            frame.skipping = true;
+            if (!schema.forms[(size_t) frame.form].open)
+                Report(SchemaError::UnknownKeyword, offset, elem, StrView());
+            return;
+        }
+        uint64_t bit = 1ull << (field - schema.forms[(size_t) frame.form].firstField);
+        if (frame.seen & bit)
+            Report(SchemaError::DuplicateKeyword, offset, elem, schema.fields[(size_t) field].keyword);
+        frame.seen |= bit;
+        frame.field = field;
+    }
+
+    // the type of the next value of the current field, or -1 if there is
+    // no value expected
+    int Expect(Frame& frame, size_t offset, int elem) {
+        if (frame.field < 0) {
+            if (!frame.skipping)
+                Report(SchemaError::UnexpectedValue, offset, elem, schema.forms[(size_t) frame.form].head);
+            frame.skipping = true;
+            return -1;
+        }
+        SexprSchema::Field const& field = schema.fields[(size_t) frame.field];
+        int at = frame.matched;
+        if (at >= field.typeCount) {
+            if (!field.repeat) {
+                Report(SchemaError::UnexpectedValue, offset, elem, field.keyword);
+                frame.field = -1;
+                frame.skipping = true;
+                return -1;
+            }
+            at = field.typeCount - 1;
+        }
+        ++frame.matched;
+        return schema.types[(size_t)(field.typeStart + at)];
+    }
+
+    // check the current field has all of its values
+    void Finish(Frame& frame) {
+        if (frame.field < 0)
+            return;
+        SexprSchema::Field const& field = schema.fields[(size_t) frame.field];
+        if (frame.matched < field.typeCount - (field.repeat == '*'))
+            Report(SchemaError::MissingValue, frame.keywordOffset, frame.keywordElem, field.keyword);
+        frame.field = -1;
+    }
+
+    static bool Matches(int type, tsSexprToken_t token, StrView text) {
+        switch (type) {
+        case SexprSchema::TypeInt: return token == tsSexprInteger;
+        case SexprSchema::TypeNumber: return token == tsSexprInteger || token == tsSexprFloat;
+        case SexprSchema::TypeString: return token == tsSexprString;
+        case SexprSchema::TypeAtom: return token == tsSexprAtom;
+        case SexprSchema::TypeBool: return token == tsSexprAtom && (text == "true" || text == "false");
+        case SexprSchema::TypeAny: return true;
+        default: return false;      // lists and forms
+        }
+    }
+
+    void Report(SchemaError::Kind kind, size_t offset, int elem, StrView name) {
+        errors.push_back(SchemaError{ kind, offset, elem, name });
+    }
+
+    SexprSchema const&        schema;
+    std::vector<SchemaError>& errors;
+    size_t                    reported;    // errors present before the check
+    std::vector<Frame>        stack;
+};
+
+bool SexprSchema::Validate(Sexpr const& tree, std::vector<SchemaError>& result) const
+{
+    TS_TRACE_SCOPE("SexprSchema::Validate");
+    SchemaCheck check(*this, result);
+    bool offsets = !tree.offsets.empty();
+    for (int e = 0, count = tree.Count(); e < count; ++e) {
+        size_t offset = offsets ? tree.offsets[(size_t) e] : 0;
+        switch (tree.Token(e)) {
+        case tsSexprPushList: check.Push(offset, e); break;
+        case tsSexprPopList: check.Pop(); break;
+        case tsSexprAtom: check.Value(tsSexprAtom, tree.Text(e), offset, e); break;
+        default: check.Value(tree.Token(e), StrView(), offset, e); break;
+        }
+    }
+    return check.Ok();
+}
+
+bool SexprSchema::Validate(StrView s, std::vector<SchemaError>& result) const
+{
+    TS_TRACE_SCOPE("SexprSchema::Validate");
+    SchemaCheck check(*this, result);
+    SexprTokenizer tokenizer(s);
+    SexprToken tok;
+    while (tokenizer.Next(tok) == SexprTokenizer::Token) {
+        switch (tok.token) {
+        case tsSexprPushList: check.Push(tok.offset, -1); break;
+        case tsSexprPopList: check.Pop(); break;
+        case tsSexprAtom: check.Value(tsSexprAtom, tok.text, tok.offset, -1); break;
+        default: check.Value(tok.token, StrView(), tok.offset, -1); break;
+        }
+    }
+    if (tokenizer.State() == SexprTokenizer::Error)
+        result.push_back(SchemaError{ SchemaError::Syntax, tokenizer.LastError().offset, -1, StrView() });
+    return check.Ok();
+}
+
+int Sexpr::End(int elem) const
+{
+    if (expr[(size_t) elem].token != tsSexprPushList)
+        return elem + 1;
+    int depth = 0;
+    for (int i = elem; i < Count(); ++i) {
+        tsSexprToken_t token = expr[(size_t) i].token;
+        if (token == tsSexprPushList)
+            ++depth;
+        else if (token == tsSexprPopList && --depth == 0)
+            return i + 1;
+    }
+    return Count();
+}
+
+SourceLocation Sexpr::Location(StrView source, size_t elem) const
+{
+    SourceLocation result;
+    if (elem >= offsets.size())
+        return result;
+    result.offset = offsets[elem];
+    tsStrViewLineColumn(&source, result.offset, &result.line, &result.column);
     return result;
 }
 }} // lab::Text
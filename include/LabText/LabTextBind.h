@@ -0,0 +1,385 @@
+#ifndef LABTEXT_BIND_H
+#define LABTEXT_BIND_H
+
+/*
+LabTextBind.h decodes keyword forms of a parse directly into C++ structs.
+A binding is a table of keywords and the members they fill, built at
+compile time:
+
+    struct Node { StrView name; float pos[2]; float value; int id; };
+
+    using namespace lab::Text::Bind;
+    constexpr auto nodeBinding = binding<Node>("ls-node",
+        field(":name", &Node::name), field(":pos", &Node::pos),
+        field(":value", &Node::value), field(":id", &Node::id));
+
+    Node node;
+    bool ok = Decode(nodeBinding, tree, list, node);
+
+The keywords are placed in a perfect hash table when the binding is built,
+so a keyword in the input is found with one hash of its text and one
+compare. Values are written straight into the typed members; nothing is
+allocated unless a member is a std::string or std::vector. Keywords the
+binding does not name are skipped, along with their values, by End, which
+is O(1) on a PackedSexpr.
+
+Decode and DecodeAll are templates over the accessors shared by Sexpr and
+PackedSexpr. Members may be integers, bool, float or double, StrView or
+std::string, fixed arrays and std::array of those, which take one value
+each, and std::vector of those, which takes the values up to the next
+keyword. A member bound with field(keyword, member, binding) is a struct
+decoded from a list by a nested binding, or a std::vector of them.
+
+StrView members view the text held by the parse, and are valid for as long
+as it is.
+
+Keywords that appear twice in a binding are a compile error when the
+binding is constexpr, as above. C++17 cannot force that check on a binding
+built at run time; such a binding decodes nothing, and Decode returns false.
+
+License BSD-2 Clause.
+*/
+
+#include "LabText.h"
+
+#if __cplusplus < 201703L && (!defined(_MSVC_LANG) || _MSVC_LANG < 201703L)
+    #error "LabTextBind.h requires C++17 or later."
+#endif
+
+#include <array>
+#include <limits>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lab { namespace Text { namespace Bind {
+
+//-----------------------------------------------------------------------------
+// Fields
+//-----------------------------------------------------------------------------
+
+// The binding of a field whose values are read as they are.
+struct Unbound {};
+
+template <class T, class M, class B = Unbound>
+struct Field {
+    char const* keyword;
+    size_t      size;
+    M T::*      member;
+    B           binding;
+};
+
+// A member filled from the values following keyword.
+template <class T, class M, size_t N>
+constexpr Field<T, M> field(char const (&keyword)[N], M T::* member) {
+    return { keyword, N - 1, member, Unbound{} };
+}
+
+// A member filled by decoding the list following keyword with binding.
+template <class T, class M, class B, size_t N>
+constexpr Field<T, M, B> field(char const (&keyword)[N], M T::* member, B const& binding) {
+    return { keyword, N - 1, member, binding };
+}
+
+namespace detail {
+
+constexpr uint32_t KeywordHash(char const* p, size_t sz, uint32_t seed) {
+    uint32_t h = seed ^ (uint32_t) sz * 0x9e3779b9u;
+    for (size_t i = 0; i < sz; ++i)
+        h = (h ^ (uint8_t) p[i]) * 0x01000193u;
+    return h ^ (h >> 15);
+}
+
+// Half the square of the keyword count, so that about one seed in three
+// places every keyword in a slot of its own.
+constexpr size_t TableSize(size_t count) {
+    size_t size = 2;
+    while (size < count * count / 2)
+        size *= 2;
+    return size;
+}
+
+// Not constexpr, so that a constexpr binding whose keywords cannot be told
+// apart fails to compile.
+inline void KeywordsCollide() {}
+
+template <class M> struct IsVector : std::false_type {};
+template <class E, class A> struct IsVector<std::vector<E, A>> : std::true_type {};
+
+template <class M> struct IsArray : std::false_type {};
+template <class E, size_t N> struct IsArray<E[N]> : std::true_type {};
+template <class E, size_t N> struct IsArray<std::array<E, N>> : std::true_type {};
+
+template <class M> struct ArraySize;
+template <class E, size_t N> struct ArraySize<E[N]> : std::integral_constant<size_t, N> {};
+template <class E, size_t N> struct ArraySize<std::array<E, N>> : std::integral_constant<size_t, N> {};
+
+template <class M> struct DependentFalse : std::false_type {};
+
+template <class Tree>
+inline bool IsKeyword(Tree const& tree, int elem) {
+    if (tree.Token(elem) != tsSexprAtom)
+        return false;
+    StrView text = tree.Text(elem);
+    return text.sz && text.curr[0] == ':';
+}
+
+// Read the value at elem into out. Integers are those of the parse, 32
+// bits, with hex literals keeping their bit pattern, so that 0xffffffff is
+// -1; an integer outside the range of M is an error. Keywords are not
+// values.
+template <class M, class Tree>
+inline bool ReadValue(Tree const& tree, int elem, M& out) {
+    tsSexprToken_t token = tree.Token(elem);
+    if constexpr (std::is_same<M, bool>::value) {
+        if (token == tsSexprInteger) {
+            out = tree.Int(elem) != 0;
+            return true;
+        }
+        if (token != tsSexprAtom)
+            return false;
+        StrView text = tree.Text(elem);
+        if (text.sz == 4 && !memcmp(text.curr, "true", 4))
+            out = true;
+        else if (text.sz == 5 && !memcmp(text.curr, "false", 5))
+            out = false;
+        else
+            return false;
+        return true;
+    }
+    else if constexpr (std::is_integral<M>::value) {
+        if (token != tsSexprInteger)
+            return false;
+        int64_t v = tree.Int(elem);
+        if (v < 0 ? v < (int64_t) std::numeric_limits<M>::min()
+                  : (uint64_t) v > (uint64_t) std::numeric_limits<M>::max())
+            return false;
+        out = (M) v;
+        return true;
+    }
+    else if constexpr (std::is_floating_point<M>::value) {
+        if (token == tsSexprFloat)
+            out = (M) tree.Float(elem);
+        else if (token == tsSexprInteger)
+            out = (M) tree.Int(elem);
+        else
+            return false;
+        return true;
+    }
+    else if constexpr (std::is_same<M, StrView>::value || std::is_same<M, std::string>::value) {
+        if (token != tsSexprString && token != tsSexprAtom)
+            return false;
+        StrView text = tree.Text(elem);
+        if (token == tsSexprAtom && text.sz && text.curr[0] == ':')
+            return false;
+        if constexpr (std::is_same<M, StrView>::value)
+            out = text;
+        else
+            out.assign(text.curr, text.sz);
+        return true;
+    }
+    else {
+        static_assert(DependentFalse<M>::value, "LabTextBind: a member of this type needs a binding");
+        return false;
+    }
+}
+
+} // detail
+
+//-----------------------------------------------------------------------------
+// Bindings
+//-----------------------------------------------------------------------------
+
+template <class T, class... Fs>
+class Binding {
+public:
+    static constexpr size_t Count = sizeof...(Fs);
+    static constexpr size_t Size = detail::TableSize(Count);
+    static_assert(Count < 255, "LabTextBind: too many fields in one binding");
+
+    constexpr Binding(char const* head, size_t headSize, Fs const&... fs)
+    : fields(fs...), keywords{ fs.keyword... }, sizes{ fs.size... }, head(head), headSize(headSize) {
+        for (size_t i = 0; i < Count; ++i)
+            for (size_t j = 0; j < i; ++j)
+                if (Same(i, j)) {
+                    detail::KeywordsCollide();
+                    return;
+                }
+        // find a seed under which every keyword has a slot of its own
+        for (seed = 0; seed < 65536; ++seed) {
+            for (size_t i = 0; i < Size; ++i)
+                slots[i] = 0;
+            size_t i = 0;
+            for (; i < Count; ++i) {
+                size_t slot = detail::KeywordHash(keywords[i], sizes[i], seed) & (Size - 1);
+                if (slots[slot])
+                    break;
+                slots[slot] = (uint8_t)(i + 1);
+            }
+            if (i == Count) {
+                built = true;
+                return;
+            }
+        }
+        for (size_t i = 0; i < Size; ++i)
+            slots[i] = 0;
+        detail::KeywordsCollide();
+    }
+
+    // The field named by keyword, or -1.
+    int Lookup(StrView keyword) const {
+        size_t slot = detail::KeywordHash(keyword.curr, keyword.sz, seed) & (Size - 1);
+        int i = (int) slots[slot] - 1;
+        if (i < 0 || sizes[i] != keyword.sz || memcmp(keywords[i], keyword.curr, keyword.sz))
+            return -1;
+        return i;
+    }
+
+    // A list begins with the head, if the binding has one.
+    template <class Tree>
+    bool Matches(Tree const& tree, int list) const {
+        if (tree.Token(list) != tsSexprPushList)
+            return false;
+        if (!headSize)
+            return true;
+        if (tree.Token(list + 1) != tsSexprAtom)
+            return false;
+        StrView text = tree.Text(list + 1);
+        return text.sz == headSize && !memcmp(text.curr, head, headSize);
+    }
+
+    template <class Tree>
+    bool Decode(Tree const& tree, int list, T& out) const {
+        if (!built || !Matches(tree, list))
+            return false;
+        int end = tree.End(list) - 1;
+        int elem = list + 1;
+        bool ok = true;
+        while (elem < end) {
+            if (tree.Token(elem) != tsSexprAtom) {
+                elem = tree.End(elem);
+                continue;
+            }
+            StrView text = tree.Text(elem++);
+            if (!text.sz || text.curr[0] != ':')
+                continue;
+            int i = Lookup(text);
+            if (i < 0)
+                continue;
+            int next = ReadField((size_t) i, tree, elem, end, out, std::index_sequence_for<Fs...>());
+            if (next < 0)
+                ok = false;
+            else
+                elem = next;
+        }
+        return ok;
+    }
+
+private:
+    constexpr bool Same(size_t i, size_t j) const {
+        if (sizes[i] != sizes[j])
+            return false;
+        for (size_t k = 0; k < sizes[i]; ++k)
+            if (keywords[i][k] != keywords[j][k])
+                return false;
+        return true;
+    }
+
+    template <class Tree, size_t... I>
+    int ReadField(size_t i, Tree const& tree, int elem, int end, T& out, std::index_sequence<I...>) const {
+        int next = -1;
+        (void)((i == I && (next = Read(std::get<I>(fields), tree, elem, end, out), true)) || ...);
+        return next;
+    }
+
+    template <class M, class B, class Tree>
+    static int ReadOne(B const& binding, Tree const& tree, int elem, int end, M& out) {
+        if (elem >= end)
+            return -1;
+        if constexpr (std::is_same<B, Unbound>::value)
+            return detail::ReadValue(tree, elem, out) ? elem + 1 : -1;
+        else
+            return binding.Decode(tree, elem, out) ? tree.End(elem) : -1;
+    }
+
+    // Read the values of a field starting at elem. Returns the element
+    // following them, or -1 if a value is missing or of the wrong type.
+    template <class M, class B, class Tree>
+    static int Read(Field<T, M, B> const& f, Tree const& tree, int elem, int end, T& out) {
+        M& member = out.*(f.member);
+        if constexpr (detail::IsArray<M>::value) {
+            for (size_t i = 0; i < detail::ArraySize<M>::value && elem >= 0; ++i)
+                elem = ReadOne(f.binding, tree, elem, end, member[i]);
+            return elem;
+        }
+        else if constexpr (detail::IsVector<M>::value) {
+            member.clear();
+            while (elem < end && !detail::IsKeyword(tree, elem)) {
+                member.emplace_back();
+                elem = ReadOne(f.binding, tree, elem, end, member.back());
+                if (elem < 0)
+                    return -1;
+            }
+            return elem;
+        }
+        else
+            return ReadOne(f.binding, tree, elem, end, member);
+    }
+
+    std::tuple<Fs...> fields;
+    char const*       keywords[Count ? Count : 1] = {};
+    size_t            sizes[Count ? Count : 1] = {};
+    char const*       head = nullptr;
+    size_t            headSize = 0;
+    uint32_t          seed = 0;
+    uint8_t           slots[Size] = {};    // field + 1, or 0
+    bool              built = false;       // every keyword has a slot
+};
+
+// A binding for lists beginning with the atom head.
+template <class T, size_t N, class... Ms, class... Bs>
+constexpr Binding<T, Field<T, Ms, Bs>...> binding(char const (&head)[N], Field<T, Ms, Bs> const&... fields) {
+    return Binding<T, Field<T, Ms, Bs>...>(head, N - 1, fields...);
+}
+
+// A binding for any list, as the value of a field, where a leading atom
+// is ignored.
+template <class T, class... Ms, class... Bs>
+constexpr Binding<T, Field<T, Ms, Bs>...> binding(Field<T, Ms, Bs> const&... fields) {
+    return Binding<T, Field<T, Ms, Bs>...>(nullptr, 0, fields...);
+}
+
+//-----------------------------------------------------------------------------
+// Entry points
+//-----------------------------------------------------------------------------
+
+// Decode the list at elem into out. Members whose keywords do not occur are
+// left as they were. Returns false if the list does not match the binding's
+// head, if a value was missing, of the wrong type or out of range, or if
+// the binding was not built; the other fields are still decoded.
+template <class B, class Tree, class T>
+inline bool Decode(B const& binding, Tree const& tree, int elem, T& out) {
+    return binding.Decode(tree, elem, out);
+}
+
+// Decode every top level list matching the binding, appending to out.
+// Returns false if any of them failed to decode.
+template <class B, class Tree, class T>
+inline bool DecodeAll(B const& binding, Tree const& tree, std::vector<T>& out) {
+    bool ok = true;
+    for (int elem = 0, count = tree.Count(); elem < count; elem = tree.End(elem)) {
+        if (!binding.Matches(tree, elem))
+            continue;
+        out.emplace_back();
+        ok &= binding.Decode(tree, elem, out.back());
+    }
+    return ok;
+}
+
+}}} // lab::Text::Bind
+
+#endif // LABTEXT_BIND_H
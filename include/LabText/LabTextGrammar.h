@@ -0,0 +1,617 @@
+#ifndef LABTEXT_GRAMMAR_H
+#define LABTEXT_GRAMMAR_H
+
+/*
+LabTextGrammar.h composes small grammars from parser combinators over
+StrView. Every combinator is a distinct type, so a grammar such as
+
+    using namespace lab::Text::Grammar;
+    StrView key; float value;
+    auto line = tok(token(identifier, key)) >> tok('=') >> tok(number(value));
+    bool ok = Parse(line, input);
+
+is resolved at template instantiation time into a single scanning routine
+over the input with no virtual calls and no allocations. Whitespace is only
+skipped where the grammar asks for it, by ws, wsc, or tok.
+
+Parse advances the input past the match and returns true, or leaves the
+input untouched and returns false. Captures made by a failed alternative
+may have been written; they are only meaningful when the overall parse
+succeeds.
+
+License BSD-2 Clause.
+*/
+
+#include "LabText.h"
+
+#if __cplusplus < 201703L && (!defined(_MSVC_LANG) || _MSVC_LANG < 201703L)
+    #error "LabTextGrammar.h requires C++17 or later."
+#endif
+
+#include <math.h>
+#include <limits>
+#include <stdint.h>
+#include <type_traits>
+
+namespace lab { namespace Text { namespace Grammar {
+
+//-----------------------------------------------------------------------------
+// Character classes
+//-----------------------------------------------------------------------------
+
+// A set of byte values, built at compile time. Stored as a byte table
+// rather than a bit set so that a membership test is a single load.
+struct CharClass {
+    bool set[256] = {};
+
+    constexpr bool Has(unsigned char c) const {
+        return set[c];
+    }
+    constexpr CharClass operator|(CharClass const& rhs) const {
+        CharClass r;
+        for (int i = 0; i < 256; ++i)
+            r.set[i] = set[i] || rhs.set[i];
+        return r;
+    }
+    constexpr CharClass operator~() const {
+        CharClass r;
+        for (int i = 0; i < 256; ++i)
+            r.set[i] = !set[i];
+        return r;
+    }
+};
+
+constexpr CharClass range(unsigned char lo, unsigned char hi) {
+    CharClass r;
+    for (unsigned c = lo; c <= hi; ++c)
+        r.set[c] = true;
+    return r;
+}
+
+constexpr CharClass charset(char const* chars) {
+    CharClass r;
+    for (; *chars; ++chars)
+        r.set[(unsigned char) *chars] = true;
+    return r;
+}
+
+constexpr CharClass digit      = range('0', '9');
+constexpr CharClass alpha      = range('a', 'z') | range('A', 'Z');
+constexpr CharClass alnum      = alpha | digit;
+constexpr CharClass identifier = alnum | charset("_");
+constexpr CharClass xdigit     = digit | range('a', 'f') | range('A', 'F');
+constexpr CharClass space      = charset(" \t\r\n");
+constexpr CharClass blank      = charset(" \t");
+
+//-----------------------------------------------------------------------------
+// Primitive parsers
+//
+// A parser is any type with
+//     bool Match(char const*& p, char const* end) const;
+// that advances p on success. Combinators restore p on failure.
+//-----------------------------------------------------------------------------
+
+// a single character
+struct Char {
+    char c;
+    bool Match(char const*& p, char const* end) const {
+        if (p < end && *p == c) {
+            ++p;
+            return true;
+        }
+        return false;
+    }
+};
+
+// a literal string
+struct Literal {
+    char const* str;
+    size_t sz;
+    bool Match(char const*& p, char const* end) const {
+        if ((size_t)(end - p) < sz || memcmp(p, str, sz) != 0)
+            return false;
+        p += sz;
+        return true;
+    }
+};
+
+// one or more characters of a class, optionally captured
+struct Token {
+    CharClass cls;
+    StrView* out;
+    bool Match(char const*& p, char const* end) const {
+        char const* start = p;
+        while (p < end && cls.Has((unsigned char) *p))
+            ++p;
+        if (p == start)
+            return false;
+        if (out)
+            *out = StrView(start, (size_t)(p - start));
+        return true;
+    }
+};
+
+// one or more ASCII characters of a class, or XID_Continue code points
+// encoded as UTF-8, optionally captured
+struct Utf8Token {
+    CharClass cls;
+    StrView* out;
+    bool Match(char const*& p, char const* end) const {
+        char const* start = p;
+        while (p < end) {
+            if ((unsigned char) *p < 0x80) {
+                if (!cls.Has((unsigned char) *p))
+                    break;
+                ++p;
+                continue;
+            }
+            char const* next;
+            if (!tsIsXidContinue(tsDecodeUtf8(p, end, &next)))
+                break;
+            p = next;
+        }
+        if (p == start)
+            return false;
+        if (out)
+            *out = StrView(start, (size_t)(p - start));
+        return true;
+    }
+};
+
+// zero or more characters of a class; never fails
+struct SkipClass {
+    CharClass cls;
+    bool Match(char const*& p, char const* end) const {
+        while (p < end && cls.Has((unsigned char) *p))
+            ++p;
+        return true;
+    }
+};
+
+// white space, and comments of the given tsCommentStyle_t styles; never fails
+struct SkipComments {
+    unsigned styles;
+    bool Match(char const*& p, char const* end) const {
+        p = tsSkipCommentsAndWhitespaceExt(p, end, styles);
+        return true;
+    }
+};
+
+// the end of a line, or the end of input
+struct EndOfLine {
+    bool Match(char const*& p, char const* end) const {
+        if (p == end)
+            return true;
+        if (*p == '\r') {
+            ++p;
+            if (p < end && *p == '\n')
+                ++p;
+            return true;
+        }
+        if (*p == '\n') {
+            ++p;
+            return true;
+        }
+        return false;
+    }
+};
+
+struct EndOfInput {
+    bool Match(char const*& p, char const* end) const {
+        return p == end;
+    }
+};
+
+// A decimal number with optional sign, fraction and exponent, converted
+// directly into T in the same pass that recognizes it. Integral targets
+// match the sign and integer digits only, leaving any fraction or exponent
+// in the input, and fail on a value T cannot hold, including a negative
+// value for an unsigned T.
+template <class T>
+struct Number {
+    T* out;
+    bool Match(char const*& p, char const* end) const {
+        char const* s = p;
+        bool neg = false;
+        if (s < end && (*s == '-' || *s == '+'))
+            neg = *s++ == '-';
+        uint64_t mant = 0;
+        int digits = 0;
+        int dropped = 0;
+        char const* intStart = s;
+        for (; s < end && (unsigned)(*s - '0') < 10; ++s) {
+            uint64_t d = (uint64_t)(*s - '0');
+            // up to 19 digits always fit; a 20th only below UINT64_MAX
+            if (digits < 19 || (digits == 19 && mant <= (UINT64_MAX - d) / 10)) {
+                mant = mant * 10 + d;
+                if (mant)
+                    ++digits;
+            }
+            else
+                ++dropped;
+        }
+        bool any = s != intStart;
+        int exp10 = dropped;
+        if (std::is_floating_point<T>::value) {
+            if (s < end && *s == '.') {
+                char const* frac = ++s;
+                for (; s < end && (unsigned)(*s - '0') < 10; ++s) {
+                    if (digits < 19) {
+                        mant = mant * 10 + (uint64_t)(*s - '0');
+                        if (mant)
+                            ++digits;
+                        --exp10;
+                    }
+                }
+                any |= s != frac;
+            }
+            if (any && s < end && (*s == 'e' || *s == 'E')) {
+                char const* e = s + 1;
+                bool eneg = false;
+                if (e < end && (*e == '-' || *e == '+'))
+                    eneg = *e++ == '-';
+                if (e < end && (unsigned)(*e - '0') < 10) {
+                    int x = 0;
+                    for (; e < end && (unsigned)(*e - '0') < 10; ++e)
+                        if (x < 10000)
+                            x = x * 10 + (*e - '0');
+                    exp10 += eneg ? -x : x;
+                    s = e;
+                }
+            }
+        }
+        if (!any)
+            return false;
+        if constexpr (!std::is_floating_point<T>::value) {
+            uint64_t max = (uint64_t) std::numeric_limits<T>::max();
+            if (std::is_signed<T>::value && neg)
+                ++max;      // the magnitude of min
+            else if (neg && mant)
+                return false;
+            if (dropped || mant > max)
+                return false;
+        }
+        if (out) {
+            if (std::is_floating_point<T>::value) {
+                static constexpr double pow10[] = {
+                    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+                double v = (double) mant;
+                if (exp10 > 0)
+                    v *= exp10 <= 22 ? pow10[exp10] : pow(10.0, (double) exp10);
+                else if (exp10 < 0)
+                    v /= exp10 >= -22 ? pow10[-exp10] : pow(10.0, (double) -exp10);
+                *out = (T)(neg ? -v : v);
+            }
+            else {
+                *out = (T)(neg ? (T)(0 - mant) : (T) mant);
+            }
+        }
+        p = s;
+        return true;
+    }
+};
+
+// a string delimited by quote, with backslash escapes skipped over. The
+// capture excludes the quotes, and escapes are not decoded.
+struct Quoted {
+    char quote;
+    StrView* out;
+    bool Match(char const*& p, char const* end) const {
+        if (p == end || *p != quote)
+            return false;
+        char const* close = tsScanForQuote(p + 1, end, quote, true);
+        if (close == end)
+            return false;
+        if (out)
+            *out = StrView(p + 1, (size_t)(close - p - 1));
+        p = close + 1;
+        return true;
+    }
+};
+
+//-----------------------------------------------------------------------------
+// Combinators
+//-----------------------------------------------------------------------------
+
+template <class... Ps>
+struct Seq;
+
+template <>
+struct Seq<> {
+    bool Match(char const*&, char const*) const { return true; }
+};
+
+template <class P, class... Ps>
+struct Seq<P, Ps...> {
+    P head;
+    Seq<Ps...> tail;
+    bool Match(char const*& p, char const* end) const {
+        char const* save = p;
+        if (head.Match(p, end) && tail.Match(p, end))
+            return true;
+        p = save;
+        return false;
+    }
+};
+
+template <class A, class B>
+struct Choice {
+    A a;
+    B b;
+    bool Match(char const*& p, char const* end) const {
+        char const* save = p;
+        if (a.Match(p, end))
+            return true;
+        p = save;
+        if (b.Match(p, end))
+            return true;
+        p = save;
+        return false;
+    }
+};
+
+// between min and max matches of P; max of zero means unbounded. Stops
+// early if P succeeds without consuming input.
+template <class P>
+struct Repeat {
+    P p_;
+    size_t min;
+    size_t max;
+    bool Match(char const*& p, char const* end) const {
+        char const* save = p;
+        size_t n = 0;
+        while (max == 0 || n < max) {
+            char const* before = p;
+            if (!p_.Match(p, end)) {
+                p = before;
+                break;
+            }
+            ++n;
+            if (p == before)
+                break;
+        }
+        if (n < min) {
+            p = save;
+            return false;
+        }
+        return true;
+    }
+};
+
+template <class P>
+struct Optional {
+    P p_;
+    bool Match(char const*& p, char const* end) const {
+        char const* save = p;
+        if (!p_.Match(p, end))
+            p = save;
+        return true;
+    }
+};
+
+// succeeds without consuming if P does not match here
+template <class P>
+struct Not {
+    P p_;
+    bool Match(char const*& p, char const* end) const {
+        char const* save = p;
+        bool m = p_.Match(p, end);
+        p = save;
+        return !m;
+    }
+};
+
+// captures the span matched by P
+template <class P>
+struct Capture {
+    P p_;
+    StrView* out;
+    bool Match(char const*& p, char const* end) const {
+        char const* start = p;
+        if (!p_.Match(p, end))
+            return false;
+        *out = StrView(start, (size_t)(p - start));
+        return true;
+    }
+};
+
+// invokes fn with the span matched by P; fn may return false to reject it
+template <class P, class F>
+struct Action {
+    P p_;
+    F fn;
+    bool Match(char const*& p, char const* end) const {
+        char const* start = p;
+        if (!p_.Match(p, end))
+            return false;
+        using R = decltype(fn(StrView(start, 0)));
+        if constexpr (std::is_same<R, bool>::value) {
+            if (!fn(StrView(start, (size_t)(p - start)))) {
+                p = start;
+                return false;
+            }
+        }
+        else
+            fn(StrView(start, (size_t)(p - start)));
+        return true;
+    }
+};
+
+//-----------------------------------------------------------------------------
+// Construction
+//-----------------------------------------------------------------------------
+
+template <class T> struct IsParser : std::false_type {};
+template <> struct IsParser<Char> : std::true_type {};
+template <> struct IsParser<Literal> : std::true_type {};
+template <> struct IsParser<Token> : std::true_type {};
+template <> struct IsParser<Utf8Token> : std::true_type {};
+template <> struct IsParser<SkipClass> : std::true_type {};
+template <> struct IsParser<SkipComments> : std::true_type {};
+template <> struct IsParser<EndOfLine> : std::true_type {};
+template <> struct IsParser<EndOfInput> : std::true_type {};
+template <> struct IsParser<Quoted> : std::true_type {};
+template <class T> struct IsParser<Number<T>> : std::true_type {};
+template <class... Ps> struct IsParser<Seq<Ps...>> : std::true_type {};
+template <class A, class B> struct IsParser<Choice<A, B>> : std::true_type {};
+template <class P> struct IsParser<Repeat<P>> : std::true_type {};
+template <class P> struct IsParser<Optional<P>> : std::true_type {};
+template <class P> struct IsParser<Not<P>> : std::true_type {};
+template <class P> struct IsParser<Capture<P>> : std::true_type {};
+template <class P, class F> struct IsParser<Action<P, F>> : std::true_type {};
+
+// characters and string literals may be used directly in a grammar
+inline constexpr Char     lift(char c) { return Char{ c }; }
+template <size_t N>
+inline constexpr Literal  lift(char const (&s)[N]) { return Literal{ s, N - 1 }; }
+template <class P, class = std::enable_if_t<IsParser<P>::value>>
+inline constexpr P        lift(P const& p) { return p; }
+
+template <class P>
+using Lifted = decltype(lift(std::declval<P const&>()));
+
+inline constexpr Char      lit(char c) { return Char{ c }; }
+template <size_t N>
+inline constexpr Literal   lit(char const (&s)[N]) { return Literal{ s, N - 1 }; }
+inline           Literal   lit(StrView s) { return Literal{ s.curr, s.sz }; }
+
+inline constexpr Token     token(CharClass cls) { return Token{ cls, nullptr }; }
+inline constexpr Token     token(CharClass cls, StrView& out) { return Token{ cls, &out }; }
+inline constexpr Utf8Token utf8token(CharClass cls) { return Utf8Token{ cls, nullptr }; }
+inline constexpr Utf8Token utf8token(CharClass cls, StrView& out) { return Utf8Token{ cls, &out }; }
+inline constexpr SkipClass skip(CharClass cls) { return SkipClass{ cls }; }
+inline constexpr Quoted    quoted(StrView& out, char quote = '"') { return Quoted{ quote, &out }; }
+inline constexpr Quoted    quoted(char quote = '"') { return Quoted{ quote, nullptr }; }
+inline constexpr SkipComments comments(unsigned styles) { return SkipComments{ styles }; }
+
+template <class T>
+inline constexpr Number<T> number(T& out) {
+    static_assert(std::is_arithmetic<T>::value, "number() requires an arithmetic capture");
+    return Number<T>{ &out };
+}
+inline constexpr Number<double> number() { return Number<double>{ nullptr }; }
+
+constexpr SkipClass    ws  = SkipClass{ space };
+constexpr SkipComments wsc = SkipComments{ tsCommentCPP };
+constexpr EndOfLine    eol = EndOfLine{};
+constexpr EndOfInput   eoi = EndOfInput{};
+
+namespace detail {
+    constexpr Seq<> make_seq() { return Seq<>{}; }
+    template <class P, class... Ps>
+    constexpr Seq<P, Ps...> make_seq(P const& p, Ps const&... ps) {
+        return Seq<P, Ps...>{ p, make_seq(ps...) };
+    }
+
+    template <class... As, class... Bs, size_t... I, size_t... J>
+    constexpr Seq<As..., Bs...> cat(Seq<As...> const& a, Seq<Bs...> const& b,
+                                    std::index_sequence<I...>, std::index_sequence<J...>);
+
+    template <size_t I, class... Ps>
+    constexpr auto const& get(Seq<Ps...> const& s) {
+        if constexpr (I == 0)
+            return s.head;
+        else
+            return get<I - 1>(s.tail);
+    }
+
+    template <class... As, class... Bs, size_t... I, size_t... J>
+    constexpr Seq<As..., Bs...> cat(Seq<As...> const& a, Seq<Bs...> const& b,
+                                    std::index_sequence<I...>, std::index_sequence<J...>) {
+        return make_seq(get<I>(a)..., get<J>(b)...);
+    }
+
+    template <class P> constexpr Seq<P> as_seq(P const& p) { return make_seq(p); }
+    template <class... Ps> constexpr Seq<Ps...> const& as_seq(Seq<Ps...> const& s) { return s; }
+
+    template <class P> struct SeqSize { static constexpr size_t value = 1; };
+    template <class... Ps> struct SeqSize<Seq<Ps...>> { static constexpr size_t value = sizeof...(Ps); };
+}
+
+template <class... Ps>
+inline constexpr Seq<Lifted<Ps>...> seq(Ps const&... ps) {
+    return detail::make_seq(lift(ps)...);
+}
+
+// whitespace followed by p, the common shape of a token in a line format
+template <class P>
+inline constexpr Seq<SkipClass, Lifted<P>> tok(P const& p) {
+    return seq(ws, p);
+}
+
+template <class P>
+inline constexpr Repeat<Lifted<P>> repeat(P const& p, size_t min = 0, size_t max = 0) {
+    return Repeat<Lifted<P>>{ lift(p), min, max };
+}
+
+template <class P>
+inline constexpr Optional<Lifted<P>> opt(P const& p) { return Optional<Lifted<P>>{ lift(p) }; }
+
+template <class P>
+inline constexpr Not<Lifted<P>> not_(P const& p) { return Not<Lifted<P>>{ lift(p) }; }
+
+template <class P>
+inline constexpr Capture<Lifted<P>> capture(P const& p, StrView& out) { return Capture<Lifted<P>>{ lift(p), &out }; }
+
+template <class P, class F>
+inline constexpr Action<Lifted<P>, F> action(P const& p, F fn) { return Action<Lifted<P>, F>{ lift(p), fn }; }
+
+// a >> b matches a then b. Sequences flatten, so a >> b >> c is one Seq.
+template <class A, class B,
+          class = std::enable_if_t<IsParser<A>::value || IsParser<B>::value>>
+inline constexpr auto operator>>(A const& a, B const& b) {
+    auto sa = detail::as_seq(lift(a));
+    auto sb = detail::as_seq(lift(b));
+    using SA = decltype(sa);
+    using SB = decltype(sb);
+    return detail::cat(sa, sb,
+                       std::make_index_sequence<detail::SeqSize<SA>::value>{},
+                       std::make_index_sequence<detail::SeqSize<SB>::value>{});
+}
+
+// a | b tries a, then b
+template <class A, class B,
+          class = std::enable_if_t<IsParser<A>::value || IsParser<B>::value>>
+inline constexpr Choice<Lifted<A>, Lifted<B>> operator|(A const& a, B const& b) {
+    return Choice<Lifted<A>, Lifted<B>>{ lift(a), lift(b) };
+}
+
+// *p matches zero or more, +p one or more, -p optionally
+template <class P, class = std::enable_if_t<IsParser<P>::value>>
+inline constexpr Repeat<P> operator*(P const& p) { return Repeat<P>{ p, 0, 0 }; }
+template <class P, class = std::enable_if_t<IsParser<P>::value>>
+inline constexpr Repeat<P> operator+(P const& p) { return Repeat<P>{ p, 1, 0 }; }
+template <class P, class = std::enable_if_t<IsParser<P>::value>>
+inline constexpr Optional<P> operator-(P const& p) { return Optional<P>{ p }; }
+
+//-----------------------------------------------------------------------------
+// Entry points
+//-----------------------------------------------------------------------------
+
+// Match g at the start of s. On success s is advanced past the match.
+template <class G>
+inline bool Parse(G const& g, StrView& s) {
+    decltype(auto) p = [&]() -> decltype(auto) {
+        if constexpr (IsParser<G>::value)
+            return (g);
+        else
+            return lift(g);
+    }();
+    char const* curr = s.curr;
+    char const* end = s.curr + s.sz;
+    if (!p.Match(curr, end))
+        return false;
+    s = StrView(curr, (size_t)(end - curr));
+    return true;
+}
+
+// Match g against the whole of s, ignoring trailing white space.
+template <class G>
+inline bool ParseAll(G const& g, StrView s) {
+    return Parse(seq(g, ws, eoi), s);
+}
+
+}}} // lab::Text::Grammar
+
+#endif // LABTEXT_GRAMMAR_H